@@ -6,24 +6,66 @@
 #include <time.h>
 #include <math.h>
 #include <signal.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// JVM Native Memory Tracking categories kept per sample (committed KB).
+// NMT_TOTAL is the "Total:" line, the rest are "- <name> (...)" sections.
+typedef enum {
+    NMT_TOTAL, NMT_HEAP, NMT_CLASS, NMT_METASPACE, NMT_THREAD, NMT_CODE, NMT_GC,
+    NMT_COMPILER, NMT_INTERNAL, NMT_OTHER, NMT_SYMBOL, NMT_ARENA,
+    NMT_CATEGORIES
+} nmt_category_t;
 
 // [Keep all the typedef structs from before - snapshot_t, etc.]
 typedef struct snapshot {
     uint64_t timestamp_sec;
+    // CLOCK_MONOTONIC midpoint of each source's read, in ns
+    uint64_t slab_ns;
+    uint64_t vmstat_ns;
+    uint64_t buddy_ns;
+    uint64_t jvm_ns;
+    uint64_t shrinker_ns;
+    uint64_t pagetype_ns;           // 0 when pagetypeinfo was not read this sample
+    uint64_t nmt_ns;                // 0 when no new NMT summary arrived this sample
     uint32_t kmalloc_1k_active;
     uint32_t kmalloc_4k_active;
     uint32_t slab_reclaimable_objs;
     uint32_t slab_unreclaimable_objs;
     uint64_t slabs_scanned;
-    uint64_t pgalloc_dma;
-    uint64_t pgsteal_kswapd;
+    uint64_t pgalloc_total;     // sum of every pgalloc_<zone>
+    uint64_t pgscan_total;      // kswapd + direct + khugepaged + proactive
+    uint64_t pgsteal_total;
+    uint64_t compact_stall;
+    uint64_t compact_fail;
+    uint64_t thp_fault_fallback;
     uint32_t order2_free_pages;
     uint32_t order3_free_pages;
     uint64_t metaspace_used_kb;
     uint64_t metaspace_committed_kb;
+    uint64_t shrinker_freeable;     // summed over every shrinker, 0 when off
+    uint32_t unmovable_blocks;      // pageblocks per migratetype, all zones
+    uint32_t movable_blocks;
+    uint32_t reclaimable_blocks;
+    uint64_t unmovable_free_pages;  // free pages on the Unmovable lists
+    uint32_t kmsg_events;           // memory-relevant kernel messages since the last sample
+    uint64_t nmt_kb[NMT_CATEGORIES];    // committed, carried forward between summaries
     double slabs_scanned_per_sec;
     double allocation_rate_kb_per_sec;
+    double reclaim_efficiency;  // pgsteal / pgscan over the interval
+    double compact_stall_per_sec;
+    double high_order_fail_per_sec; // compact_fail + thp_fault_fallback
     double fragmentation_index;
     struct snapshot *next;
 } snapshot_t;
@@ -38,10 +80,251 @@ typedef struct {
     double correlation;
     double coefficient_var;
     double mean_pressure;
+    double frag_failure_correlation; // fragmentation index vs high-order failures
+    double mean_compact_stall;
 } correlation_result_t;
 
 volatile sig_atomic_t running = 1;
 int debug_mode = 0;  // NEW: Debug flag
+size_t max_samples = 0;  // --samples N: report after N samples, 0 = until Ctrl+C
+
+// Fixed-footprint mode (--fixed N): N snapshots plus the correlation
+// scratch arrays live in one region mapped at startup, so sampling never
+// allocates. When the pool is used up collection stops with a diagnostic.
+#define CORRELATION_SERIES 5
+// raw and resampled values, one time base per source, the grid, the
+// interpolation weights, then one index array
+#define CORRELATION_CLOCKS 4
+#define CORRELATION_DOUBLES (2 * CORRELATION_SERIES + CORRELATION_CLOCKS + 2)
+#define CORRELATION_SCRATCH_BYTES(n) \
+    (CORRELATION_DOUBLES * (n) * sizeof(double) + (n) * sizeof(size_t))
+
+typedef struct {
+    snapshot_t *pool;
+    size_t capacity;
+    size_t used;
+    double *scratch;    // CORRELATION_SCRATCH_BYTES(capacity)
+    size_t heap_mark;   // heap in use after the first sample
+} fixed_region_t;
+
+fixed_region_t fixed_region = {NULL, 0, 0, NULL, 0};
+
+// /proc files read every sample (pagetypeinfo every N). Each is opened
+// once and re-read with pread() from offset 0 into its own buffer, carved
+// from the fixed region in --fixed mode and malloc()ed once otherwise;
+// the parsers split it into lines in place.
+typedef struct {
+    const char *path;
+    int fd;
+    char *buf;
+    size_t cap;
+} proc_file_t;
+
+enum { PROC_SLABINFO, PROC_VMSTAT, PROC_BUDDYINFO, PROC_PAGETYPEINFO, PROC_FILES };
+
+proc_file_t proc_files[PROC_FILES] = {
+    { "/proc/slabinfo", -1, NULL, 256 * 1024 },
+    { "/proc/vmstat", -1, NULL, 32 * 1024 },
+    { "/proc/buddyinfo", -1, NULL, 4096 },
+    { "/proc/pagetypeinfo", -1, NULL, 32 * 1024 },
+};
+
+// Streaming export. Every sample is formatted into a large userspace
+// buffer as it is taken; the buffer goes to disk and is fdatasync()ed every
+// sync period (or when full), so a crash loses at most that period. The
+// active file is rotated to <path>.<n> by size or age.
+#define EXPORT_BUF_SIZE   (1 << 20)
+#define EXPORT_ROW_MAX    2048
+#define EXPORT_SYNC_SEC   10
+
+typedef enum { EXPORT_CSV, EXPORT_JSONL } export_format_t;
+
+typedef struct {
+    export_format_t format;
+    const char *path;
+    int fd;
+    size_t len;
+    char buf[EXPORT_BUF_SIZE];
+    uint64_t file_bytes;        // bytes in the active file, buffered included
+    uint64_t file_opened;       // sample time the active file was started
+    uint64_t last_sync;
+    uint64_t rotate_bytes;      // 0 = no size rotation
+    uint64_t rotate_sec;        // 0 = no time rotation
+    uint64_t sync_sec;
+    unsigned rotations;
+    uint64_t rows;
+} exporter_t;
+
+exporter_t exporter = { .fd = -1, .sync_sec = EXPORT_SYNC_SEC };
+
+// Shrinker debugfs (--shrinkers[=DIR], kernel 6.0+). Each shrinker has a
+// directory with a `count` file: one line per memcg holding freeable
+// objects, "<memcg inode> <node0> <node1> ...". The shrinkers are
+// enumerated once and their directories held open; every sample opens
+// `count` relative to its directory. DIR may be a recorded fixture tree.
+#define SHRINKER_DIR      "/sys/kernel/debug/shrinker"
+#define SHRINKER_MAX      64
+#define SHRINKER_HISTORY  720       // samples kept per shrinker, 1h at 5s
+#define SHRINKER_TOP      10
+
+typedef struct {
+    char name[NAME_MAX + 1];        // directory name under SHRINKER_DIR
+    int dirfd;
+    uint64_t freeable;              // latest, summed over memcgs and nodes
+    unsigned memcgs;                // memcgs with freeable objects
+    uint64_t top_memcg_ino;
+    uint64_t top_memcg_freeable;
+    uint64_t *series;               // SHRINKER_HISTORY samples, ring shared below
+} shrinker_t;
+
+typedef struct {
+    const char *dir;                // NULL = collector off
+    shrinker_t list[SHRINKER_MAX];
+    size_t count;
+    double t[SHRINKER_HISTORY];     // seconds since the first sample
+    double scan_rate[SHRINKER_HISTORY]; // slabs_scanned/sec of the same sample
+    size_t head, len;
+    uint64_t base_ns;
+} shrinker_set_t;
+
+shrinker_set_t shrinkers = { .dir = NULL };
+
+// Pageblock migratetypes (--pagetypeinfo[=N], root). Reading
+// /proc/pagetypeinfo walks every free list under the zone lock, so it is
+// read every N samples only. Per zone it gives free pages per migratetype
+// and order and the number of pageblocks of each migratetype; unmovable
+// pageblocks that keep appearing are what later defeats compaction.
+#define PAGETYPE_EVERY      12
+#define PAGETYPE_MAX_ZONES  16
+#define PAGETYPE_MAX_TYPES  8
+#define PAGETYPE_MAX_ORDER  16
+#define PAGETYPE_NAME       16
+
+typedef struct {
+    int node;
+    char name[PAGETYPE_NAME];
+    uint32_t free[PAGETYPE_MAX_TYPES][PAGETYPE_MAX_ORDER];
+    uint32_t blocks[PAGETYPE_MAX_TYPES];
+} pagetype_zone_t;
+
+typedef struct {
+    unsigned pages_per_block;
+    int norders;
+    int ntypes;
+    char type[PAGETYPE_MAX_TYPES][PAGETYPE_NAME];
+    size_t nzones;
+    pagetype_zone_t zone[PAGETYPE_MAX_ZONES];
+} pagetype_t;
+
+pagetype_t pagetype;
+int pagetype_every = 0;             // 0 = collector off
+
+// Kernel log (--kmsg[=PATH]). /dev/kmsg is opened non-blocking and drained
+// while the loop waits for the next sample; records are split
+// incrementally, so a recorded fixture file (PATH) parses the same way.
+// Record timestamps are microseconds on the kernel's monotonic clock,
+// the timeline the snapshots' *_ns fields already use. Memory-relevant
+// records are picked out by a literal-pattern matcher built once at
+// startup: one pass over the text, no allocation.
+#define KMSG_DEVICE       "/dev/kmsg"
+#define KMSG_BUF_SIZE     8192      // one /dev/kmsg record always fits
+#define KMSG_EVENTS_MAX   256
+#define KMSG_MSG_MAX      160
+
+typedef enum {
+    KMSG_ALLOC_FAIL, KMSG_SLAB_FAIL, KMSG_OOM, KMSG_MODULE, KMSG_LEAK, KMSG_CORRUPTION,
+    KMSG_CLASSES
+} kmsg_class_t;
+
+static const char *kmsg_class_names[KMSG_CLASSES] = {
+    "ALLOC FAIL", "SLAB FAIL", "OOM", "MODULE", "LEAK", "CORRUPTION"
+};
+
+static const struct {
+    const char *text;
+    kmsg_class_t cls;
+} kmsg_patterns[] = {
+    { "page allocation failure", KMSG_ALLOC_FAIL },
+    { "vmalloc error", KMSG_ALLOC_FAIL },
+    { "SLUB: Unable to allocate memory", KMSG_SLAB_FAIL },
+    { "Out of memory", KMSG_OOM },
+    { "out of memory", KMSG_OOM },
+    { "oom-kill:", KMSG_OOM },
+    { "Killed process", KMSG_OOM },
+    { "loading out-of-tree module", KMSG_MODULE },
+    { "module verification failed", KMSG_MODULE },
+    { "kmemleak:", KMSG_LEAK },
+    { "Poison overwritten", KMSG_CORRUPTION },
+    { "Redzone overwritten", KMSG_CORRUPTION },
+    { "BUG: KASAN", KMSG_CORRUPTION },
+    { "BUG: Bad page", KMSG_CORRUPTION },
+};
+#define KMSG_NPATTERNS (sizeof(kmsg_patterns) / sizeof(kmsg_patterns[0]))
+
+typedef struct {
+    uint64_t ns;                    // CLOCK_MONOTONIC
+    uint64_t seq;
+    kmsg_class_t cls;
+    char msg[KMSG_MSG_MAX];
+} kmsg_event_t;
+
+typedef struct {
+    int fd;
+    int eof;                        // fixture read to the end
+    const char *path;
+    char buf[KMSG_BUF_SIZE + 1];
+    size_t have;                    // partial record carried to the next read
+    // first byte -> patterns starting with it, as a bit mask
+    uint32_t first[256];
+    size_t pattern_len[KMSG_NPATTERNS];
+    kmsg_event_t events[KMSG_EVENTS_MAX];
+    size_t head, len;
+    uint64_t counts[KMSG_CLASSES];
+    uint32_t pending;               // events since the last sample
+    uint64_t lost;                  // records overwritten before we read them
+} kmsg_reader_t;
+
+kmsg_reader_t kmsg = { .fd = -1 };
+
+// JVM Native Memory Tracking (--nmt[=N|PATH], JVM started with
+// -XX:NativeMemoryTracking=summary). Every N samples `jcmd <pid>
+// VM.native_memory summary scale=KB` is started in the background; its
+// output is read from a non-blocking pipe while the loop waits, so a slow
+// attach never delays sampling, and a run still going at the next turn
+// skips that turn. Lines are parsed in place out of a fixed buffer. PATH
+// replays captured output instead: summaries appended one after another,
+// one taken per turn.
+#define NMT_EVERY         12
+#define NMT_BUF_SIZE      4096
+#define NMT_TIMEOUT_SEC   60
+#define NMT_HEADER        "Native Memory Tracking:"
+
+static const char *nmt_category_names[NMT_CATEGORIES] = {
+    "Total", "Java Heap", "Class", "Metaspace", "Thread", "Code", "GC",
+    "Compiler", "Internal", "Other", "Symbol", "Arena Chunk"
+};
+
+typedef struct {
+    int every;                      // 0 = collector off
+    const char *fixture;            // replayed instead of running jcmd
+    int fd;                         // jcmd's stdout or the fixture, -1 between runs
+    pid_t child;
+    int eof;                        // fixture used up
+    char buf[NMT_BUF_SIZE + 1];
+    size_t have;                    // partial line carried to the next read
+    int in_summary;
+    int saw_total;
+    int not_enabled;                // the JVM runs without NMT
+    uint64_t cur[NMT_CATEGORIES];   // summary being parsed
+    uint64_t started_ns;
+    // the latest complete summary, taken by the next sample
+    uint64_t kb[NMT_CATEGORIES];
+    uint64_t ns;
+    int ready;
+    unsigned summaries, skipped, failed;
+} nmt_reader_t;
+
+nmt_reader_t nmt = { .fd = -1, .child = -1 };
 
 #define INTERVAL_STARTUP  1
 #define INTERVAL_NORMAL   5
@@ -61,22 +344,67 @@ void signal_handler(int signum) {
     printf("\n\nReceived interrupt signal. Generating report...\n");
 }
 
+// The whole file into pf->buf, NUL-terminated. Returns its length, or
+// -1 with errno set. A file larger than the buffer is cut at the last
+// whole line.
+ssize_t proc_read(proc_file_t *pf) {
+    if (pf->fd < 0) {
+        pf->fd = open(pf->path, O_RDONLY | O_CLOEXEC);
+        if (pf->fd < 0) return -1;
+    }
+    if (!pf->buf) {
+        pf->buf = malloc(pf->cap);
+        if (!pf->buf) return -1;
+    }
+    size_t len = 0;
+    ssize_t n;
+    while (len < pf->cap - 1 &&
+           (n = pread(pf->fd, pf->buf + len, pf->cap - 1 - len, (off_t)len)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        len += (size_t)n;
+    }
+    if (len == pf->cap - 1) {
+        while (len > 0 && pf->buf[len - 1] != '\n') len--;
+        if (debug_mode) fprintf(stderr, "DEBUG: %s cut at %zu bytes\n", pf->path, len);
+    }
+    pf->buf[len] = '\0';
+    return (ssize_t)len;
+}
+
+// Terminates the line at *cursor and moves the cursor past it; NULL at
+// the end of the buffer.
+static char *proc_next_line(char **cursor) {
+    char *line = *cursor;
+    if (!line || !*line) return NULL;
+    char *nl = strchr(line, '\n');
+    if (nl) {
+        *nl = '\0';
+        *cursor = nl + 1;
+    } else {
+        *cursor = NULL;
+    }
+    return line;
+}
+
 // IMPROVED: Better slabinfo parser with debug output
 int parse_slabinfo(snapshot_t *snap) {
-    FILE *fp = fopen("/proc/slabinfo", "r");
-    if (!fp) {
-        perror("Cannot open /proc/slabinfo");
+    proc_file_t *pf = &proc_files[PROC_SLABINFO];
+    if (proc_read(pf) < 0) {
+        perror("Cannot read /proc/slabinfo");
         return -1;
     }
 
-    char line[512];
+    char *cursor = pf->buf, *line;
     int found_1k = 0, found_4k = 0;
 
     // Skip 2 header lines
-    fgets(line, sizeof(line), fp);
-    fgets(line, sizeof(line), fp);
+    proc_next_line(&cursor);
+    proc_next_line(&cursor);
 
-    while (fgets(line, sizeof(line), fp)) {
+    while ((line = proc_next_line(&cursor)) != NULL) {
         char name[64];
         unsigned long active_objs, num_objs, objsize;
 
@@ -105,29 +433,49 @@ int parse_slabinfo(snapshot_t *snap) {
                 found_1k, found_4k);
     }
 
-    fclose(fp);
     return 0;
 }
 
 int parse_vmstat(snapshot_t *snap) {
-    FILE *fp = fopen("/proc/vmstat", "r");
-    if (!fp) {
-        perror("Cannot open /proc/vmstat");
+    proc_file_t *pf = &proc_files[PROC_VMSTAT];
+    if (proc_read(pf) < 0) {
+        perror("Cannot read /proc/vmstat");
         return -1;
     }
 
+    char *cursor = pf->buf, *line;
     char key[64];
     uint64_t value;
 
-    while (fscanf(fp, "%63s %lu", key, &value) == 2) {
+    while ((line = proc_next_line(&cursor)) != NULL &&
+           sscanf(line, "%63s %lu", key, &value) == 2) {
         if (strcmp(key, "slabs_scanned") == 0) {
             snap->slabs_scanned = value;
         }
-        else if (strcmp(key, "pgalloc_dma") == 0) {
-            snap->pgalloc_dma = value;
+        else if (strncmp(key, "pgalloc_", 8) == 0) {
+            // pgalloc_dma alone is ~0 on x86_64, take every zone
+            snap->pgalloc_total += value;
+        }
+        else if (strcmp(key, "pgscan_kswapd") == 0 ||
+                 strcmp(key, "pgscan_direct") == 0 ||
+                 strcmp(key, "pgscan_khugepaged") == 0 ||
+                 strcmp(key, "pgscan_proactive") == 0) {
+            snap->pgscan_total += value;
+        }
+        else if (strcmp(key, "pgsteal_kswapd") == 0 ||
+                 strcmp(key, "pgsteal_direct") == 0 ||
+                 strcmp(key, "pgsteal_khugepaged") == 0 ||
+                 strcmp(key, "pgsteal_proactive") == 0) {
+            snap->pgsteal_total += value;
+        }
+        else if (strcmp(key, "compact_stall") == 0) {
+            snap->compact_stall = value;
         }
-        else if (strcmp(key, "pgsteal_kswapd") == 0) {
-            snap->pgsteal_kswapd = value;
+        else if (strcmp(key, "compact_fail") == 0) {
+            snap->compact_fail = value;
+        }
+        else if (strcmp(key, "thp_fault_fallback") == 0) {
+            snap->thp_fault_fallback = value;
         }
         else if (strcmp(key, "nr_slab_reclaimable") == 0) {
             snap->slab_reclaimable_objs = value;
@@ -137,20 +485,19 @@ int parse_vmstat(snapshot_t *snap) {
         }
     }
 
-    fclose(fp);
     return 0;
 }
 
 int parse_buddyinfo(snapshot_t *snap) {
-    FILE *fp = fopen("/proc/buddyinfo", "r");
-    if (!fp) {
-        perror("Cannot open /proc/buddyinfo");
+    proc_file_t *pf = &proc_files[PROC_BUDDYINFO];
+    if (proc_read(pf) < 0) {
+        perror("Cannot read /proc/buddyinfo");
         return -1;
     }
 
-    char line[512];
+    char *cursor = pf->buf, *line;
 
-    while (fgets(line, sizeof(line), fp)) {
+    while ((line = proc_next_line(&cursor)) != NULL) {
         if (strstr(line, "zone") == NULL) continue;
 
         char zone[32];
@@ -169,31 +516,68 @@ int parse_buddyinfo(snapshot_t *snap) {
         }
     }
 
-    fclose(fp);
     return 0;
 }
 
-// COMPLETELY REWRITTEN: Better JVM metaspace parser
-int get_jvm_metaspace(pid_t pid, snapshot_t *snap) {
-    char cmd[512];
-    FILE *pipe;
-
-    // Get the Both: line and clean up extra spaces
-    snprintf(cmd, sizeof(cmd),
-             "jcmd %d VM.metaspace 2>/dev/null | grep 'Both:' | sed 's/  */ /g'",
-             pid);
+// `jcmd <pid> VM.metaspace` on a pipe, read with plain read()s: the
+// first "Both:" line is kept, the rest drained so jcmd can exit. No stdio
+// stream, so a sample allocates nothing here.
+static int jcmd_metaspace_line(pid_t pid, char *line, size_t size) {
+    char pid_arg[16];
+    snprintf(pid_arg, sizeof(pid_arg), "%d", pid);
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+    pid_t child = fork();
+    if (child == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) dup2(null, STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execlp("jcmd", "jcmd", pid_arg, "VM.metaspace", (char *)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+    if (child < 0) {
+        close(fds[0]);
+        return -1;
+    }
 
-    pipe = popen(cmd, "r");
-    if (!pipe) return -1;
+    char buf[4096];
+    size_t have = 0;
+    line[0] = '\0';
+    for (;;) {
+        ssize_t n = read(fds[0], buf + have, sizeof(buf) - 1 - have);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        have += (size_t)n;
+        buf[have] = '\0';
+        char *p = buf, *nl;
+        while ((nl = strchr(p, '\n')) != NULL) {
+            *nl = '\0';
+            const char *both = strstr(p, "Both:");
+            if (both && !line[0]) snprintf(line, size, "%s", both);
+            p = nl + 1;
+        }
+        have = strlen(p);
+        if (have == sizeof(buf) - 1) have = 0;   // no newline in a full buffer
+        memmove(buf, p, have);
+    }
+    close(fds[0]);
+    waitpid(child, NULL, 0);
+    return line[0] ? 0 : -1;
+}
 
+// COMPLETELY REWRITTEN: Better JVM metaspace parser
+int get_jvm_metaspace(pid_t pid, snapshot_t *snap) {
     char line[1024];
 
-    if (fgets(line, sizeof(line), pipe)) {
+    if (jcmd_metaspace_line(pid, line, sizeof(line)) == 0) {
         if (debug_mode) {
-            fprintf(stderr, "DEBUG: Cleaned line: %s", line);
+            fprintf(stderr, "DEBUG: Both line: %s\n", line);
         }
 
-        // After cleaning: "Both: 2422 chunks, 40.63 MB capacity, 40.20 MB ( 99%) committed, 39.67 MB ( 98%) used, ..."
+        // "Both: 2422 chunks, 40.63 MB capacity, 40.20 MB ( 99%) committed, 39.67 MB ( 98%) used, ..."
         // Extract all float+MB patterns
 
         float values[10];
@@ -237,16 +621,599 @@ int get_jvm_metaspace(pid_t pid, snapshot_t *snap) {
                         values[2], snap->metaspace_used_kb);
             }
 
-            pclose(pipe);
             return 0;
         }
     }
 
-    pclose(pipe);
     return -1;
 }
 
 
+// Enumerate the shrinkers once; the series are allocated here, before
+// sampling starts.
+int shrinkers_open(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        perror(dir);
+        return -1;
+    }
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        if (shrinkers.count == SHRINKER_MAX) {
+            fprintf(stderr, "shrinkers: more than %d under %s, tracking the first %d\n",
+                    SHRINKER_MAX, dir, SHRINKER_MAX);
+            break;
+        }
+        int fd = openat(dirfd(d), e->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) continue;
+        shrinker_t *s = &shrinkers.list[shrinkers.count++];
+        snprintf(s->name, sizeof(s->name), "%s", e->d_name);
+        s->dirfd = fd;
+    }
+    closedir(d);
+
+    if (shrinkers.count == 0) {
+        fprintf(stderr, "shrinkers: none found under %s\n", dir);
+        return -1;
+    }
+    uint64_t *series = calloc(shrinkers.count * SHRINKER_HISTORY, sizeof(uint64_t));
+    if (!series) return -1;
+    for (size_t i = 0; i < shrinkers.count; i++) {
+        shrinkers.list[i].series = series + i * SHRINKER_HISTORY;
+    }
+    shrinkers.dir = dir;
+    printf("Shrinkers: tracking %zu from %s\n", shrinkers.count, dir);
+    return 0;
+}
+
+// One "<memcg inode> <node0> <node1> ..." line.
+static void shrinker_parse_line(shrinker_t *s, const char *p) {
+    char *end;
+    uint64_t ino = strtoull(p, &end, 10);
+    if (end == p) return;
+    uint64_t total = 0;
+    for (p = end;; p = end) {
+        uint64_t v = strtoull(p, &end, 10);
+        if (end == p) break;
+        total += v;
+    }
+    s->freeable += total;
+    s->memcgs++;
+    if (total > s->top_memcg_freeable) {
+        s->top_memcg_freeable = total;
+        s->top_memcg_ino = ino;
+    }
+}
+
+// `count` can run to many lines with lots of memcgs: parse in chunks,
+// carrying a partial line over.
+static int shrinker_read(shrinker_t *s) {
+    static char buf[16384];
+    s->freeable = 0;
+    s->memcgs = 0;
+    s->top_memcg_ino = s->top_memcg_freeable = 0;
+
+    int fd = openat(s->dirfd, "count", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    size_t have = 0;
+    ssize_t n;
+    while ((n = read(fd, buf + have, sizeof(buf) - 1 - have)) > 0) {
+        have += (size_t)n;
+        buf[have] = '\0';
+        char *line = buf, *nl;
+        while ((nl = strchr(line, '\n')) != NULL) {
+            *nl = '\0';
+            shrinker_parse_line(s, line);
+            line = nl + 1;
+        }
+        have = strlen(line);
+        if (have == sizeof(buf) - 1) have = 0;  // absurd line, drop it
+        memmove(buf, line, have);
+    }
+    if (have) {
+        buf[have] = '\0';
+        shrinker_parse_line(s, buf);
+    }
+    close(fd);
+    return n < 0 ? -1 : 0;
+}
+
+int collect_shrinkers(snapshot_t *snap) {
+    if (!shrinkers.dir) return 0;
+    for (size_t i = 0; i < shrinkers.count; i++) {
+        shrinker_t *s = &shrinkers.list[i];
+        if (shrinker_read(s) == 0) {
+            snap->shrinker_freeable += s->freeable;
+        }
+    }
+    return 0;
+}
+
+void shrinkers_close(void) {
+    if (!shrinkers.dir) return;
+    for (size_t i = 0; i < shrinkers.count; i++) {
+        close(shrinkers.list[i].dirfd);
+    }
+    free(shrinkers.list[0].series);
+    shrinkers.dir = NULL;
+    shrinkers.count = 0;
+}
+
+// Once the sample's rates are known: append it to the shrinker series.
+void record_shrinkers(const snapshot_t *snap) {
+    if (!shrinkers.dir) return;
+    if (shrinkers.len == 0) shrinkers.base_ns = snap->shrinker_ns;
+    size_t k = shrinkers.head;
+    shrinkers.t[k] = (double)(int64_t)(snap->shrinker_ns - shrinkers.base_ns) / 1e9;
+    shrinkers.scan_rate[k] = snap->slabs_scanned_per_sec;
+    for (size_t i = 0; i < shrinkers.count; i++) {
+        shrinkers.list[i].series[k] = shrinkers.list[i].freeable;
+    }
+    shrinkers.head = (k + 1) % SHRINKER_HISTORY;
+    if (shrinkers.len < SHRINKER_HISTORY) shrinkers.len++;
+}
+
+
+static int pagetype_type_index(const char *name) {
+    for (int t = 0; t < pagetype.ntypes; t++) {
+        if (strcmp(pagetype.type[t], name) == 0) return t;
+    }
+    if (pagetype.ntypes == PAGETYPE_MAX_TYPES) return -1;
+    snprintf(pagetype.type[pagetype.ntypes], PAGETYPE_NAME, "%s", name);
+    return pagetype.ntypes++;
+}
+
+static pagetype_zone_t *pagetype_zone(int node, const char *name) {
+    for (size_t z = 0; z < pagetype.nzones; z++) {
+        pagetype_zone_t *zone = &pagetype.zone[z];
+        if (zone->node == node && strcmp(zone->name, name) == 0) return zone;
+    }
+    if (pagetype.nzones == PAGETYPE_MAX_ZONES) return NULL;
+    pagetype_zone_t *zone = &pagetype.zone[pagetype.nzones++];
+    zone->node = node;
+    snprintf(zone->name, PAGETYPE_NAME, "%s", name);
+    return zone;
+}
+
+// Up to `max` numbers from p on; returns how many.
+static int pagetype_numbers(const char *p, uint32_t *v, int max) {
+    int n = 0;
+    char *end;
+    while (n < max) {
+        unsigned long x = strtoul(p, &end, 10);
+        if (end == p) break;
+        v[n++] = (uint32_t)x;
+        p = end;
+    }
+    return n;
+}
+
+// Fill the zone x migratetype x order matrix, then the sample's totals.
+int parse_pagetypeinfo(snapshot_t *snap) {
+    proc_file_t *pf = &proc_files[PROC_PAGETYPEINFO];
+    if (proc_read(pf) < 0) {
+        perror("Cannot read /proc/pagetypeinfo (root only), pagetype collector off");
+        pagetype_every = 0;
+        return -1;
+    }
+
+    char *cursor = pf->buf, *line;
+    int block_col[PAGETYPE_MAX_TYPES];  // "Number of blocks" column -> type
+    int block_cols = 0;
+    for (size_t z = 0; z < pagetype.nzones; z++) {
+        memset(pagetype.zone[z].free, 0, sizeof(pagetype.zone[z].free));
+        memset(pagetype.zone[z].blocks, 0, sizeof(pagetype.zone[z].blocks));
+    }
+
+    while ((line = proc_next_line(&cursor)) != NULL) {
+        int node, pos = 0;
+        char zone_name[PAGETYPE_NAME], type_name[PAGETYPE_NAME];
+
+        if (sscanf(line, "Pages per block: %u", &pagetype.pages_per_block) == 1) continue;
+        if (strncmp(line, "Free pages count", 16) == 0) {
+            uint32_t orders[PAGETYPE_MAX_ORDER];
+            const char *at = strstr(line, "order");
+            pagetype.norders = at ? pagetype_numbers(at + 5, orders, PAGETYPE_MAX_ORDER) : 0;
+            continue;
+        }
+        if (strncmp(line, "Number of blocks type", 21) == 0) {
+            char *save, *tok = strtok_r(line + 21, " \t\n", &save);
+            for (block_cols = 0; tok && block_cols < PAGETYPE_MAX_TYPES;
+                 tok = strtok_r(NULL, " \t\n", &save)) {
+                block_col[block_cols++] = pagetype_type_index(tok);
+            }
+            continue;
+        }
+        if (sscanf(line, "Node %d, zone %15[^,], type %15s%n", &node, zone_name, type_name, &pos) == 3) {
+            pagetype_zone_t *zone = pagetype_zone(node, zone_name);
+            int t = pagetype_type_index(type_name);
+            if (zone && t >= 0) {
+                pagetype_numbers(line + pos, zone->free[t], pagetype.norders);
+            }
+            continue;
+        }
+        if (block_cols && sscanf(line, "Node %d, zone %15s%n", &node, zone_name, &pos) == 2) {
+            pagetype_zone_t *zone = pagetype_zone(node, zone_name);
+            uint32_t v[PAGETYPE_MAX_TYPES];
+            int n = pagetype_numbers(line + pos, v, block_cols);
+            for (int c = 0; zone && c < n; c++) {
+                if (block_col[c] >= 0) zone->blocks[block_col[c]] = v[c];
+            }
+        }
+    }
+
+    int unmovable = pagetype_type_index("Unmovable");
+    int movable = pagetype_type_index("Movable");
+    int reclaimable = pagetype_type_index("Reclaimable");
+    for (size_t z = 0; z < pagetype.nzones; z++) {
+        const pagetype_zone_t *zone = &pagetype.zone[z];
+        if (unmovable >= 0) {
+            snap->unmovable_blocks += zone->blocks[unmovable];
+            for (int o = 0; o < pagetype.norders; o++) {
+                snap->unmovable_free_pages += (uint64_t)zone->free[unmovable][o] << o;
+            }
+        }
+        if (movable >= 0) snap->movable_blocks += zone->blocks[movable];
+        if (reclaimable >= 0) snap->reclaimable_blocks += zone->blocks[reclaimable];
+    }
+    return 0;
+}
+
+
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int kmsg_open(const char *path) {
+    kmsg.fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (kmsg.fd < 0) {
+        perror(path);
+        return -1;
+    }
+    // the live log: only what happens from now on
+    struct stat st;
+    if (fstat(kmsg.fd, &st) == 0 && S_ISCHR(st.st_mode)) {
+        lseek(kmsg.fd, 0, SEEK_END);
+    }
+    for (size_t i = 0; i < KMSG_NPATTERNS; i++) {
+        kmsg.pattern_len[i] = strlen(kmsg_patterns[i].text);
+        kmsg.first[(unsigned char)kmsg_patterns[i].text[0]] |= 1u << i;
+    }
+    kmsg.path = path;
+    printf("Kernel log: %s\n", path);
+    return 0;
+}
+
+static int kmsg_classify(const char *msg, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint32_t m = kmsg.first[(unsigned char)msg[i]];
+        while (m) {
+            int p = __builtin_ctz(m);
+            m &= m - 1;
+            if (kmsg.pattern_len[p] <= len - i &&
+                memcmp(msg + i, kmsg_patterns[p].text, kmsg.pattern_len[p]) == 0) {
+                return kmsg_patterns[p].cls;
+            }
+        }
+    }
+    return -1;
+}
+
+// "<prio>,<seq>,<usec>,<flags>[,...];<text>"; continuation lines start
+// with a space and carry dictionary keys we don't need.
+static void kmsg_record(const char *line, size_t len) {
+    char *end;
+    unsigned long prio = strtoul(line, &end, 10);
+    if (*end != ',' || prio >> 3 != 0) return;   // kernel facility only
+    uint64_t seq = strtoull(end + 1, &end, 10);
+    if (*end != ',') return;
+    uint64_t usec = strtoull(end + 1, &end, 10);
+    const char *text = memchr(line, ';', len);
+    if (!text) return;
+    text++;
+    size_t tlen = len - (size_t)(text - line);
+
+    int cls = kmsg_classify(text, tlen);
+    if (cls < 0) return;
+
+    kmsg_event_t *ev = &kmsg.events[kmsg.head];
+    ev->ns = usec * 1000;
+    ev->seq = seq;
+    ev->cls = (kmsg_class_t)cls;
+    size_t n = tlen < KMSG_MSG_MAX - 1 ? tlen : KMSG_MSG_MAX - 1;
+    memcpy(ev->msg, text, n);
+    ev->msg[n] = '\0';
+    kmsg.head = (kmsg.head + 1) % KMSG_EVENTS_MAX;
+    if (kmsg.len < KMSG_EVENTS_MAX) kmsg.len++;
+    kmsg.counts[cls]++;
+    kmsg.pending++;
+    printf("    kmsg [%5lu.%06lu] %s: %s\n", (unsigned long)(usec / 1000000),
+           (unsigned long)(usec % 1000000), kmsg_class_names[cls], ev->msg);
+}
+
+// Everything readable right now, without blocking.
+void kmsg_drain(void) {
+    if (kmsg.fd < 0 || kmsg.eof) return;
+    for (;;) {
+        ssize_t n = read(kmsg.fd, kmsg.buf + kmsg.have, KMSG_BUF_SIZE - kmsg.have);
+        if (n < 0) {
+            if (errno == EPIPE) {       // overwritten under us, resume at the oldest left
+                kmsg.lost++;
+                continue;
+            }
+            if (errno == EINTR) continue;
+            return;                     // EAGAIN: nothing more for now
+        }
+        if (n == 0) {
+            kmsg.eof = 1;
+            if (kmsg.have) kmsg_record(kmsg.buf, kmsg.have);
+            kmsg.have = 0;
+            return;
+        }
+        kmsg.have += (size_t)n;
+        char *line = kmsg.buf, *end = kmsg.buf + kmsg.have, *nl;
+        while ((nl = memchr(line, '\n', (size_t)(end - line))) != NULL) {
+            if (*line != ' ') kmsg_record(line, (size_t)(nl - line));
+            line = nl + 1;
+        }
+        kmsg.have = (size_t)(end - line);
+        if (kmsg.have == KMSG_BUF_SIZE) kmsg.have = 0;   // no newline in a full buffer
+        memmove(kmsg.buf, line, kmsg.have);
+    }
+}
+
+void kmsg_close(void) {
+    if (kmsg.fd >= 0) close(kmsg.fd);
+    kmsg.fd = -1;
+}
+
+// "... (reserved=<n>KB, committed=<n>KB)" -> committed KB
+static int nmt_committed(const char *p, const char *end, uint64_t *kb) {
+    static const char key[] = "committed=";
+    for (; (size_t)(end - p) >= sizeof(key) - 1; p++) {
+        if (*p != 'c' || memcmp(p, key, sizeof(key) - 1) != 0) continue;
+        p += sizeof(key) - 1;
+        if (p == end || *p < '0' || *p > '9') return -1;
+        uint64_t v = 0;
+        while (p < end && *p >= '0' && *p <= '9') v = v * 10 + (uint64_t)(*p++ - '0');
+        *kb = v;
+        return 0;
+    }
+    return -1;
+}
+
+static void nmt_commit(void) {
+    uint64_t now = monotonic_ns();
+    memcpy(nmt.kb, nmt.cur, sizeof(nmt.kb));
+    // jcmd: the JVM answered somewhere between start and end of the run
+    nmt.ns = nmt.fixture ? now : nmt.started_ns + (now - nmt.started_ns) / 2;
+    nmt.ready = 1;
+    nmt.summaries++;
+    nmt.in_summary = 0;
+}
+
+// One line of summary output, not NUL-terminated. Returns 1 when it
+// completed the summary before it (a header following a whole summary).
+static int nmt_line(const char *p, size_t len) {
+    const char *end = p + len;
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    size_t left = (size_t)(end - p);
+
+    if (left >= sizeof(NMT_HEADER) - 1 && memcmp(p, NMT_HEADER, sizeof(NMT_HEADER) - 1) == 0) {
+        int done = nmt.in_summary && nmt.saw_total;
+        if (done) nmt_commit();
+        nmt.in_summary = 1;
+        nmt.saw_total = 0;
+        memset(nmt.cur, 0, sizeof(nmt.cur));
+        return done;
+    }
+    if (!nmt.in_summary) {
+        static const char off[] = "Native memory tracking is not enabled";
+        if (left >= sizeof(off) - 1 && memcmp(p, off, sizeof(off) - 1) == 0) nmt.not_enabled = 1;
+        return 0;
+    }
+    if (left >= 6 && memcmp(p, "Total:", 6) == 0) {
+        if (nmt_committed(p, end, &nmt.cur[NMT_TOTAL]) == 0) nmt.saw_total = 1;
+        return 0;
+    }
+    // "-                    Thread (reserved=22592KB, committed=1104KB)"
+    if (*p != '-') return 0;
+    p++;
+    while (p < end && *p == ' ') p++;
+    const char *paren = memchr(p, '(', (size_t)(end - p));
+    if (!paren) return 0;
+    const char *name_end = paren;
+    while (name_end > p && name_end[-1] == ' ') name_end--;
+    size_t name_len = (size_t)(name_end - p);
+    for (int c = NMT_TOTAL + 1; c < NMT_CATEGORIES; c++) {
+        if (strlen(nmt_category_names[c]) == name_len &&
+            memcmp(p, nmt_category_names[c], name_len) == 0) {
+            nmt_committed(paren, end, &nmt.cur[c]);
+            break;
+        }
+    }
+    return 0;
+}
+
+// End of jcmd's output (or of the fixture).
+static void nmt_finish(void) {
+    if (nmt.have) nmt_line(nmt.buf, nmt.have);   // last line without a newline
+    nmt.have = 0;
+    if (nmt.in_summary && nmt.saw_total) nmt_commit();
+    else if (!nmt.fixture) nmt.failed++;
+    nmt.in_summary = 0;
+    close(nmt.fd);
+    nmt.fd = -1;
+    if (nmt.fixture) {
+        nmt.eof = 1;
+        return;
+    }
+
+    int status = 0;
+    waitpid(nmt.child, &status, 0);
+    nmt.child = -1;
+    if (nmt.not_enabled) {
+        fprintf(stderr, "nmt: JVM runs without -XX:NativeMemoryTracking=summary, collector off\n");
+        nmt.every = 0;
+    } else if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+        fprintf(stderr, "nmt: cannot run jcmd, collector off\n");
+        nmt.every = 0;
+    }
+}
+
+// Whatever jcmd has written so far. A fixture is read until it yields
+// one summary; the rest stays buffered for the next turn.
+void nmt_drain(void) {
+    if (nmt.fd < 0) return;
+    for (;;) {
+        char *line = nmt.buf, *end = nmt.buf + nmt.have, *nl;
+        int done = 0;
+        while (!done && (nl = memchr(line, '\n', (size_t)(end - line))) != NULL) {
+            done = nmt_line(line, (size_t)(nl - line));
+            line = nl + 1;
+        }
+        nmt.have = (size_t)(end - line);
+        if (nmt.have == NMT_BUF_SIZE) nmt.have = 0;     // no newline in a full buffer
+        memmove(nmt.buf, line, nmt.have);
+        if (done) return;
+
+        ssize_t n = read(nmt.fd, nmt.buf + nmt.have, NMT_BUF_SIZE - nmt.have);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;                     // EAGAIN: jcmd is still working
+        }
+        if (n == 0) {
+            nmt_finish();
+            return;
+        }
+        nmt.have += (size_t)n;
+    }
+}
+
+int nmt_open(const char *fixture) {
+    if (fixture) {
+        nmt.fd = open(fixture, O_RDONLY | O_CLOEXEC);
+        if (nmt.fd < 0) {
+            perror(fixture);
+            nmt.every = 0;
+            return -1;
+        }
+        nmt.fixture = fixture;
+        printf("Native memory tracking: replaying %s\n", fixture);
+    } else {
+        printf("Native memory tracking: jcmd every %d samples\n", nmt.every);
+    }
+    return 0;
+}
+
+static void nmt_reap(void) {
+    close(nmt.fd);
+    nmt.fd = -1;
+    waitpid(nmt.child, NULL, 0);
+    nmt.child = -1;
+}
+
+// Start this turn's summary. A fixture is parsed right here.
+void nmt_launch(pid_t pid) {
+    if (nmt.fixture) {
+        nmt_drain();
+        return;
+    }
+    if (nmt.child > 0) {
+        if (monotonic_ns() - nmt.started_ns < NMT_TIMEOUT_SEC * 1000000000ULL) {
+            nmt.skipped++;
+            return;
+        }
+        kill(nmt.child, SIGKILL);       // attach hung; try again next turn
+        nmt_reap();
+        nmt.failed++;
+    }
+
+    char pid_arg[16];
+    snprintf(pid_arg, sizeof(pid_arg), "%d", pid);
+    int fds[2];
+    if (pipe(fds) != 0) {
+        nmt.failed++;
+        return;
+    }
+    pid_t child = fork();
+    if (child == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) dup2(null, STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execlp("jcmd", "jcmd", pid_arg, "VM.native_memory", "summary", "scale=KB", (char *)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+    if (child < 0) {
+        perror("nmt: fork");
+        close(fds[0]);
+        nmt.failed++;
+        return;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    nmt.fd = fds[0];
+    nmt.child = child;
+    nmt.started_ns = monotonic_ns();
+    nmt.have = 0;
+    nmt.in_summary = 0;
+    nmt.saw_total = 0;
+    nmt.not_enabled = 0;
+}
+
+// A summary that completed since the last sample belongs to this one;
+// otherwise the last values are carried forward.
+void nmt_take(snapshot_t *snap, const snapshot_t *prev) {
+    if (nmt.ready) {
+        memcpy(snap->nmt_kb, nmt.kb, sizeof(snap->nmt_kb));
+        snap->nmt_ns = nmt.ns;
+        nmt.ready = 0;
+    } else if (prev) {
+        memcpy(snap->nmt_kb, prev->nmt_kb, sizeof(snap->nmt_kb));
+    }
+}
+
+void nmt_close(void) {
+    if (nmt.child > 0) {
+        kill(nmt.child, SIGTERM);
+        nmt_reap();
+    } else if (nmt.fd >= 0) {
+        close(nmt.fd);
+        nmt.fd = -1;
+    }
+}
+
+// Sleep until the next sample, handling kernel log records and jcmd
+// output as they come.
+void wait_next_sample(int interval_sec) {
+    uint64_t deadline = monotonic_ns() + (uint64_t)interval_sec * 1000000000ULL;
+    while (running) {
+        uint64_t now = monotonic_ns();
+        if (now >= deadline) break;
+        uint64_t left = deadline - now;
+        struct pollfd pfd[2];
+        nfds_t nfds = 0;
+        if (kmsg.fd >= 0 && !kmsg.eof) pfd[nfds++] = (struct pollfd){ kmsg.fd, POLLIN, 0 };
+        if (nmt.child > 0) pfd[nfds++] = (struct pollfd){ nmt.fd, POLLIN, 0 };
+        if (!nfds) {
+            struct timespec ts = { (time_t)(left / 1000000000ULL), (long)(left % 1000000000ULL) };
+            nanosleep(&ts, NULL);      // a signal ends it early, `running` decides
+            continue;
+        }
+        if (poll(pfd, nfds, (int)((left + 999999) / 1000000)) > 0) {
+            kmsg_drain();
+            if (nmt.child > 0) nmt_drain();
+        }
+    }
+}
+
+
 double calculate_fragmentation_index(snapshot_t *snap) {
     double weighted_sum = 0.0;
     double total_free = 0.0;
@@ -301,78 +1268,660 @@ double pearson_correlation(double *x, double *y, size_t n) {
     return (denominator == 0.0) ? 0.0 : (numerator / denominator);
 }
 
+int fixed_region_init(size_t capacity, int lock) {
+    size_t bytes = capacity * sizeof(snapshot_t) + CORRELATION_SCRATCH_BYTES(capacity);
+    size_t scratch_end = bytes;
+    for (int f = 0; f < PROC_FILES; f++) bytes += proc_files[f].cap;
+    void *region = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        perror("Cannot map fixed-footprint region");
+        return -1;
+    }
+    memset(region, 0, bytes);  // fault every page in now
+
+    if (lock && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        perror("mlockall (continuing unlocked)");
+    }
+
+    fixed_region.pool = region;
+    fixed_region.capacity = capacity;
+    fixed_region.used = 0;
+    fixed_region.scratch = (double *)(fixed_region.pool + capacity);
+    char *buf = (char *)region + scratch_end;
+    for (int f = 0; f < PROC_FILES; f++) {
+        proc_files[f].buf = buf;
+        buf += proc_files[f].cap;
+    }
+    printf("Fixed footprint: %zu samples, %zu KB region%s\n",
+           capacity, bytes / 1024, lock ? ", locked" : "");
+    return 0;
+}
+
+static size_t heap_in_use(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+// --fixed: the heap in use after the first sample is the mark; growth
+// after that means the sampling path allocated, reported when seen.
+void fixed_heap_check(int first) {
+    size_t now = heap_in_use();
+    if (!first && now > fixed_region.heap_mark) {
+        fprintf(stderr, "fixed-footprint: heap grew by %zu bytes while sampling\n",
+                now - fixed_region.heap_mark);
+    }
+    if (first || now > fixed_region.heap_mark) fixed_region.heap_mark = now;
+}
+
+snapshot_t *snapshot_alloc(void) {
+    if (!fixed_region.pool) {
+        return calloc(1, sizeof(snapshot_t));
+    }
+    if (fixed_region.used == fixed_region.capacity) {
+        fprintf(stderr, "fixed-footprint: all %zu sample slots used, stopping collection "
+                        "(restart with a larger --fixed)\n", fixed_region.capacity);
+        return NULL;
+    }
+    return &fixed_region.pool[fixed_region.used++];
+}
+
+// For every grid time: the source sample at or before it and the weight
+// toward the next one. Both sequences are sorted, so one merge pass does.
+static void interp_weights(const double *t, size_t n, const double *grid, size_t m,
+                           size_t *lo, double *w) {
+    size_t j = 0;
+    for (size_t i = 0; i < m; i++) {
+        while (j + 2 < n && t[j + 1] <= grid[i]) j++;
+        double span = t[j + 1] - t[j];
+        double x = span > 0.0 ? (grid[i] - t[j]) / span : 0.0;
+        lo[i] = j;
+        w[i] = x < 0.0 ? 0.0 : (x > 1.0 ? 1.0 : x);
+    }
+}
+
+// The blend itself: a straight loop over flat arrays the compiler can
+// vectorize, shared by every series on the same time base.
+static void interp_apply(const double *v, const size_t *lo, const double *w, size_t m,
+                         double *out) {
+    for (size_t i = 0; i < m; i++) {
+        double a = v[lo[i]];
+        double b = v[lo[i] + 1];
+        out[i] = a + w[i] * (b - a);
+    }
+}
+
 correlation_result_t analyze_correlation(snapshot_list_t *list) {
     size_t n = list->count;
     correlation_result_t result = {0};
 
     if (n < 2) return result;
 
-    double *jvm_metaspace = malloc(n * sizeof(double));
-    double *kernel_slabs = malloc(n * sizeof(double));
-    double *slab_scan_rates = malloc(n * sizeof(double));
-
-    if (!jvm_metaspace || !kernel_slabs || !slab_scan_rates) {
-        free(jvm_metaspace);
-        free(kernel_slabs);
-        free(slab_scan_rates);
+    double *series = fixed_region.scratch ? fixed_region.scratch
+                                          : malloc(CORRELATION_SCRATCH_BYTES(n));
+    if (!series) {
         return result;
     }
 
+    double *jvm_metaspace = series;
+    double *kernel_slabs = series + n;
+    double *slab_scan_rates = series + 2 * n;
+    double *frag_index = series + 3 * n;
+    double *high_order_fails = series + 4 * n;
+    double *t_slab = series + 5 * n;
+    double *t_vmstat = series + 6 * n;
+    double *t_buddy = series + 7 * n;
+    double *t_jvm = series + 8 * n;
+    double *resampled = series + 9 * n;   // CORRELATION_SERIES arrays
+    double *grid = series + 14 * n;
+    double *weight = series + 15 * n;
+    size_t *lo = (size_t *)(series + 16 * n);
+
+    // seconds since the first slab read; doubles keep ns precision here
+    uint64_t base = list->head->slab_ns;
     snapshot_t *snap = list->head;
     for (size_t i = 0; i < n; i++) {
         jvm_metaspace[i] = snap->metaspace_used_kb;
         kernel_slabs[i] = snap->kmalloc_1k_active + snap->kmalloc_4k_active;
         slab_scan_rates[i] = snap->slabs_scanned_per_sec;
+        frag_index[i] = snap->fragmentation_index;
+        high_order_fails[i] = snap->high_order_fail_per_sec;
+        t_slab[i] = (double)(int64_t)(snap->slab_ns - base) / 1e9;
+        t_vmstat[i] = (double)(int64_t)(snap->vmstat_ns - base) / 1e9;
+        t_buddy[i] = (double)(int64_t)(snap->buddy_ns - base) / 1e9;
+        t_jvm[i] = (double)(int64_t)(snap->jvm_ns - base) / 1e9;
         snap = snap->next;
     }
 
-    result.correlation = pearson_correlation(jvm_metaspace, kernel_slabs, n);
-    double mean = calculate_mean(slab_scan_rates, n);
-    double stddev = calculate_stddev(slab_scan_rates, n);
+    // The sources were read one after another, the JVM one possibly
+    // hundreds of ms later, so sample i of two series is not the same
+    // instant. Resample everything onto one evenly spaced grid over the
+    // span all sources cover. Rates and the fragmentation index start at
+    // the second sample.
+    size_t m = n - 1;
+    double start = t_slab[0];
+    if (t_jvm[0] > start) start = t_jvm[0];
+    if (t_buddy[1] > start) start = t_buddy[1];
+    if (t_vmstat[1] > start) start = t_vmstat[1];
+    double end = t_slab[n - 1];
+    if (t_jvm[n - 1] < end) end = t_jvm[n - 1];
+    if (t_buddy[n - 1] < end) end = t_buddy[n - 1];
+    if (t_vmstat[n - 1] < end) end = t_vmstat[n - 1];
+
+    double *x_jvm = jvm_metaspace + 1, *x_slabs = kernel_slabs + 1;
+    double *x_scan = slab_scan_rates + 1, *x_frag = frag_index + 1;
+    double *x_fail = high_order_fails + 1;
+    if (n >= 3 && end > start) {
+        double step = (end - start) / (double)(m - 1);
+        for (size_t i = 0; i < m; i++) grid[i] = start + step * (double)i;
+
+        x_jvm = resampled;
+        x_slabs = resampled + m;
+        x_scan = resampled + 2 * m;
+        x_frag = resampled + 3 * m;
+        x_fail = resampled + 4 * m;
+
+        interp_weights(t_jvm, n, grid, m, lo, weight);
+        interp_apply(jvm_metaspace, lo, weight, m, x_jvm);
+        interp_weights(t_slab, n, grid, m, lo, weight);
+        interp_apply(kernel_slabs, lo, weight, m, x_slabs);
+        interp_weights(t_buddy + 1, n - 1, grid, m, lo, weight);
+        interp_apply(frag_index + 1, lo, weight, m, x_frag);
+        interp_weights(t_vmstat + 1, n - 1, grid, m, lo, weight);
+        interp_apply(slab_scan_rates + 1, lo, weight, m, x_scan);
+        interp_apply(high_order_fails + 1, lo, weight, m, x_fail);
+    }
+    // with too few samples to resample the raw series are used as they are
+
+    result.correlation = pearson_correlation(x_jvm, x_slabs, m);
+    double mean = calculate_mean(x_scan, m);
+    double stddev = calculate_stddev(x_scan, m);
     result.coefficient_var = (mean != 0.0) ? (stddev / mean) : 0.0;
     result.mean_pressure = mean;
 
-    free(jvm_metaspace);
-    free(kernel_slabs);
-    free(slab_scan_rates);
+    result.frag_failure_correlation = pearson_correlation(x_frag, x_fail, m);
+
+    double stalls = 0.0;
+    for (snap = list->head; snap; snap = snap->next) stalls += snap->compact_stall_per_sec;
+    result.mean_compact_stall = stalls / n;
+
+    if (series != fixed_region.scratch) {
+        free(series);
+    }
 
     return result;
 }
 
 void display_live_stats(snapshot_t *snap) {
-    printf("[%zu] Metaspace: %lu KB | Slabs/sec: %.2f | 1K: %u | 4K: %u | Frag: %.3f\n",
+    printf("[%zu] Metaspace: %lu KB | Slabs/sec: %.2f | Alloc: %.0f KB/s | Reclaim eff: %.1f%% | 1K: %u | 4K: %u | Frag: %.3f\n",
            snap->timestamp_sec,
            snap->metaspace_used_kb,
            snap->slabs_scanned_per_sec,
+           snap->allocation_rate_kb_per_sec,
+           snap->reclaim_efficiency * 100.0,
            snap->kmalloc_1k_active,
            snap->kmalloc_4k_active,
            snap->fragmentation_index);
+    if (shrinkers.dir) {
+        printf("    Shrinkable: %lu objects in %zu shrinkers\n", snap->shrinker_freeable, shrinkers.count);
+    }
+    if (snap->pagetype_ns) {
+        printf("    Pageblocks: unmovable %u | movable %u | reclaimable %u | unmovable free %lu pages\n",
+               snap->unmovable_blocks, snap->movable_blocks, snap->reclaimable_blocks,
+               snap->unmovable_free_pages);
+    }
+    if (snap->nmt_ns) {
+        printf("    NMT committed: %lu KB | heap %lu | class %lu | thread %lu | code %lu | gc %lu | internal %lu | other %lu\n",
+               snap->nmt_kb[NMT_TOTAL], snap->nmt_kb[NMT_HEAP], snap->nmt_kb[NMT_CLASS],
+               snap->nmt_kb[NMT_THREAD], snap->nmt_kb[NMT_CODE], snap->nmt_kb[NMT_GC],
+               snap->nmt_kb[NMT_INTERNAL], snap->nmt_kb[NMT_OTHER]);
+    }
 }
 
-void export_csv(snapshot_list_t *list, const char *filename) {
-    FILE *fp = fopen(filename, "w");
-    if (!fp) {
-        perror("Cannot create CSV file");
-        return;
+// Fast formatters for the export path: no locale, no varargs, no stdio.
+static char *fmt_u64(char *p, uint64_t v) {
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+static const double fmt_scale[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+// Fixed-point with `decimals` digits (at most 9), rounded half up.
+static char *fmt_fixed(char *p, double v, int decimals) {
+    // every exported rate is guarded against division by zero; keep the
+    // row parseable even if one slips through
+    if (!isfinite(v)) v = 0.0;
+
+    double scaled = fabs(v) * fmt_scale[decimals] + 0.5;
+    if (scaled >= 1.8e19) {
+        return p + snprintf(p, 32, "%.17g", v);
     }
 
-    fprintf(fp, "timestamp,metaspace_kb,slabs_scanned_per_sec,"
-                "kmalloc_1k,kmalloc_4k,fragmentation_index\n");
+    uint64_t fixed = (uint64_t)scaled;
+    uint64_t unit = (uint64_t)fmt_scale[decimals];
+    if (v < 0 && fixed) *p++ = '-';
+    p = fmt_u64(p, fixed / unit);
+    if (decimals) {
+        uint64_t frac = fixed % unit;
+        *p++ = '.';
+        for (int i = decimals - 1; i >= 0; i--) {
+            p[i] = '0' + frac % 10;
+            frac /= 10;
+        }
+        p += decimals;
+    }
+    return p;
+}
 
-    snapshot_t *snap = list->head;
-    while (snap) {
-        fprintf(fp, "%lu,%lu,%.4f,%u,%u,%.6f\n",
-                snap->timestamp_sec,
-                snap->metaspace_used_kb,
-                snap->slabs_scanned_per_sec,
-                snap->kmalloc_1k_active,
-                snap->kmalloc_4k_active,
-                snap->fragmentation_index);
-        snap = snap->next;
+typedef enum { COL_U64, COL_U32, COL_F64 } export_type_t;
+
+typedef struct {
+    const char *name;
+    size_t name_len;
+    size_t offset;
+    export_type_t type;
+    int decimals;
+} export_column_t;
+
+#define EXPORT_COL(name, field, type, decimals) \
+    { name, sizeof(name) - 1, offsetof(snapshot_t, field), type, decimals }
+
+// One table drives the CSV header, CSV rows and JSONL keys alike.
+static const export_column_t export_columns[] = {
+    EXPORT_COL("timestamp", timestamp_sec, COL_U64, 0),
+    EXPORT_COL("metaspace_kb", metaspace_used_kb, COL_U64, 0),
+    EXPORT_COL("slabs_scanned_per_sec", slabs_scanned_per_sec, COL_F64, 4),
+    EXPORT_COL("kmalloc_1k", kmalloc_1k_active, COL_U32, 0),
+    EXPORT_COL("kmalloc_4k", kmalloc_4k_active, COL_U32, 0),
+    EXPORT_COL("fragmentation_index", fragmentation_index, COL_F64, 6),
+    EXPORT_COL("allocation_rate_kb_per_sec", allocation_rate_kb_per_sec, COL_F64, 2),
+    EXPORT_COL("reclaim_efficiency", reclaim_efficiency, COL_F64, 4),
+    EXPORT_COL("compact_stall_per_sec", compact_stall_per_sec, COL_F64, 4),
+    EXPORT_COL("high_order_fail_per_sec", high_order_fail_per_sec, COL_F64, 4),
+    EXPORT_COL("shrinker_freeable", shrinker_freeable, COL_U64, 0),
+    EXPORT_COL("unmovable_pageblocks", unmovable_blocks, COL_U32, 0),
+    EXPORT_COL("kmsg_events", kmsg_events, COL_U32, 0),
+    EXPORT_COL("nmt_total_kb", nmt_kb[NMT_TOTAL], COL_U64, 0),
+    EXPORT_COL("nmt_heap_kb", nmt_kb[NMT_HEAP], COL_U64, 0),
+    EXPORT_COL("nmt_class_kb", nmt_kb[NMT_CLASS], COL_U64, 0),
+    EXPORT_COL("nmt_metaspace_kb", nmt_kb[NMT_METASPACE], COL_U64, 0),
+    EXPORT_COL("nmt_thread_kb", nmt_kb[NMT_THREAD], COL_U64, 0),
+    EXPORT_COL("nmt_code_kb", nmt_kb[NMT_CODE], COL_U64, 0),
+    EXPORT_COL("nmt_gc_kb", nmt_kb[NMT_GC], COL_U64, 0),
+    EXPORT_COL("nmt_compiler_kb", nmt_kb[NMT_COMPILER], COL_U64, 0),
+    EXPORT_COL("nmt_internal_kb", nmt_kb[NMT_INTERNAL], COL_U64, 0),
+    EXPORT_COL("nmt_other_kb", nmt_kb[NMT_OTHER], COL_U64, 0),
+    EXPORT_COL("nmt_symbol_kb", nmt_kb[NMT_SYMBOL], COL_U64, 0),
+    EXPORT_COL("nmt_arena_kb", nmt_kb[NMT_ARENA], COL_U64, 0),
+};
+
+#define EXPORT_NCOLS (sizeof(export_columns) / sizeof(export_columns[0]))
+
+static char *export_value(char *p, const snapshot_t *snap, const export_column_t *col) {
+    const char *field = (const char *)snap + col->offset;
+    switch (col->type) {
+    case COL_U64: return fmt_u64(p, *(const uint64_t *)field);
+    case COL_U32: return fmt_u64(p, *(const uint32_t *)field);
+    case COL_F64: return fmt_fixed(p, *(const double *)field, col->decimals);
+    }
+    return p;
+}
+
+// Write out the buffer; with `sync` also push it to stable storage.
+static int exporter_flush(exporter_t *ex, int sync) {
+    size_t off = 0;
+    while (off < ex->len) {
+        ssize_t n = write(ex->fd, ex->buf + off, ex->len - off);
+        if (n < 0) {
+            perror("Cannot write export file");
+            ex->len = 0;
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    ex->len = 0;
+    if (sync && fdatasync(ex->fd) != 0) {
+        perror("fdatasync export file");
+        return -1;
+    }
+    return 0;
+}
+
+static void exporter_header(exporter_t *ex) {
+    if (ex->format != EXPORT_CSV) return;
+    char *p = ex->buf + ex->len;
+    for (size_t i = 0; i < EXPORT_NCOLS; i++) {
+        if (i) *p++ = ',';
+        memcpy(p, export_columns[i].name, export_columns[i].name_len);
+        p += export_columns[i].name_len;
     }
+    *p++ = '\n';
+    ex->file_bytes += (uint64_t)(p - (ex->buf + ex->len));
+    ex->len = (size_t)(p - ex->buf);
+}
 
-    fclose(fp);
-    printf("\nData exported to %s\n", filename);
+static int exporter_open_file(exporter_t *ex, uint64_t now) {
+    ex->fd = open(ex->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (ex->fd < 0) {
+        perror("Cannot create export file");
+        return -1;
+    }
+    ex->file_bytes = 0;
+    ex->file_opened = ex->last_sync = now;
+    exporter_header(ex);
+    return 0;
+}
+
+int exporter_open(exporter_t *ex, const char *path, export_format_t format) {
+    ex->path = path;
+    ex->format = format;
+    ex->len = 0;
+    ex->rows = 0;
+    ex->rotations = 0;
+    return exporter_open_file(ex, (uint64_t)time(NULL));
+}
+
+// Close the active file and move it aside as <path>.<n>.
+static void exporter_rotate(exporter_t *ex, uint64_t now) {
+    exporter_flush(ex, 1);
+    close(ex->fd);
+    ex->fd = -1;
+
+    char rotated[4096];
+    snprintf(rotated, sizeof(rotated), "%s.%u", ex->path, ++ex->rotations);
+    if (rename(ex->path, rotated) != 0) {
+        perror("Cannot rotate export file");
+    }
+    exporter_open_file(ex, now);
+}
+
+void exporter_write(exporter_t *ex, const snapshot_t *snap) {
+    if (ex->fd < 0) return;
+
+    uint64_t now = snap->timestamp_sec;
+    if ((ex->rotate_bytes && ex->file_bytes >= ex->rotate_bytes) ||
+        (ex->rotate_sec && now - ex->file_opened >= ex->rotate_sec)) {
+        exporter_rotate(ex, now);
+        if (ex->fd < 0) return;
+    }
+
+    if (ex->len + EXPORT_ROW_MAX > EXPORT_BUF_SIZE) {
+        exporter_flush(ex, 0);
+    }
+
+    char *start = ex->buf + ex->len;
+    char *p = start;
+    if (ex->format == EXPORT_JSONL) *p++ = '{';
+    for (size_t i = 0; i < EXPORT_NCOLS; i++) {
+        const export_column_t *col = &export_columns[i];
+        if (i) *p++ = ',';
+        if (ex->format == EXPORT_JSONL) {
+            *p++ = '"';
+            memcpy(p, col->name, col->name_len);
+            p += col->name_len;
+            *p++ = '"';
+            *p++ = ':';
+        }
+        p = export_value(p, snap, col);
+    }
+    if (ex->format == EXPORT_JSONL) *p++ = '}';
+    *p++ = '\n';
+
+    ex->len += (size_t)(p - start);
+    ex->file_bytes += (uint64_t)(p - start);
+    ex->rows++;
+
+    if (now - ex->last_sync >= ex->sync_sec) {
+        exporter_flush(ex, 1);
+        ex->last_sync = now;
+    }
+}
+
+void exporter_close(exporter_t *ex) {
+    if (ex->fd < 0) return;
+    exporter_flush(ex, 1);
+    close(ex->fd);
+    ex->fd = -1;
+    printf("\nExported %lu samples to %s", ex->rows, ex->path);
+    if (ex->rotations) printf(" (%u rotated files)", ex->rotations);
+    printf("\n");
+}
+
+// Which shrinkers give objects back when reclaim scans slabs: the rate
+// their freeable count drops, against slabs_scanned/sec.
+static void report_shrinkers(void) {
+    static double freed[SHRINKER_HISTORY], scan[SHRINKER_HISTORY];
+    size_t n = shrinkers.len;
+    if (!shrinkers.dir || n < 3) return;
+    size_t first = (shrinkers.head + SHRINKER_HISTORY - n) % SHRINKER_HISTORY;
+
+    double pressure = 0.0;
+    for (size_t j = 1; j < n; j++) {
+        pressure += shrinkers.scan_rate[(first + j) % SHRINKER_HISTORY];
+    }
+    pressure /= (double)(n - 1);
+
+    printf("\n--- Shrinkers (%zu tracked, top %d by freeable objects) ---\n",
+           shrinkers.count, SHRINKER_TOP);
+    int shown[SHRINKER_MAX] = {0};
+    for (int r = 0; r < SHRINKER_TOP; r++) {
+        int best = -1;
+        for (size_t i = 0; i < shrinkers.count; i++) {
+            if (!shown[i] && (best < 0 ||
+                              shrinkers.list[i].freeable > shrinkers.list[best].freeable)) {
+                best = (int)i;
+            }
+        }
+        if (best < 0) break;
+        shown[best] = 1;
+        const shrinker_t *s = &shrinkers.list[best];
+
+        double released = 0.0, mean = 0.0;
+        for (size_t j = 1; j < n; j++) {
+            size_t k = (first + j) % SHRINKER_HISTORY, p = (first + j - 1) % SHRINKER_HISTORY;
+            double dt = shrinkers.t[k] - shrinkers.t[p];
+            double drop = s->series[p] > s->series[k] ? (double)(s->series[p] - s->series[k]) : 0.0;
+            freed[j - 1] = dt > 0.0 ? drop / dt : 0.0;
+            scan[j - 1] = shrinkers.scan_rate[k];
+            released += drop;
+            mean += (double)s->series[k];
+        }
+        mean /= (double)(n - 1);
+        double corr = pearson_correlation(freed, scan, n - 1);
+
+        printf("%-32s freeable: %lu (%u memcgs", s->name, s->freeable, s->memcgs);
+        if (s->memcgs > 1) printf(", most in memcg ino %lu", s->top_memcg_ino);
+        printf(") | released: %.0f | corr(scan): %.2f ", released, corr);
+        if (pressure < 1.0) printf("(no reclaim pressure seen)\n");
+        else if (corr >= 0.5) printf("(SHRINKABLE - gives objects back under pressure)\n");
+        else if (released < 0.01 * mean) printf("(NOT SHRINKING under pressure)\n");
+        else printf("(WEAK)\n");
+    }
+}
+
+// Unmovable pageblocks against unreclaimable slab, over the samples that
+// read pagetypeinfo. Slab that packs well needs about as many new block
+// pages as it grows; many more means its allocations are being scattered
+// over fresh pageblocks.
+static void report_pageblocks(snapshot_list_t *list) {
+    if (!pagetype_every) return;
+    size_t n = 0;
+    for (snapshot_t *snap = list->head; snap; snap = snap->next) {
+        if (snap->pagetype_ns) n++;
+    }
+    if (n < 2) return;
+
+    double *series = fixed_region.scratch ? fixed_region.scratch : malloc(2 * n * sizeof(double));
+    if (!series) return;
+    double *blocks = series, *slab = series + n;
+    const snapshot_t *first = NULL, *last = NULL;
+    size_t i = 0;
+    for (snapshot_t *snap = list->head; snap; snap = snap->next) {
+        if (!snap->pagetype_ns) continue;
+        if (!first) first = snap;
+        last = snap;
+        blocks[i] = snap->unmovable_blocks;
+        slab[i] = snap->slab_unreclaimable_objs;   // pages
+        i++;
+    }
+    double corr = pearson_correlation(blocks, slab, n);
+    if (series != fixed_region.scratch) free(series);
+
+    uint32_t all = last->unmovable_blocks + last->movable_blocks + last->reclaimable_blocks;
+    int64_t grown = (int64_t)last->unmovable_blocks - (int64_t)first->unmovable_blocks;
+    int64_t slab_grown = (int64_t)last->slab_unreclaimable_objs - (int64_t)first->slab_unreclaimable_objs;
+
+    printf("\n--- Pageblock Pollution (%zu pagetypeinfo samples) ---\n", n);
+    printf("Unmovable pageblocks: %u -> %u (%+ld, %.1f%% of all blocks)\n",
+           first->unmovable_blocks, last->unmovable_blocks, (long)grown,
+           all ? 100.0 * last->unmovable_blocks / all : 0.0);
+    printf("Free pages left on Unmovable lists: %lu\n", last->unmovable_free_pages);
+    for (size_t z = 0; z < pagetype.nzones; z++) {
+        const pagetype_zone_t *zone = &pagetype.zone[z];
+        printf("  node %d %-8s", zone->node, zone->name);
+        for (int t = 0; t < pagetype.ntypes; t++) {
+            printf(" %s=%u", pagetype.type[t], zone->blocks[t]);
+        }
+        printf("\n");
+    }
+    printf("Unmovable blocks vs unreclaimable slab correlation: %.4f ", corr);
+    if (grown > 0 && slab_grown > 0) {
+        double ratio = (double)grown * pagetype.pages_per_block / (double)slab_grown;
+        printf("(%.1f block pages per slab page grown) ", ratio);
+        if (corr > 0.7 && ratio > 2.0) printf("(POLLUTING - slab growth scatters unmovable pageblocks)\n");
+        else if (corr > 0.7) printf("(STRONG - unmovable blocks follow slab)\n");
+        else printf("(WEAK)\n");
+    } else if (grown > 0) {
+        printf("(unmovable blocks growing without slab growth)\n");
+    } else {
+        printf("(STABLE)\n");
+    }
+}
+
+// Memory-relevant kernel messages placed on the sample timeline: each
+// event with the sample closest to it and the unreclaimable slab around
+// it, so an OOM kill or allocation failure lines up with the growth that
+// led there.
+static void report_kmsg(snapshot_list_t *list) {
+    if (kmsg.fd < 0 && !kmsg.eof) return;
+    uint64_t total = 0;
+    for (int c = 0; c < KMSG_CLASSES; c++) total += kmsg.counts[c];
+
+    printf("\n--- Kernel Log Events (%s) ---\n", kmsg.path);
+    printf("Events: %lu", total);
+    for (int c = 0; c < KMSG_CLASSES; c++) {
+        if (kmsg.counts[c]) printf(" | %s %lu", kmsg_class_names[c], kmsg.counts[c]);
+    }
+    if (kmsg.lost) printf(" | %lu log overruns", kmsg.lost);
+    printf("\n");
+    if (total > kmsg.len) printf("(last %zu shown)\n", kmsg.len);
+
+    // events and samples are both in time order: one merge pass
+    const snapshot_t *snap = list->head;
+    size_t idx = 0;
+    for (size_t i = 0; i < kmsg.len; i++) {
+        const kmsg_event_t *ev = &kmsg.events[(kmsg.head + KMSG_EVENTS_MAX - kmsg.len + i) % KMSG_EVENTS_MAX];
+        while (snap->next && snap->next->slab_ns <= ev->ns) {
+            snap = snap->next;
+            idx++;
+        }
+        const snapshot_t *next = snap->next;
+        int inside = ev->ns >= snap->slab_ns && next;
+        size_t near = idx + (inside && next->slab_ns - ev->ns < ev->ns - snap->slab_ns);
+        double rel = ((double)ev->ns - (double)list->head->slab_ns) / 1e9;
+        printf("  %+9.3fs  sample %-5zu %-10s %s", rel, near, kmsg_class_names[ev->cls], ev->msg);
+        if (inside) {
+            printf("  (unreclaimable slab %+ld pages over that interval)",
+                   (long)((int64_t)next->slab_unreclaimable_objs - (int64_t)snap->slab_unreclaimable_objs));
+        }
+        printf("\n");
+    }
+}
+
+// Each NMT category against the kernel caches. The kernel series are
+// interpolated to the moments the summaries were taken, so a category
+// that grows with unreclaimable slab or the kmalloc caches points at JVM
+// native allocations driving kernel objects (threads: task_struct and
+// stacks), while slab growth no category follows is the kernel's own.
+static void report_nmt(snapshot_list_t *list) {
+    if (!nmt.fixture && !nmt.summaries && !nmt.failed) return;
+    size_t n = list->count, k = 0;
+    for (snapshot_t *snap = list->head; snap; snap = snap->next) {
+        if (snap->nmt_ns) k++;
+    }
+
+    printf("\n--- JVM Native Memory Tracking (%zu summaries", k);
+    if (nmt.skipped) printf(", %u turns skipped", nmt.skipped);
+    if (nmt.failed) printf(", %u jcmd runs failed", nmt.failed);
+    printf(") ---\n");
+    if (k < 3) {
+        printf("Not enough summaries for correlation.\n");
+        return;
+    }
+
+    size_t bytes = (3 * n + 5 * k) * sizeof(double) + k * sizeof(size_t);
+    double *series = fixed_region.scratch ? fixed_region.scratch : malloc(bytes);
+    if (!series) return;
+    double *t = series, *slab = series + n, *kmalloc = series + 2 * n;
+    double *grid = series + 3 * n, *weight = grid + k;
+    double *slab_at = weight + k, *kmalloc_at = slab_at + k, *cat = kmalloc_at + k;
+    size_t *lo = (size_t *)(cat + k);
+
+    uint64_t base = list->head->slab_ns;
+    const snapshot_t *first = NULL, *last = NULL;
+    size_t i = 0, j = 0;
+    for (snapshot_t *snap = list->head; snap; snap = snap->next, i++) {
+        t[i] = (double)(int64_t)(snap->slab_ns - base) / 1e9;
+        slab[i] = snap->slab_unreclaimable_objs;
+        kmalloc[i] = snap->kmalloc_1k_active + snap->kmalloc_4k_active;
+        if (!snap->nmt_ns) continue;
+        if (!first) first = snap;
+        last = snap;
+        grid[j++] = (double)(int64_t)(snap->nmt_ns - base) / 1e9;
+    }
+    interp_weights(t, n, grid, k, lo, weight);
+    interp_apply(slab, lo, weight, k, slab_at);
+    interp_apply(kmalloc, lo, weight, k, kmalloc_at);
+
+    double best = 0.0;
+    printf("%-12s %12s %10s %10s %10s\n", "category", "committed KB", "grown", "corr slab", "corr kmalloc");
+    for (int c = 0; c < NMT_CATEGORIES; c++) {
+        if (!last->nmt_kb[c] && !first->nmt_kb[c]) continue;
+        j = 0;
+        for (const snapshot_t *snap = first; snap; snap = snap->next) {
+            if (snap->nmt_ns) cat[j++] = (double)snap->nmt_kb[c];
+        }
+        double corr_slab = pearson_correlation(cat, slab_at, k);
+        double corr_kmalloc = pearson_correlation(cat, kmalloc_at, k);
+        int64_t grown = (int64_t)last->nmt_kb[c] - (int64_t)first->nmt_kb[c];
+
+        printf("%-12s %12lu %+10ld %10.2f %10.2f ", nmt_category_names[c], last->nmt_kb[c],
+               (long)grown, corr_slab, corr_kmalloc);
+        if (grown <= 0) {
+            printf("(STABLE)\n");
+            continue;
+        }
+        double corr = corr_slab > corr_kmalloc ? corr_slab : corr_kmalloc;
+        if (c != NMT_TOTAL && corr > best) best = corr;
+        if (corr > 0.7) printf("(FOLLOWS KERNEL - JVM native growth drives kernel caches)\n");
+        else printf("(JVM-ONLY - native growth inside the JVM)\n");
+    }
+
+    int64_t slab_grown = (int64_t)last->slab_unreclaimable_objs - (int64_t)first->slab_unreclaimable_objs;
+    if (slab_grown > 0 && best < 0.4) {
+        printf("Unreclaimable slab grew %+ld pages with no NMT category following it "
+               "(KERNEL-SIDE growth, not the JVM's native memory)\n", (long)slab_grown);
+    }
+    if (series != fixed_region.scratch) free(series);
 }
 
 void generate_report(snapshot_list_t *list) {
@@ -405,11 +1954,23 @@ void generate_report(snapshot_list_t *list) {
 
     printf("\n--- Kernel Pressure ---\n");
     printf("Average slabs scanned/sec: %.2f\n", corr.mean_pressure);
+
+    printf("\n--- Fragmentation vs High-Order Failures ---\n");
+    printf("Average compaction stalls/sec: %.2f\n", corr.mean_compact_stall);
+    printf("Fragmentation-Failure Correlation: %.4f ", corr.frag_failure_correlation);
+    if (corr.frag_failure_correlation > 0.7) printf("(STRONG - fragmentation is causing allocation failures)\n");
+    else if (corr.frag_failure_correlation > 0.4) printf("(MODERATE)\n");
+    else printf("(WEAK)\n");
+
+    report_shrinkers();
+    report_pageblocks(list);
+    report_kmsg(list);
+    report_nmt(list);
     printf("\n=================================\n");
 }
 
 void cleanup_list(snapshot_list_t *list) {
-    snapshot_t *current = list->head;
+    snapshot_t *current = fixed_region.pool ? NULL : list->head;
     while (current) {
         snapshot_t *next = current->next;
         free(current);
@@ -419,37 +1980,80 @@ void cleanup_list(snapshot_list_t *list) {
     list->count = 0;
 }
 
-void collection_loop(pid_t jvm_pid, int interval_sec) {
+int collection_loop(pid_t jvm_pid, int interval_sec, const char *export_path,
+                    export_format_t format) {
     snapshot_list_t list = {NULL, NULL, 0};
+    int status = 0;
 
     printf("SlabSight - Kernel-Level JVM Memory Analyzer\n");
     printf("Target PID: %d | Interval: %ds", jvm_pid, interval_sec);
     if (debug_mode) printf(" | DEBUG MODE");
     printf("\n\nPress Ctrl+C to stop and generate report...\n\n");
 
+    exporter_open(&exporter, export_path, format);
+
     while (running) {
-        snapshot_t *snap = calloc(1, sizeof(snapshot_t));
+        snapshot_t *snap = snapshot_alloc();
         if (!snap) {
-            fprintf(stderr, "Memory allocation failed\n");
+            if (!fixed_region.pool) fprintf(stderr, "Memory allocation failed\n");
+            status = 1;
             break;
         }
 
         snap->timestamp_sec = time(NULL);
 
+        // each source gets the midpoint of its own read
+        uint64_t t0 = monotonic_ns();
         parse_slabinfo(snap);
+        uint64_t t1 = monotonic_ns();
+        snap->slab_ns = t0 + (t1 - t0) / 2;
         parse_vmstat(snap);
+        t0 = monotonic_ns();
+        snap->vmstat_ns = t1 + (t0 - t1) / 2;
         parse_buddyinfo(snap);
+        t1 = monotonic_ns();
+        snap->buddy_ns = t0 + (t1 - t0) / 2;
         get_jvm_metaspace(jvm_pid, snap);
+        t0 = monotonic_ns();
+        snap->jvm_ns = t1 + (t0 - t1) / 2;
+        collect_shrinkers(snap);
+        t1 = monotonic_ns();
+        snap->shrinker_ns = t0 + (t1 - t0) / 2;
+        if (pagetype_every && list.count % pagetype_every == 0 && parse_pagetypeinfo(snap) == 0) {
+            t0 = monotonic_ns();
+            snap->pagetype_ns = t1 + (t0 - t1) / 2;
+        } else if (list.tail) {
+            // carried forward so the export has no holes between reads
+            snap->unmovable_blocks = list.tail->unmovable_blocks;
+            snap->movable_blocks = list.tail->movable_blocks;
+            snap->reclaimable_blocks = list.tail->reclaimable_blocks;
+            snap->unmovable_free_pages = list.tail->unmovable_free_pages;
+        }
+        if (nmt.every && list.count % nmt.every == 0) nmt_launch(jvm_pid);
+        nmt_take(snap, list.tail);
 
         if (list.tail != NULL) {
-            uint64_t dt = snap->timestamp_sec - list.tail->timestamp_sec;
+            // vmstat counters over the time between the two vmstat reads
+            double dt = (double)(snap->vmstat_ns - list.tail->vmstat_ns) / 1e9;
 
-            if (dt > 0) {
+            if (dt > 0.0) {
                 uint64_t delta_scanned = snap->slabs_scanned - list.tail->slabs_scanned;
                 snap->slabs_scanned_per_sec = (double)delta_scanned / dt;
 
-                uint64_t delta_alloc = snap->pgalloc_dma - list.tail->pgalloc_dma;
+                // unsigned deltas stay correct across a counter wrap
+                uint64_t delta_alloc = snap->pgalloc_total - list.tail->pgalloc_total;
                 snap->allocation_rate_kb_per_sec = (double)(delta_alloc * 4) / dt;
+
+                uint64_t delta_scan = snap->pgscan_total - list.tail->pgscan_total;
+                uint64_t delta_steal = snap->pgsteal_total - list.tail->pgsteal_total;
+                snap->reclaim_efficiency = delta_scan ? (double)delta_steal / delta_scan : 0.0;
+
+                uint64_t delta_stall = snap->compact_stall - list.tail->compact_stall;
+                snap->compact_stall_per_sec = (double)delta_stall / dt;
+
+                uint64_t delta_fail = (snap->compact_fail - list.tail->compact_fail) +
+                                      (snap->thp_fault_fallback - list.tail->thp_fault_fallback);
+                snap->high_order_fail_per_sec = (double)delta_fail / dt;
             }
 
             snap->fragmentation_index = calculate_fragmentation_index(snap);
@@ -463,31 +2067,115 @@ void collection_loop(pid_t jvm_pid, int interval_sec) {
         }
         list.count++;
 
+        // records that arrived while this sample was read belong to it
+        kmsg_drain();
+        snap->kmsg_events = kmsg.pending;
+        kmsg.pending = 0;
+
+        record_shrinkers(snap);
+        exporter_write(&exporter, snap);
         display_live_stats(snap);
-        sleep(interval_sec);
+        if (fixed_region.pool) fixed_heap_check(list.count == 1);
+        if (max_samples && list.count >= max_samples) break;
+        wait_next_sample(interval_sec);
     }
 
     generate_report(&list);
-    export_csv(&list, "slabsight_data.csv");
+    exporter_close(&exporter);
     cleanup_list(&list);
+    shrinkers_close();
+    kmsg_close();
+    nmt_close();
+    return status;
 }
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <jvm-pid> [interval-seconds] [--debug]\n", argv[0]);
+        fprintf(stderr, "Usage: %s <jvm-pid> [interval-seconds] [--debug] [--fixed N [--mlock]]\n"
+                        "       [--format csv|jsonl] [--output PATH] [--rotate-mb N] [--rotate-min N]\n"
+                        "       [--sync-sec N] [--shrinkers[=DIR]] [--pagetypeinfo[=N]] [--kmsg[=PATH]]\n"
+                        "       [--nmt[=N|PATH]] [--samples N]\n", argv[0]);
         fprintf(stderr, "Example: %s 12345 5\n", argv[0]);
         fprintf(stderr, "         %s 12345 2 --debug\n", argv[0]);
+        fprintf(stderr, "         %s 12345 5 --fixed 17280 --mlock   (24h, no allocation while sampling)\n", argv[0]);
+        fprintf(stderr, "         %s 12345 5 --format jsonl --rotate-mb 64\n", argv[0]);
+        fprintf(stderr, "         %s 12345 5 --shrinkers   (needs debugfs at " SHRINKER_DIR ")\n", argv[0]);
+        fprintf(stderr, "         %s 12345 1 --samples 3 --kmsg=dmesg.txt   (report after 3 samples)\n", argv[0]);
         return 1;
     }
 
     pid_t jvm_pid = atoi(argv[1]);
-    int interval = (argc >= 3) ? atoi(argv[2]) : 5;
+    int interval = (argc >= 3 && argv[2][0] != '-') ? atoi(argv[2]) : 5;
+    size_t fixed_samples = 0;
+    int lock = 0;
+    export_format_t format = EXPORT_CSV;
+    const char *export_path = NULL;
+    const char *shrinker_dir = NULL;
+    const char *kmsg_path = NULL;
+    const char *nmt_fixture = NULL;
 
     // Check for debug flag
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--debug") == 0) {
             debug_mode = 1;
         }
+        else if (strcmp(argv[i], "--fixed") == 0 && i + 1 < argc) {
+            fixed_samples = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            max_samples = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--mlock") == 0) {
+            lock = 1;
+        }
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            format = strcmp(argv[++i], "jsonl") == 0 ? EXPORT_JSONL : EXPORT_CSV;
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            export_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--rotate-mb") == 0 && i + 1 < argc) {
+            exporter.rotate_bytes = strtoull(argv[++i], NULL, 10) << 20;
+        }
+        else if (strcmp(argv[i], "--rotate-min") == 0 && i + 1 < argc) {
+            exporter.rotate_sec = strtoull(argv[++i], NULL, 10) * 60;
+        }
+        else if (strcmp(argv[i], "--sync-sec") == 0 && i + 1 < argc) {
+            exporter.sync_sec = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--shrinkers") == 0) {
+            shrinker_dir = SHRINKER_DIR;
+        }
+        else if (strncmp(argv[i], "--shrinkers=", 12) == 0) {
+            shrinker_dir = argv[i] + 12;
+        }
+        else if (strcmp(argv[i], "--pagetypeinfo") == 0) {
+            pagetype_every = PAGETYPE_EVERY;
+        }
+        else if (strncmp(argv[i], "--pagetypeinfo=", 15) == 0) {
+            pagetype_every = atoi(argv[i] + 15);
+            if (pagetype_every < 1) pagetype_every = PAGETYPE_EVERY;
+        }
+        else if (strcmp(argv[i], "--kmsg") == 0) {
+            kmsg_path = KMSG_DEVICE;
+        }
+        else if (strncmp(argv[i], "--kmsg=", 7) == 0) {
+            kmsg_path = argv[i] + 7;
+        }
+        else if (strcmp(argv[i], "--nmt") == 0) {
+            nmt.every = NMT_EVERY;
+        }
+        else if (strncmp(argv[i], "--nmt=", 6) == 0) {
+            // a number is the cadence, anything else captured output
+            const char *arg = argv[i] + 6;
+            if (*arg && strspn(arg, "0123456789") == strlen(arg)) {
+                nmt.every = atoi(arg);
+                if (nmt.every < 1) nmt.every = NMT_EVERY;
+            } else {
+                nmt.every = 1;
+                nmt_fixture = arg;
+            }
+        }
     }
 
     if (jvm_pid <= 0) {
@@ -500,7 +2188,25 @@ int main(int argc, char *argv[]) {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
-    collection_loop(jvm_pid, interval);
+    if (fixed_samples > 0 && fixed_region_init(fixed_samples, lock) != 0) {
+        return 1;
+    }
 
-    return 0;
+    if (shrinker_dir && shrinkers_open(shrinker_dir) != 0) {
+        fprintf(stderr, "shrinkers: collector off\n");
+    }
+
+    if (kmsg_path && kmsg_open(kmsg_path) != 0) {
+        fprintf(stderr, "kmsg: collector off\n");
+    }
+
+    if (nmt.every && nmt_open(nmt_fixture) != 0) {
+        fprintf(stderr, "nmt: collector off\n");
+    }
+
+    if (!export_path) {
+        export_path = format == EXPORT_JSONL ? "slabsight_data.jsonl" : "slabsight_data.csv";
+    }
+
+    return collection_loop(jvm_pid, interval, export_path, format);
 }
@@ -1,10 +1,7 @@
 #ifndef ANALYSIS_H
 #define ANALYSIS_H
 
-
-#define EMA_ALPHA 0.30
-#define GROWTH_THRESHOLD 20.0
-#define MONO_LIMIT 3
+// thresholds and the EMA weight come from the detector config (config.h)
 
 void update_ema_for_slabs();
 void compute_growth_for_slabs();
@@ -30,33 +27,56 @@ void init_trend_tracking()
 
 void update_ema_for_slabs()
 {
+    // ema_alpha is per configured interval; a stretched or late cycle
+    // lets the old average fade by the time that actually passed between
+    // the samples, not by when the analysis got to them
+    static struct timespec last;
+    static int last_valid = 0;
+    const detector_config *c = cfg();
+    double dt = last_valid ? (slab_sample_ts.tv_sec - last.tv_sec) +
+                             (slab_sample_ts.tv_nsec - last.tv_nsec) / 1e9
+                           : c->interval;
+    last = slab_sample_ts;
+    last_valid = 1;
+    double keep = config_ema_keep(c, dt);
+
     list *cur = get_slab_list_head();
     while (cur)
     {
         slabinfo *s = cur->slab;
-        s->ema = EMA_ALPHA * s->active_objs + (1 - EMA_ALPHA) * s->ema;
+        // a cache back from being stale fades over the cycles it missed
+        double k = s->span > 1 ? config_ema_keep(c, dt * s->span) : keep;
+        if (!s->stale)
+            s->ema = (1.0 - k) * slab_trend_objs(s) + k * s->ema;
         cur = cur->next;
     }
 }
 
 void compute_growth_for_slabs()
 {
+    float threshold = (float)cfg()->growth_threshold;
     list *cur = get_slab_list_head();
     while (cur)
     {
+        if (cur->slab->stale) {
+            cur = cur->next;
+            continue;
+        }
+        unsigned int now = slab_trend_objs(cur->slab);
+        unsigned int prev = slab_prev_trend_objs(cur->slab);
         // Calculate percentage growth
-        if (cur->slab->prev_active_objs > 10) {
-            cur->slab->growth = ((float)cur->slab->active_objs - cur->slab->prev_active_objs) /
-                                (float)cur->slab->prev_active_objs * 100.0f;
+        if (prev > 10) {
+            cur->slab->growth = ((float)now - prev) / (float)prev * 100.0f;
         } else {
             // For small values, use absolute difference
-            cur->slab->growth = (float)(cur->slab->active_objs - cur->slab->prev_active_objs);
+            cur->slab->growth = (float)now - (float)prev;
         }
+        cur->slab->growth /= (float)slab_span(cur->slab);
 
         // Add clear threshold alerts
-        if (cur->slab->growth > 5.0f) {
-            printf("\033[1;31m[ALERT] %s growing at %.1f%%\033[0m\n",
-                   cur->slab->name, cur->slab->growth);
+        if (cur->slab->growth > threshold) {
+            rprintf("\033[1;31m[ALERT] %s growing at %.1f%%\033[0m\n",
+                    cur->slab->name, cur->slab->growth);
         }
 
         cur = cur->next;
@@ -65,16 +85,21 @@ void compute_growth_for_slabs()
 
 void update_monotonic_for_slabs()
 {
+    int mono_limit = cfg()->mono_limit;
     list *cur = get_slab_list_head();
     while (cur)
     {
         slabinfo *s = cur->slab;
-        if (s->active_objs > s->prev_active_objs) {
+        if (s->stale) {
+            cur = cur->next;
+            continue;
+        }
+        if (slab_trend_objs(s) > slab_prev_trend_objs(s)) {
             s->monotonic_count++;
             // Persistent growth detection
-            if (s->monotonic_count >= MONO_LIMIT) {
-                printf("\033[1;33m[LEAK WARNING] %s has grown %d consecutive times\033[0m\n",
-                       s->name, s->monotonic_count);
+            if (s->monotonic_count >= mono_limit) {
+                rprintf("\033[1;33m[LEAK WARNING] %s has grown %d consecutive times\033[0m\n",
+                        s->name, s->monotonic_count);
             }
         } else {
             s->monotonic_count = 0;
@@ -86,7 +111,7 @@ void update_monotonic_for_slabs()
 
 void show_topN_slabs(int N)
 {
-    printf("\n--- Top %d Growing Slabs ---\n", N);
+    rprintf("\n--- Top %d Growing Slabs ---\n", N);
 
     // Create temporary array for sorting
     typedef struct {
@@ -122,6 +147,7 @@ void show_topN_slabs(int N)
     }
 
     // Print top N slabs
+    const detector_config *c = cfg();
     int display_count = (N < count) ? N : count;
     for (int i = 0; i < display_count; i++) {
         // Trend indicator
@@ -134,45 +160,47 @@ void show_topN_slabs(int N)
 
         // Color code based on monotonic count
         char *color_code = "\033[0m";  // Default: normal
-        if (rankings[i].slab->monotonic_count >= MONO_LIMIT) {
+        if (rankings[i].slab->monotonic_count >= c->mono_limit) {
             color_code = "\033[1;31m";  // Red for potential leaks
-        } else if (rankings[i].slab->growth > 5.0f) {
+        } else if (rankings[i].slab->growth > c->growth_threshold) {
             color_code = "\033[1;33m";  // Yellow for high growth
         }
 
-        printf("%s%2d. %-20s %s Active: %-6u EMA: %.1f Growth: %.1f%%\033[0m\n",
-               color_code, i+1, rankings[i].slab->name, trend_indicator,
-               rankings[i].slab->active_objs,
-               rankings[i].slab->ema,
-               rankings[i].slab->growth);
+        rprintf("%s%2d. %-20s %s Active: %-6u EMA: %.1f Growth: %.1f%%\033[0m\n",
+                color_code, i+1, rankings[i].slab->name, trend_indicator,
+                rankings[i].slab->active_objs,
+                rankings[i].slab->ema,
+                rankings[i].slab->growth);
     }
-    printf("\n");
+    rprintf("\n");
 }
 
 void correlate_vmstat_slab()
 {
-    static unsigned int prev_unreclaimable = 0;
-    unsigned int free_pages = get_vmstat("nr_free_pages");
-    unsigned int slab_unreclaimable = get_vmstat("nr_slab_unreclaimable");
-
-    if (free_pages < 10000)
+    // the composite leak score (leakscore.h) folds reclaim pressure, PSI,
+    // fragmentation and free memory against the zone watermarks into
+    // every cache
+    const detector_config *c = cfg();
+    double alert_score = c->score.alert_score;
+    int flagged = 0;
+    list *cur = get_slab_list_head();
+    while (cur)
     {
-        printf("[CORRELATION] Low free pages: %u\n", free_pages);
-        list *cur = get_slab_list_head();
-        while (cur)
+        double score = get_leak_score(cur->slab);
+        if (score >= alert_score)
         {
-            if (cur->slab->monotonic_count >= 3)
-                printf("   -> Slab %s is growing rapidly\n", cur->slab->name);
-            cur = cur->next;
+            rprintf("\033[1;31m[CORRELATION] %s leak score %.1f (%.0f bytes/h, r2 %.2f)\033[0m\n",
+                    cur->slab->name, score,
+                    sc_slope[cur->slab->idx], sc_r2[cur->slab->idx]);
+            flagged++;
         }
+        cur = cur->next;
     }
 
-    // After printing VMStat info:
-    if (free_pages < 50000 && (slab_unreclaimable > prev_unreclaimable)) {
-        printf("\033[1;31m[SYSTEM ALERT] Low free memory with increasing unreclaimable slabs!\033[0m\n");
+    if (flagged && score_sys.system_factor > 1.5) {
+        rprintf("\033[1;31m[SYSTEM ALERT] Memory pressure with %d caches scoring as leaks!\033[0m\n",
+                flagged);
     }
-
-    prev_unreclaimable = slab_unreclaimable;
 }
 
 
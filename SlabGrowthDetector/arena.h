@@ -0,0 +1,110 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "report.h"
+
+// Fixed-footprint mode. Every table is sized from a first probe of /proc
+// plus headroom and carved out of one preallocated region. In steady state
+// nothing is allocated: running out of room is a hard failure with a
+// diagnostic instead of a silent malloc.
+
+#define ARENA_ALIGN 16
+
+typedef struct
+{
+    char *base;
+    size_t size;
+    size_t used;
+} arena;
+
+static arena fixed_arena = { NULL, 0, 0 };
+static int fixed_footprint = 0;   // --fixed-footprint
+static size_t fixed_heap_mark = 0;
+
+int arena_init(size_t size, int lock)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap fixed-footprint region");
+        return -1;
+    }
+    // touch every page now so steady state never faults in new memory
+    memset(p, 0, size);
+
+    if (lock && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        perror("mlockall (continuing unlocked)");
+
+    fixed_arena.base = p;
+    fixed_arena.size = size;
+    fixed_arena.used = 0;
+    return 0;
+}
+
+// `what` names the table that overflowed in the diagnostic
+void *arena_alloc(size_t n, const char *what)
+{
+    size_t off = (fixed_arena.used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (!fixed_arena.base || off + n > fixed_arena.size) {
+        fprintf(stderr, "fixed-footprint: region exhausted allocating %zu bytes for %s "
+                        "(%zu of %zu bytes used); restart with more --headroom\n",
+                n, what, fixed_arena.used, fixed_arena.size);
+        exit(EXIT_FAILURE);
+    }
+    fixed_arena.used = off + n;
+    return fixed_arena.base + off;
+}
+
+// Allocation entry point for the tables: the arena in fixed-footprint
+// mode, plain malloc otherwise.
+void *kml_alloc(size_t n, const char *what)
+{
+    return fixed_footprint ? arena_alloc(n, what) : malloc(n);
+}
+
+void kml_free(void *p)
+{
+    if (!fixed_footprint)
+        free(p);
+}
+
+static size_t fixed_heap_in_use(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+// Taken after the first full cycle, once stdio and friends have set up.
+void fixed_footprint_mark(void)
+{
+    fixed_heap_mark = fixed_heap_in_use();
+}
+
+// Reports any heap growth since the mark: steady state must allocate nothing.
+void fixed_footprint_check(void)
+{
+    size_t now = fixed_heap_in_use();
+    if (fixed_footprint && now > fixed_heap_mark) {
+        fprintf(stderr, "fixed-footprint: heap grew by %zu bytes in steady state\n",
+                now - fixed_heap_mark);
+        fixed_heap_mark = now;
+    }
+}
+
+void show_fixed_footprint(void)
+{
+    rprintf("[FOOTPRINT] region %zu KB, %zu KB used (%.0f%%)\n",
+            fixed_arena.size / 1024, fixed_arena.used / 1024,
+            fixed_arena.size ? 100.0 * fixed_arena.used / fixed_arena.size : 0.0);
+}
+
+#endif // ARENA_H
@@ -0,0 +1,87 @@
+#ifndef BUDDYINFO_H
+#define BUDDYINFO_H
+
+#include <stdio.h>
+#include <string.h>
+
+// /proc/buddyinfo: free block counts per node, zone and order
+#define FILE_BUDDYINFO "/proc/buddyinfo"
+#define BUDDY_MAX_ORDER 11
+#define BUDDY_MAX_ZONES 32
+// PAGE_ALLOC_COSTLY_ORDER in the kernel; slab and networking live here
+#define BUDDY_COSTLY_ORDER 3
+
+typedef struct
+{
+    int node;
+    char zone[16];
+    unsigned long long free[BUDDY_MAX_ORDER]; // free blocks of each order
+} buddyzone;
+
+static buddyzone buddy_zones[BUDDY_MAX_ZONES];
+static procfile buddyinfo_file = PROCFILE_INIT(FILE_BUDDYINFO);
+static int buddy_nzones = 0;
+static int buddy_orders = 0; // orders the kernel actually reports
+
+// Parse buddyinfo text into zones[]; returns the zone count and the
+// highest number of orders seen in *orders.
+int parse_buddyinfo_buffer(char *buf, buddyzone *zones, int max, int *orders)
+{
+    int n = 0;
+    *orders = 0;
+    for (char *line = buf; line && n < max; line = procfile_next_line(line)) {
+        buddyzone *z = &zones[n];
+        int off = 0;
+        if (sscanf(line, "Node %d, zone %15s%n", &z->node, z->zone, &off) != 2)
+            continue;
+
+        char *p = line + off;
+        int order = 0;
+        while (order < BUDDY_MAX_ORDER) {
+            char *end;
+            unsigned long long v = strtoull(p, &end, 10);
+            if (end == p)
+                break;
+            z->free[order++] = v;
+            p = end;
+        }
+        for (int i = order; i < BUDDY_MAX_ORDER; i++)
+            z->free[i] = 0;
+        if (order > *orders)
+            *orders = order;
+        n++;
+    }
+    return n;
+}
+
+void parse_buddyinfo(void)
+{
+    if (procfile_read(&buddyinfo_file) < 0) {
+        perror("cannot read /proc/buddyinfo");
+        return;
+    }
+    buddy_nzones = parse_buddyinfo_buffer(buddyinfo_file.buf, buddy_zones,
+                                          BUDDY_MAX_ZONES, &buddy_orders);
+}
+
+// Free pages held in blocks of at least `order`, over all zones.
+unsigned long long buddy_free_pages_at_least(int order)
+{
+    unsigned long long pages = 0;
+    for (int z = 0; z < buddy_nzones; z++)
+        for (int o = order; o < BUDDY_MAX_ORDER; o++)
+            pages += buddy_zones[z].free[o] << o;
+    return pages;
+}
+
+// Unusable free space index for `order`: the share of free memory that
+// cannot satisfy an allocation of that order. 0 = none, 1 = all of it.
+double buddy_unusable_index(int order)
+{
+    unsigned long long total = buddy_free_pages_at_least(0);
+    if (total == 0)
+        return 1.0;
+    return (double)(total - buddy_free_pages_at_least(order)) / (double)total;
+}
+
+#endif // BUDDYINFO_H
@@ -0,0 +1,227 @@
+#ifndef COMPACTION_H
+#define COMPACTION_H
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "report.h"
+
+// Compaction and THP health. Keeps a short history of the buddyinfo order
+// matrix next to the high-order failure rates, learns at what free-block
+// level failures started, and projects when each order will get there.
+
+#define COMPACT_HISTORY 120
+#define COMPACT_WATCH_ORDERS 2
+#define COMPACT_THP_ORDER 9        // pageblock order with 4 KB pages
+#define COMPACT_ONSET_EPISODES 4   // failure episodes the onset level spans
+
+// orders worth predicting: costly slab/network allocations and THP. Each
+// is judged by its own failures: compaction failures and direct reclaim
+// stalls for the costly order, the THP counters for the pageblock order.
+enum { COMPACT_COSTLY, COMPACT_THP };
+static const int compact_watch[COMPACT_WATCH_ORDERS] = {BUDDY_COSTLY_ORDER, COMPACT_THP_ORDER};
+
+typedef struct
+{
+    double t;                                  // seconds, CLOCK_MONOTONIC
+    double blocks_at_least[BUDDY_MAX_ORDER];   // free order-k-capable blocks
+    double compact_stall, compact_fail, compact_success;
+    double thp_fault_fallback, thp_collapse_alloc_failed;
+    double allocstall;
+    double failures[COMPACT_WATCH_ORDERS];     // per watched order, per second
+} compact_sample;
+
+// Highest free-block level of each of the last few failure episodes (runs
+// of samples with failures). The onset is the max over them, so a level
+// from long ago ages out once newer episodes start lower.
+typedef struct
+{
+    double level[COMPACT_ONSET_EPISODES];
+    int head;        // slot of the current or last episode
+    int len;
+    int in_episode;
+} compact_onset;
+
+static compact_sample compact_hist[COMPACT_HISTORY];
+static int compact_enabled = 1; // optional collector, the governor may drop it
+static int compact_head = 0;   // next slot to write
+static int compact_len = 0;
+static compact_onset compact_onsets[COMPACT_WATCH_ORDERS];
+
+static const compact_sample *compact_at(int i) // 0 = oldest
+{
+    int start = (compact_head - compact_len + COMPACT_HISTORY) % COMPACT_HISTORY;
+    return &compact_hist[(start + i) % COMPACT_HISTORY];
+}
+
+static void compact_onset_update(compact_onset *o, double failures, double blocks)
+{
+    if (failures <= 0.0) {
+        o->in_episode = 0;
+        return;
+    }
+    if (!o->in_episode) {
+        o->in_episode = 1;
+        o->head = o->len ? (o->head + 1) % COMPACT_ONSET_EPISODES : 0;
+        o->level[o->head] = blocks;
+        if (o->len < COMPACT_ONSET_EPISODES)
+            o->len++;
+    } else if (blocks > o->level[o->head]) {
+        o->level[o->head] = blocks;
+    }
+}
+
+// Free-block level at which watched order `w` started failing; 0 if no
+// failure episode has been seen.
+static int compact_onset_level(int w, double *level)
+{
+    const compact_onset *o = &compact_onsets[w];
+    if (o->len == 0)
+        return 0;
+    double max = 0.0;
+    for (int i = 0; i < o->len; i++)
+        if (o->level[i] > max)
+            max = o->level[i];
+    *level = max;
+    return 1;
+}
+
+// Call after vmrate_update() and parse_buddyinfo().
+void update_compaction_health(void)
+{
+    if (!compact_enabled)
+        return;
+    compact_sample *s = &compact_hist[compact_head];
+    memset(s, 0, sizeof(*s));
+
+    s->t = vm_sample_ts.tv_sec + vm_sample_ts.tv_nsec / 1e9;
+    // blocks that can serve order k: sum over j >= k of n_j * 2^(j-k)
+    for (int k = 0; k < BUDDY_MAX_ORDER; k++) {
+        double blocks = 0.0;
+        for (int z = 0; z < buddy_nzones; z++)
+            for (int j = k; j < BUDDY_MAX_ORDER; j++)
+                blocks += (double)(buddy_zones[z].free[j] << (j - k));
+        s->blocks_at_least[k] = blocks;
+    }
+
+    const vmrate_derived *d = get_vmrate_derived();
+    s->compact_stall = d->compact_stall_per_sec;
+    s->compact_fail = d->compact_fail_per_sec;
+    s->compact_success = d->compact_success_per_sec;
+    s->allocstall = d->allocstall_per_sec;
+    s->thp_fault_fallback = get_vmstat_rate("thp_fault_fallback");
+    s->thp_collapse_alloc_failed = get_vmstat_rate("thp_collapse_alloc_failed");
+    s->failures[COMPACT_COSTLY] = s->compact_fail + s->allocstall;
+    s->failures[COMPACT_THP] = s->thp_fault_fallback + s->thp_collapse_alloc_failed;
+
+    // remember the free-block level at which each order's failures showed up
+    for (int w = 0; w < COMPACT_WATCH_ORDERS; w++)
+        compact_onset_update(&compact_onsets[w], s->failures[w],
+                             s->blocks_at_least[compact_watch[w]]);
+
+    compact_head = (compact_head + 1) % COMPACT_HISTORY;
+    if (compact_len < COMPACT_HISTORY)
+        compact_len++;
+}
+
+// Pearson correlation between free blocks at watched order `w` and that
+// order's failure rate. Strongly negative means failures track its depletion.
+double compaction_order_correlation(int w)
+{
+    int n = compact_len;
+    if (n < 3)
+        return 0.0;
+
+    int order = compact_watch[w];
+    double mx = 0.0, my = 0.0;
+    for (int i = 0; i < n; i++) {
+        mx += compact_at(i)->blocks_at_least[order];
+        my += compact_at(i)->failures[w];
+    }
+    mx /= n;
+    my /= n;
+
+    double sxy = 0.0, sxx = 0.0, syy = 0.0;
+    for (int i = 0; i < n; i++) {
+        double dx = compact_at(i)->blocks_at_least[order] - mx;
+        double dy = compact_at(i)->failures[w] - my;
+        sxy += dx * dy;
+        sxx += dx * dx;
+        syy += dy * dy;
+    }
+    double den = sqrt(sxx * syy);
+    return den > 0.0 ? sxy / den : 0.0;
+}
+
+// Least-squares slope of free blocks at `order`, blocks per second.
+static double compaction_order_slope(int order)
+{
+    int n = compact_len;
+    if (n < 3)
+        return 0.0;
+
+    double t0 = compact_at(0)->t;
+    double st = 0.0, sy = 0.0, stt = 0.0, sty = 0.0;
+    for (int i = 0; i < n; i++) {
+        double t = compact_at(i)->t - t0;
+        double y = compact_at(i)->blocks_at_least[order];
+        st += t;
+        sy += y;
+        stt += t * t;
+        sty += t * y;
+    }
+    double den = n * stt - st * st;
+    return den > 0.0 ? (n * sty - st * sy) / den : 0.0;
+}
+
+// Seconds until free blocks at watched order `w` fall to the level where
+// its failures began (or to zero if none seen yet). Negative when not falling.
+double compaction_eta_sec(int w)
+{
+    if (compact_len < 3)
+        return -1.0;
+    int order = compact_watch[w];
+    double slope = compaction_order_slope(order);
+    if (slope >= 0.0)
+        return -1.0;
+
+    double now = compact_at(compact_len - 1)->blocks_at_least[order];
+    double floor = 0.0;
+    compact_onset_level(w, &floor);
+    if (now <= floor)
+        return 0.0;
+    return (now - floor) / -slope;
+}
+
+void show_compaction_health(void)
+{
+    if (!compact_enabled || compact_len == 0)
+        return;
+    const compact_sample *s = compact_at(compact_len - 1);
+
+    rprintf("[COMPACTION] stall=%.2f/s fail=%.2f/s success=%.2f/s thp_fallback=%.2f/s "
+            "collapse_failed=%.2f/s allocstall=%.2f/s\n",
+            s->compact_stall, s->compact_fail, s->compact_success,
+            s->thp_fault_fallback, s->thp_collapse_alloc_failed, s->allocstall);
+
+    for (int w = 0; w < COMPACT_WATCH_ORDERS; w++) {
+        int k = compact_watch[w];
+        if (k >= buddy_orders)
+            continue;
+        double eta = compaction_eta_sec(w);
+        double corr = compaction_order_correlation(w);
+        double onset;
+
+        rprintf("[COMPACTION] order-%d free blocks=%.0f trend=%+.1f/min corr(failures)=%.2f",
+                k, s->blocks_at_least[k], compaction_order_slope(k) * 60.0, corr);
+        if (compact_onset_level(w, &onset))
+            rprintf(" failures began below %.0f", onset);
+        if (eta == 0.0)
+            rprintf(" \033[1;31m-> order-%d allocations failing now\033[0m", k);
+        else if (eta > 0.0 && eta < 3600.0)
+            rprintf(" \033[1;33m-> order-%d failures expected in ~%.0f min\033[0m", k, eta / 60.0);
+        rprintf("\n");
+    }
+}
+
+#endif // COMPACTION_H
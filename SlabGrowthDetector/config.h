@@ -0,0 +1,382 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include "report.h"
+
+// Detector tunables (detector.conf or --config PATH), with the leak score
+// weights and the compiled alert rules they point at. A watcher thread
+// reloads everything on SIGHUP or when one of the files is rewritten:
+// it parses into a spare slot and publishes it with one atomic pointer
+// store. The analyzer takes a reference at the start of a cycle and keeps
+// that config until the cycle is printed, so a cycle never sees half of
+// a reload. Whatever can be derived from the config (EMA decay per time
+// step, the rule programs) is computed here, once per reload.
+
+#define CONFIG_DEFAULT_PATH "detector.conf"
+#define CONFIG_SLOTS 3              // current, one a slow reader still holds, next
+#define CONFIG_POLL_MS 500
+#define CONFIG_SETTLE_MS 100        // editors write in several steps
+#define CONFIG_PATH_LEN 256
+#define CONFIG_WATCHES 3
+// EMA decay precomputed per 1/8 interval, up to 16 intervals
+#define CONFIG_EMA_STEPS 8
+#define CONFIG_EMA_SPAN 16
+#define CONFIG_EMA_TABLE (CONFIG_EMA_STEPS * CONFIG_EMA_SPAN + 1)
+
+typedef struct
+{
+    unsigned generation;
+    double interval;            // seconds between samples
+    double ema_alpha;           // EMA weight of a new sample, per interval
+    double growth_threshold;    // % per cycle that raises [ALERT]
+    int mono_limit;             // consecutive increases for [LEAK WARNING]
+    int top_n;
+    char score_path[CONFIG_PATH_LEN];
+    char rules_path[CONFIG_PATH_LEN];
+    score_config score;
+    rule_set rules;
+    // old-sample weight after i/CONFIG_EMA_STEPS intervals: (1 - alpha)^(i/8)
+    double ema_keep[CONFIG_EMA_TABLE];
+    int refs;
+} detector_config;
+
+// command line values win over the file, on every reload
+typedef struct
+{
+    const char *path;
+    double interval;            // 0 = from the file
+    const char *score_path;
+    const char *rules_path;
+} config_overrides;
+
+static detector_config config_slot[CONFIG_SLOTS];
+static detector_config *config_cur = NULL;
+static __thread const detector_config *config_held = NULL;
+static config_overrides config_opts = {CONFIG_DEFAULT_PATH, 0.0, NULL, NULL};
+
+static pthread_t config_tid;
+static int config_started = 0;
+static volatile int config_stop_flag = 0;
+static int config_ready = 0;
+static int config_sigfd = -1, config_infd = -1;
+static int config_wd[CONFIG_WATCHES];
+static char config_watch_name[CONFIG_WATCHES][CONFIG_PATH_LEN];
+
+static void config_defaults(detector_config *c)
+{
+    c->interval = 5.0;
+    c->ema_alpha = 0.30;
+    c->growth_threshold = 5.0;
+    c->mono_limit = 3;
+    c->top_n = 10;
+    snprintf(c->score_path, sizeof(c->score_path), "%s", SCORE_DEFAULT_CONFIG);
+    snprintf(c->rules_path, sizeof(c->rules_path), "%s", RULES_DEFAULT_CONFIG);
+    c->score = score_defaults;
+}
+
+// "key = value" lines, '#' starts a comment. Bad values keep the default.
+static int config_parse(const char *path, detector_config *c)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+
+    char line[LINE_BUFFER];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+
+        char key[64], val[CONFIG_PATH_LEN];
+        if (sscanf(line, " %63[^= \t] = %255s", key, val) != 2)
+            continue;
+
+        char *end;
+        double v = strtod(val, &end);
+        int numeric = end != val && *end == '\0';
+        const char *bad = NULL;
+        if (strcmp(key, "score_config") == 0) {
+            snprintf(c->score_path, sizeof(c->score_path), "%s", val);
+        } else if (strcmp(key, "rules") == 0) {
+            snprintf(c->rules_path, sizeof(c->rules_path), "%s", val);
+        } else if (strcmp(key, "interval") == 0) {
+            if (numeric && v > 0.0) c->interval = v; else bad = "a positive number of seconds";
+        } else if (strcmp(key, "ema_alpha") == 0) {
+            if (numeric && v > 0.0 && v <= 1.0) c->ema_alpha = v; else bad = "in (0, 1]";
+        } else if (strcmp(key, "growth_threshold") == 0) {
+            if (numeric) c->growth_threshold = v; else bad = "a percentage";
+        } else if (strcmp(key, "mono_limit") == 0) {
+            if (numeric && v >= 1.0) c->mono_limit = (int)v; else bad = "at least 1";
+        } else if (strcmp(key, "top_n") == 0) {
+            if (numeric && v >= 1.0) c->top_n = (int)v; else bad = "at least 1";
+        } else {
+            fprintf(stderr, "%s:%d: unknown key '%s'\n", path, lineno, key);
+        }
+        if (bad)
+            fprintf(stderr, "%s:%d: %s must be %s\n", path, lineno, key, bad);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+// Everything a reload produces; the slot is not visible to readers yet.
+static void config_build(detector_config *c, unsigned generation)
+{
+    config_defaults(c);
+    c->generation = generation;
+    if (config_parse(config_opts.path, c) != 0 && strcmp(config_opts.path, CONFIG_DEFAULT_PATH) != 0)
+        fprintf(stderr, "cannot read config %s: %s\n", config_opts.path, strerror(errno));
+    if (config_opts.interval > 0.0)
+        c->interval = config_opts.interval;
+    if (config_opts.score_path)
+        snprintf(c->score_path, sizeof(c->score_path), "%s", config_opts.score_path);
+    if (config_opts.rules_path)
+        snprintf(c->rules_path, sizeof(c->rules_path), "%s", config_opts.rules_path);
+
+    // the built-in names may be absent, anything named explicitly may not
+    if (load_score_config(c->score_path, &c->score) != 0 && strcmp(c->score_path, SCORE_DEFAULT_CONFIG) != 0)
+        fprintf(stderr, "cannot read score config %s: %s\n", c->score_path, strerror(errno));
+    if (load_rules(c->rules_path, &c->rules) != 0 && strcmp(c->rules_path, RULES_DEFAULT_CONFIG) != 0)
+        fprintf(stderr, "cannot read rules %s: %s\n", c->rules_path, strerror(errno));
+
+    for (int i = 0; i < CONFIG_EMA_TABLE; i++)
+        c->ema_keep[i] = pow(1.0 - c->ema_alpha, (double)i / CONFIG_EMA_STEPS);
+}
+
+// Reference to the current config: count first, then make sure it is
+// still current, so the writer never reuses a slot a reader is entering.
+static detector_config *config_hold(void)
+{
+    for (;;) {
+        detector_config *c = __atomic_load_n(&config_cur, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&c->refs, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&config_cur, __ATOMIC_SEQ_CST) == c)
+            return c;
+        __atomic_sub_fetch(&c->refs, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void config_release(const detector_config *c)
+{
+    __atomic_sub_fetch(&((detector_config *)c)->refs, 1, __ATOMIC_SEQ_CST);
+}
+
+// Pins the current config on this thread until config_leave().
+void config_enter(void)
+{
+    if (!config_held)
+        config_held = config_hold();
+}
+
+void config_leave(void)
+{
+    if (config_held)
+        config_release(config_held);
+    config_held = NULL;
+}
+
+// The config pinned by config_enter(); only valid until config_leave().
+static const detector_config *cfg(void)
+{
+    return config_held;
+}
+
+// Weight of the old EMA after dt seconds, from the table built on reload.
+static double config_ema_keep(const detector_config *c, double dt)
+{
+    long i = lround(dt / c->interval * CONFIG_EMA_STEPS);
+    if (i < 0)
+        i = 0;
+    if (i >= CONFIG_EMA_TABLE)
+        i = CONFIG_EMA_TABLE - 1;
+    return c->ema_keep[i];
+}
+
+static void config_log(const detector_config *c)
+{
+    time_t now = time(NULL);
+    char ts[32];
+    strftime(ts, sizeof(ts), "%H:%M:%S", localtime(&now));
+    fprintf(stderr, "[CONFIG %s] generation %u: interval %.1fs, ema_alpha %.2f, growth %.1f%%, "
+                    "mono %d, top %d, %d rules\n",
+            ts, c->generation, c->interval, c->ema_alpha, c->growth_threshold,
+            c->mono_limit, c->top_n, c->rules.count);
+}
+
+// Builds the next config in a slot no reader holds and publishes it.
+static void config_publish(void)
+{
+    detector_config *cur = __atomic_load_n(&config_cur, __ATOMIC_SEQ_CST);
+    detector_config *next = NULL;
+    while (!next) {
+        for (int i = 0; i < CONFIG_SLOTS && !next; i++)
+            if (&config_slot[i] != cur && __atomic_load_n(&config_slot[i].refs, __ATOMIC_SEQ_CST) == 0)
+                next = &config_slot[i];
+        if (!next) {
+            struct timespec ts = {0, 10 * 1000 * 1000};
+            nanosleep(&ts, NULL);
+        }
+    }
+    config_build(next, cur ? cur->generation + 1 : 1);
+    __atomic_store_n(&config_cur, next, __ATOMIC_SEQ_CST);
+}
+
+static void config_watch_one(int w, const char *path)
+{
+    char dir[CONFIG_PATH_LEN];
+    const char *slash = strrchr(path, '/');
+    if (slash) {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path) + (slash == path), path);
+        snprintf(config_watch_name[w], sizeof(config_watch_name[w]), "%s", slash + 1);
+    } else {
+        snprintf(dir, sizeof(dir), ".");
+        snprintf(config_watch_name[w], sizeof(config_watch_name[w]), "%s", path);
+    }
+    config_wd[w] = inotify_add_watch(config_infd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+}
+
+// Directories rather than files: editors replace a file by renaming
+// over it, which would end a watch on the file itself.
+static void config_watch(const detector_config *c)
+{
+    if (config_infd < 0)
+        return;
+    for (int w = 0; w < CONFIG_WATCHES; w++)
+        if (config_wd[w] >= 0)
+            inotify_rm_watch(config_infd, config_wd[w]);
+    config_watch_one(0, config_opts.path);
+    config_watch_one(1, c->score_path);
+    config_watch_one(2, c->rules_path);
+}
+
+// Drains the inotify queue; nonzero if a config file changed.
+static int config_drain_inotify(void)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    ssize_t n;
+    while ((n = read(config_infd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            for (int w = 0; w < CONFIG_WATCHES; w++)
+                if (ev->wd == config_wd[w] && ev->len && strcmp(ev->name, config_watch_name[w]) == 0)
+                    changed = 1;
+            p += sizeof(*ev) + ev->len;
+        }
+    }
+    return changed;
+}
+
+static void *config_run(void *arg)
+{
+    (void)arg;
+    // the first load runs here too, so this thread's allocator and stdio
+    // are warm before a fixed-footprint run takes its heap mark
+    config_publish();
+    config_watch(config_cur);
+    __atomic_store_n(&config_ready, 1, __ATOMIC_RELEASE);
+
+    while (!config_stop_flag) {
+        struct pollfd pfd[2] = {{config_sigfd, POLLIN, 0}, {config_infd, POLLIN, 0}};
+        if (poll(pfd, 2, CONFIG_POLL_MS) <= 0)
+            continue;
+
+        int reload = 0;
+        if (pfd[0].revents & POLLIN) {
+            struct signalfd_siginfo si;
+            while (read(config_sigfd, &si, sizeof(si)) == (ssize_t)sizeof(si))
+                reload = 1;
+        }
+        if (config_infd >= 0 && (pfd[1].revents & POLLIN)) {
+            int changed = config_drain_inotify();
+            // let the writer finish before reading the file
+            while (changed && poll(&pfd[1], 1, CONFIG_SETTLE_MS) > 0)
+                config_drain_inotify();
+            reload |= changed;
+        }
+        if (!reload)
+            continue;
+
+        config_publish();
+        const detector_config *c = __atomic_load_n(&config_cur, __ATOMIC_ACQUIRE);
+        config_watch(c);
+        config_log(c);
+    }
+    return NULL;
+}
+
+// Starts the watcher and waits for the first config. Call before any
+// other thread exists: SIGHUP is blocked here so every later thread
+// inherits the mask and only the watcher's signalfd sees it.
+int config_start(const config_overrides *opts)
+{
+    config_opts = *opts;
+    if (!config_opts.path)
+        config_opts.path = CONFIG_DEFAULT_PATH;
+    for (int w = 0; w < CONFIG_WATCHES; w++)
+        config_wd[w] = -1;
+
+    sigset_t hup;
+    sigemptyset(&hup);
+    sigaddset(&hup, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hup, NULL);
+    config_sigfd = signalfd(-1, &hup, SFD_NONBLOCK | SFD_CLOEXEC);
+    config_infd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (config_infd < 0)
+        fprintf(stderr, "config: no inotify (%s), reloading on SIGHUP only\n", strerror(errno));
+    if (config_sigfd < 0)
+        perror("config: signalfd");
+    tzset();   // localtime() in the reload log must not allocate later
+
+    // the watcher leaves SIGINT/SIGTERM to the main loop
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    int err = pthread_create(&config_tid, NULL, config_run, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        errno = err;
+        perror("pthread_create config");
+        config_publish();          // no reloads, but a config all the same
+    } else {
+        config_started = 1;
+        while (!__atomic_load_n(&config_ready, __ATOMIC_ACQUIRE)) {
+            struct timespec ts = {0, 1000 * 1000};
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    const detector_config *c = config_cur;
+    if (c->rules.count)
+        printf("Alert rules: %d loaded, %d instructions\n", c->rules.count, c->rules.code_len);
+    return config_started && (config_sigfd >= 0 || config_infd >= 0) ? 0 : -1;
+}
+
+void config_stop(void)
+{
+    if (!config_started)
+        return;
+    config_stop_flag = 1;
+    pthread_join(config_tid, NULL);
+    config_started = 0;
+}
+
+#endif // CONFIG_H
@@ -0,0 +1,226 @@
+#ifndef FSOBJS_H
+#define FSOBJS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "procfile.h"
+#include "report.h"
+
+// Filesystem object counts from /proc/sys/fs, joined with the dentry,
+// inode and filp caches. /proc/slabinfo cannot tell a negative dentry
+// from a positive one or an open file from a cached inode; these counters
+// can: dentry-state splits unused and negative dentries, inode-nr free
+// inodes, file-nr the files actually open.
+
+#define FILE_DENTRY_STATE "/proc/sys/fs/dentry-state"
+#define FILE_INODE_NR "/proc/sys/fs/inode-nr"
+#define FILE_INODE_STATE "/proc/sys/fs/inode-state"
+#define FILE_FILE_NR "/proc/sys/fs/file-nr"
+#define FS_HISTORY 60
+#define FS_MIN_SAMPLES 6
+
+enum
+{
+    FS_DENTRY, FS_DENTRY_UNUSED, FS_DENTRY_NEGATIVE,
+    FS_INODES, FS_INODES_FREE,
+    FS_FILES, FS_FILES_MAX,
+    FS_CACHE_DENTRY, FS_CACHE_INODE, FS_CACHE_FILP,   // slab objects
+    FS_COUNT
+};
+
+static int fs_enabled = 1;              // optional collector, the governor may drop it
+static int fs_has_negative = 0;         // nr_negative seen (5.8+)
+static int fs_inode_state = 0;          // fell back to inode-state
+static procfile dentry_state_file = PROCFILE_INIT(FILE_DENTRY_STATE);
+static procfile inode_nr_file = PROCFILE_INIT(FILE_INODE_NR);
+static procfile file_nr_file = PROCFILE_INIT(FILE_FILE_NR);
+
+static double fs_hist_t[FS_HISTORY];
+static double fs_hist[FS_HISTORY][FS_COUNT];
+static int fs_head = 0, fs_len = 0;
+
+static int fs_at(int i) // 0 = oldest
+{
+    return (fs_head - fs_len + i + 2 * FS_HISTORY) % FS_HISTORY;
+}
+
+static const double *fs_now(void)
+{
+    return fs_hist[fs_at(fs_len - 1)];
+}
+
+// Reads up to `max` whitespace-separated numbers; returns how many.
+static int fs_read_numbers(procfile *pf, double *v, int max)
+{
+    if (procfile_read(pf) < 0)
+        return 0;
+    char *p = pf->buf, *end;
+    int n = 0;
+    while (n < max) {
+        unsigned long long x = strtoull(p, &end, 10);
+        if (end == p)
+            break;
+        v[n++] = (double)x;
+        p = end;
+    }
+    return n;
+}
+
+// inode_cache, ext4_inode_cache, xfs_inode, ... but not fscrypt_inode_info
+static int fs_is_inode_cache(const char *name)
+{
+    size_t len = strlen(name);
+    return strcmp(name, "inode_cache") == 0 ||
+           (len > 12 && strcmp(name + len - 12, "_inode_cache") == 0) ||
+           (len > 6 && strcmp(name + len - 6, "_inode") == 0);
+}
+
+// Call after the slab rows are applied.
+void update_fs_objects(void)
+{
+    if (!fs_enabled)
+        return;
+    double *s = fs_hist[fs_head];
+    memset(s, 0, sizeof(fs_hist[0]));
+
+    double v[6] = {0};
+    int n = fs_read_numbers(&dentry_state_file, v, 6);
+    if (n < 2) {
+        perror("fs objects: " FILE_DENTRY_STATE);
+        fs_enabled = 0;
+        return;
+    }
+    s[FS_DENTRY] = v[0];
+    s[FS_DENTRY_UNUSED] = v[1];
+    // older kernels print a zero "dummy" where nr_negative now is
+    if (n >= 5 && v[4] > 0.0)
+        fs_has_negative = 1;
+    s[FS_DENTRY_NEGATIVE] = n >= 5 ? v[4] : 0.0;
+
+    // inode-state carries the same two leading numbers where inode-nr is missing
+    if (fs_read_numbers(&inode_nr_file, v, 2) < 2 && !fs_inode_state) {
+        if (inode_nr_file.fd >= 0)
+            close(inode_nr_file.fd);
+        inode_nr_file.fd = -1;   // the buffer is kept
+        inode_nr_file.path = FILE_INODE_STATE;
+        fs_inode_state = 1;
+        fs_read_numbers(&inode_nr_file, v, 2);
+    }
+    s[FS_INODES] = v[0];
+    s[FS_INODES_FREE] = v[1];
+
+    if (fs_read_numbers(&file_nr_file, v, 3) == 3) {
+        s[FS_FILES] = v[0] - v[1]; // v[1] is always 0 since 2.6, kept for old kernels
+        s[FS_FILES_MAX] = v[2];
+    }
+
+    for (list *cur = get_slab_list_head(); cur; cur = cur->next) {
+        const slabinfo *slab = cur->slab;
+        if (strcmp(slab->name, "dentry") == 0)
+            s[FS_CACHE_DENTRY] = slab_trend_objs(slab);
+        else if (strcmp(slab->name, "filp") == 0)
+            s[FS_CACHE_FILP] = slab_trend_objs(slab);
+        else if (fs_is_inode_cache(slab->name))
+            s[FS_CACHE_INODE] += slab_trend_objs(slab);
+    }
+
+    fs_hist_t[fs_head] = slab_sample_ts.tv_sec + slab_sample_ts.tv_nsec / 1e9;
+    fs_head = (fs_head + 1) % FS_HISTORY;
+    if (fs_len < FS_HISTORY)
+        fs_len++;
+}
+
+// Least-squares slope of one series, per second.
+static double fs_slope(int c)
+{
+    int n = fs_len;
+    double t0 = fs_hist_t[fs_at(0)];
+    double st = 0.0, sy = 0.0, stt = 0.0, sty = 0.0;
+    for (int i = 0; i < n; i++) {
+        double t = fs_hist_t[fs_at(i)] - t0;
+        double y = fs_hist[fs_at(i)][c];
+        st += t;
+        sy += y;
+        stt += t * t;
+        sty += t * y;
+    }
+    double den = n * stt - st * st;
+    return den > 0.0 ? (n * sty - st * sy) / den : 0.0;
+}
+
+// Rise over the window, from the slope so single-sample spikes don't count.
+static double fs_rise(int c)
+{
+    return fs_slope(c) * (fs_hist_t[fs_at(fs_len - 1)] - fs_hist_t[fs_at(0)]);
+}
+
+static int fs_rising(int c)
+{
+    double rise = fs_rise(c);
+    return rise > 16.0 && rise > 0.02 * fs_hist[fs_at(0)][c];
+}
+
+static void fs_show_trend(const char *cache, int c)
+{
+    rprintf("[FS OBJECTS] %-6s objs=%.0f trend=%+.1f/min", cache, fs_now()[c], fs_slope(c) * 60.0);
+}
+
+void show_fs_objects(void)
+{
+    if (!fs_enabled || fs_len == 0)
+        return;
+    const double *s = fs_now();
+
+    rprintf("[FS OBJECTS] dentries=%.0f (unused %.0f", s[FS_DENTRY], s[FS_DENTRY_UNUSED]);
+    if (fs_has_negative)
+        rprintf(", negative %.0f = %.0f%%", s[FS_DENTRY_NEGATIVE],
+                s[FS_DENTRY] > 0.0 ? 100.0 * s[FS_DENTRY_NEGATIVE] / s[FS_DENTRY] : 0.0);
+    rprintf(") inodes=%.0f (free %.0f) files=%.0f/%.0f\n",
+            s[FS_INODES], s[FS_INODES_FREE], s[FS_FILES], s[FS_FILES_MAX]);
+
+    if (fs_len < FS_MIN_SAMPLES)
+        return;
+    int files_up = fs_rising(FS_FILES);
+
+    // dentries: negative, unused but cached, or pinned
+    if (fs_rising(FS_CACHE_DENTRY)) {
+        double grow = fs_rise(FS_CACHE_DENTRY);
+        fs_show_trend("dentry", FS_CACHE_DENTRY);
+        rprintf(" negative %+.1f/min unused %+.1f/min",
+                fs_slope(FS_DENTRY_NEGATIVE) * 60.0, fs_slope(FS_DENTRY_UNUSED) * 60.0);
+        if (fs_has_negative && fs_rise(FS_DENTRY_NEGATIVE) > 0.5 * grow)
+            rprintf(" \033[1;33m-> negative dentry explosion (lookups of missing files)\033[0m\n");
+        else if (fs_rise(FS_DENTRY_UNUSED) > 0.5 * grow)
+            rprintf(" -> unused dentries cached, reclaimable\n");
+        else if (files_up)
+            rprintf(" \033[1;33m-> dentries pinned by an open file leak\033[0m\n");
+        else
+            rprintf(" -> dentries in use growing\n");
+    }
+
+    if (fs_rising(FS_CACHE_INODE)) {
+        fs_show_trend("inodes", FS_CACHE_INODE);
+        rprintf(" in use %+.1f/min free %+.1f/min",
+                (fs_slope(FS_INODES) - fs_slope(FS_INODES_FREE)) * 60.0, fs_slope(FS_INODES_FREE) * 60.0);
+        if (fs_rise(FS_INODES_FREE) > 0.5 * fs_rise(FS_CACHE_INODE))
+            rprintf(" -> unused inodes cached, reclaimable\n");
+        else if (files_up)
+            rprintf(" \033[1;33m-> inodes held by an open file leak\033[0m\n");
+        else
+            rprintf(" -> inodes in use growing\n");
+    }
+
+    if (fs_rising(FS_CACHE_FILP)) {
+        fs_show_trend("filp", FS_CACHE_FILP);
+        rprintf(" open files %+.1f/min", fs_slope(FS_FILES) * 60.0);
+        if (files_up)
+            rprintf(" \033[1;31m-> open file leak (%.0f%% of file-max)\033[0m\n",
+                    s[FS_FILES_MAX] > 0.0 ? 100.0 * s[FS_FILES] / s[FS_FILES_MAX] : 0.0);
+        else
+            rprintf(" \033[1;33m-> filp objects outpace open files\033[0m\n");
+    }
+}
+
+#endif // FSOBJS_H
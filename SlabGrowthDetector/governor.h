@@ -0,0 +1,188 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// Keeps the detector inside a CPU budget. After every cycle the process
+// CPU time spent since the previous cycle is compared with the budget; on
+// overrun optional collectors are switched off first, then the interval
+// is stretched. Both are undone once usage stays well under budget.
+
+#define GOV_MAX_OPTIONAL 16
+#define GOV_STRETCH 1.5
+#define GOV_MAX_STRETCH 12.0      // never sample less often than 12x base
+#define GOV_CALM_CYCLES 5         // cycles under half budget before relaxing
+
+// from include/uapi/linux/ioprio.h
+#define GOV_IOPRIO_CLASS_SHIFT 13
+#define GOV_IOPRIO_CLASS_IDLE 3
+#define GOV_IOPRIO_WHO_PROCESS 1
+
+typedef struct
+{
+    const char *name;
+    int *enabled;      // collector's own on/off flag
+    int user_enabled;  // what the command line asked for
+    int dropped;
+} gov_optional;
+
+static double gov_budget = 0.0;       // fraction of one core, 0 = unlimited
+static double gov_base_interval = 5.0;
+static double gov_interval = 5.0;
+static int gov_calm = 0;
+static double gov_last_usage = 0.0;
+static struct timespec gov_wall0, gov_cpu0;
+static gov_optional gov_opt[GOV_MAX_OPTIONAL];
+static int gov_nopt = 0;
+
+// every enforcement decision is logged to stderr with a timestamp
+static void gov_log(const char *fmt, ...)
+{
+    time_t now = time(NULL);
+    char ts[32];
+    strftime(ts, sizeof(ts), "%H:%M:%S", localtime(&now));
+    fprintf(stderr, "[GOVERNOR %s] ", ts);
+
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+// Collectors the governor may switch off, dropped last-registered first.
+void governor_register_optional(const char *name, int *enabled)
+{
+    if (gov_nopt >= GOV_MAX_OPTIONAL)
+        return;
+    gov_opt[gov_nopt].name = name;
+    gov_opt[gov_nopt].enabled = enabled;
+    gov_opt[gov_nopt].user_enabled = *enabled;
+    gov_opt[gov_nopt].dropped = 0;
+    gov_nopt++;
+}
+
+void init_governor(double interval_sec, double budget_pct)
+{
+    gov_base_interval = gov_interval = interval_sec;
+    gov_budget = budget_pct / 100.0;
+    clock_gettime(CLOCK_MONOTONIC, &gov_wall0);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &gov_cpu0);
+    if (gov_budget > 0.0)
+        gov_log("budget %.3f%% of one core, base interval %.1fs", budget_pct, interval_sec);
+}
+
+// A reload changed the interval; a stretch in force keeps its factor.
+void governor_set_interval(double interval_sec)
+{
+    gov_interval = gov_interval / gov_base_interval * interval_sec;
+    gov_base_interval = interval_sec;
+    if (gov_budget > 0.0)
+        gov_log("base interval %.1fs", interval_sec);
+}
+
+// SCHED_IDLE for the CPU, the idle I/O class for /proc and sysfs reads
+void governor_go_idle(void)
+{
+    struct sched_param sp = { .sched_priority = 0 };
+    if (sched_setscheduler(0, SCHED_IDLE, &sp) != 0)
+        perror("sched_setscheduler(SCHED_IDLE)");
+
+    int prio = GOV_IOPRIO_CLASS_IDLE << GOV_IOPRIO_CLASS_SHIFT;
+    if (syscall(SYS_ioprio_set, GOV_IOPRIO_WHO_PROCESS, 0, prio) != 0)
+        perror("ioprio_set(IOPRIO_CLASS_IDLE)");
+}
+
+static int gov_drop_one(void)
+{
+    for (int i = gov_nopt - 1; i >= 0; i--) {
+        if (*gov_opt[i].enabled && !gov_opt[i].dropped) {
+            *gov_opt[i].enabled = 0;
+            gov_opt[i].dropped = 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int gov_restore_one(void)
+{
+    for (int i = 0; i < gov_nopt; i++) {
+        if (gov_opt[i].dropped) {
+            *gov_opt[i].enabled = gov_opt[i].user_enabled;
+            gov_opt[i].dropped = 0;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Call once per cycle, after all work and before sleeping.
+void governor_account_cycle(void)
+{
+    struct timespec wall1, cpu1;
+    clock_gettime(CLOCK_MONOTONIC, &wall1);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu1);
+
+    double wall = (wall1.tv_sec - gov_wall0.tv_sec) + (wall1.tv_nsec - gov_wall0.tv_nsec) / 1e9;
+    double cpu = (cpu1.tv_sec - gov_cpu0.tv_sec) + (cpu1.tv_nsec - gov_cpu0.tv_nsec) / 1e9;
+    gov_wall0 = wall1;
+    gov_cpu0 = cpu1;
+    if (wall <= 0.0)
+        return;
+
+    gov_last_usage = cpu / wall;
+    if (gov_budget <= 0.0)
+        return;
+
+    if (gov_last_usage > gov_budget) {
+        gov_calm = 0;
+        int i = gov_drop_one();
+        if (i >= 0) {
+            gov_log("usage %.3f%% over budget %.3f%%: dropping %s",
+                    gov_last_usage * 100.0, gov_budget * 100.0, gov_opt[i].name);
+            return;
+        }
+        double next = gov_interval * GOV_STRETCH;
+        if (next > gov_base_interval * GOV_MAX_STRETCH)
+            next = gov_base_interval * GOV_MAX_STRETCH;
+        if (next > gov_interval) {
+            gov_log("usage %.3f%% over budget: interval now %.1fs",
+                    gov_last_usage * 100.0, next);
+            gov_interval = next;
+        }
+        return;
+    }
+
+    // relax only after a run of cycles at less than half the budget
+    if (gov_last_usage < gov_budget * 0.5 && ++gov_calm >= GOV_CALM_CYCLES) {
+        gov_calm = 0;
+        if (gov_interval > gov_base_interval) {
+            double next = gov_interval / GOV_STRETCH;
+            gov_interval = next < gov_base_interval ? gov_base_interval : next;
+            gov_log("usage %.3f%% under budget: interval back to %.1fs",
+                    gov_last_usage * 100.0, gov_interval);
+        } else {
+            int i = gov_restore_one();
+            if (i >= 0)
+                gov_log("usage %.3f%% under budget %.3f%%: restoring %s",
+                        gov_last_usage * 100.0, gov_budget * 100.0, gov_opt[i].name);
+        }
+    }
+}
+
+void governor_sleep(void)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)gov_interval;
+    ts.tv_nsec = (long)((gov_interval - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+#endif // GOVERNOR_H
@@ -0,0 +1,807 @@
+#ifndef KMEMTRACE_H
+#define KMEMTRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include "report.h"
+
+// Outstanding kmalloc/kmem_cache allocations by call site, from the kmem
+// trace events. Counts per cache say that a cache grows, not who grows it.
+// One thread per CPU drains that CPU's binary ring buffer
+// (per_cpu/cpuN/trace_pipe_raw) and keeps every live pointer in a sharded
+// open-addressing table: pointer -> call site, bytes, timestamp. Each cycle
+// the table is folded into outstanding bytes and an age histogram per call
+// site.
+//
+// Frees and allocations of one pointer can arrive out of order when they
+// happened on different CPUs. A free that finds nothing leaves a short-lived
+// "freed early" slot so the late allocation cancels against it; timestamps
+// decide which of two events is the newer one.
+//
+// --kmemtrace=DIR replays a recorded tracefs tree: DIR/events/header_page,
+// the four events/kmem/*/format files and per_cpu/cpuN/trace_pipe_raw as
+// plain files of raw pages (and optionally DIR/kallsyms). Nothing is
+// enabled then and no root is needed.
+
+#define KMT_TRACEFS "/sys/kernel/tracing"
+#define KMT_TRACEFS_OLD "/sys/kernel/debug/tracing"
+#define KMT_KALLSYMS "/proc/kallsyms"
+#define KMT_MAX_CPUS 256
+#define KMT_SHARDS 64                       // power of two
+#define KMT_DEFAULT_SLOTS (1u << 18)        // 8 MB of table
+#define KMT_EARLY_FREE_NS 5000000000ULL     // how long a free waits for its allocation
+#define KMT_MAX_SITES 4096
+#define KMT_SITE_HASH 8192                  // power of two, > KMT_MAX_SITES
+#define KMT_SHOW 8
+#define KMT_RISING_CYCLES 3
+#define KMT_POLL_MS 200
+#define KMT_TRACEFS_MAGIC 0x74726163
+#define KMT_DEBUGFS_MAGIC 0x64626720
+
+// include/linux/ring_buffer.h
+#define KMT_TYPE_PADDING 29
+#define KMT_TYPE_TIME_EXTEND 30
+#define KMT_TYPE_TIME_STAMP 31
+#define KMT_MISSED_EVENTS (1ULL << 31)
+#define KMT_MISSED_STORED (1ULL << 30)
+
+enum { KMT_KMALLOC, KMT_KFREE, KMT_CACHE_ALLOC, KMT_CACHE_FREE, KMT_NEVENTS };
+enum { KMT_EMPTY, KMT_LIVE, KMT_FREED_EARLY };
+enum { KMT_AGE_1S, KMT_AGE_10S, KMT_AGE_1M, KMT_AGE_10M, KMT_AGE_OLDER, KMT_AGES };
+
+typedef struct
+{
+    uint64_t ptr;
+    uint64_t call_site;
+    uint64_t ts;          // trace clock, ns
+    uint32_t bytes;
+    uint32_t state;
+} kmt_slot;
+
+typedef struct
+{
+    kmt_slot *slots;
+    uint32_t mask;
+    uint32_t used;
+    char lock;
+    char pad[64 - sizeof(kmt_slot *) - 2 * sizeof(uint32_t) - 1];
+} kmt_shard;
+
+// where the fields sit in each event, from its format file
+typedef struct
+{
+    int id;
+    int call_site_off, call_site_size;
+    int ptr_off, ptr_size;
+    int bytes_off, bytes_size;  // allocations only
+} kmt_event_fmt;
+
+typedef struct
+{
+    int cpu;
+    int fd;
+    unsigned char *page;
+    pthread_t tid;
+    int spawned, running;
+    // counters, read by the cycle without locking
+    uint64_t allocs, frees, pages, missed_pages, reused, table_full;
+    uint64_t last_ts;
+    char pad[64];
+} kmt_reader;
+
+typedef struct
+{
+    uint64_t site;
+    uint64_t bytes, objs;
+    uint64_t age_bytes[KMT_AGES];
+    uint64_t prev_bytes;
+    int rising;            // consecutive cycles of growth
+    int resolved;
+    char sym[72];
+} kmt_site;
+
+static int kmt_enabled = 0;               // --kmemtrace
+static const char *kmt_dir = NULL;        // NULL = live tracefs
+static uint32_t kmt_slots_total = KMT_DEFAULT_SLOTS;
+static int kmt_replay = 0;
+static int kmt_started = 0;
+static size_t kmt_page_size = 4096;
+static int kmt_data_off = 16, kmt_commit_size = 8;
+static kmt_event_fmt kmt_fmt[KMT_NEVENTS];
+static int kmt_was_enabled[KMT_NEVENTS];
+static kmt_shard kmt_shards[KMT_SHARDS];
+static kmt_reader kmt_readers[KMT_MAX_CPUS];
+static int kmt_nreaders = 0;
+static volatile int kmt_stop = 0;
+
+static kmt_site kmt_sites[KMT_MAX_SITES];
+static int kmt_site_index[KMT_SITE_HASH];   // site number + 1, 0 = empty
+static int kmt_nsites = 0;
+static uint64_t kmt_other_bytes = 0;      // sites beyond KMT_MAX_SITES
+static uint64_t kmt_live_objs = 0, kmt_live_bytes = 0, kmt_pending_frees = 0;
+static uint64_t kmt_prev_events = 0;
+static struct timespec kmt_prev_time;
+static double kmt_rate = 0.0, kmt_alloc_rate = 0.0;
+
+static const char *kmt_event_names[KMT_NEVENTS] = {"kmalloc", "kfree", "kmem_cache_alloc",
+                                                   "kmem_cache_free"};
+static const char *kmt_age_names[KMT_AGES] = {"<1s", "<10s", "<1m", "<10m", ">=10m"};
+
+static void kmt_lock(kmt_shard *s)
+{
+    while (__atomic_test_and_set(&s->lock, __ATOMIC_ACQUIRE))
+        while (__atomic_load_n(&s->lock, __ATOMIC_RELAXED))
+            ;
+}
+
+static void kmt_unlock(kmt_shard *s)
+{
+    __atomic_clear(&s->lock, __ATOMIC_RELEASE);
+}
+
+// Fibonacci hashing; objects are at least 8-byte aligned
+static uint64_t kmt_hash(uint64_t ptr)
+{
+    return (ptr >> 3) * 0x9E3779B97F4A7C15ULL;
+}
+
+// the top bits pick the shard, the ones below them the home slot
+static kmt_shard *kmt_shard_of(uint64_t h)
+{
+    return &kmt_shards[h >> 58 & (KMT_SHARDS - 1)];
+}
+
+static uint32_t kmt_home(uint64_t h, uint32_t mask)
+{
+    return (uint32_t)(h >> 26) & mask;
+}
+
+// Linear probe: the slot holding ptr, or the empty slot ending its run.
+static uint32_t kmt_find(const kmt_shard *s, uint64_t ptr, uint64_t h)
+{
+    uint32_t i = kmt_home(h, s->mask);
+    while (s->slots[i].state != KMT_EMPTY && s->slots[i].ptr != ptr)
+        i = (i + 1) & s->mask;
+    return i;
+}
+
+// Backward-shift deletion keeps probe runs unbroken without tombstones.
+static void kmt_erase(kmt_shard *s, uint32_t i)
+{
+    uint32_t j = i;
+    for (;;) {
+        j = (j + 1) & s->mask;
+        if (s->slots[j].state == KMT_EMPTY)
+            break;
+        uint32_t home = kmt_home(kmt_hash(s->slots[j].ptr), s->mask);
+        if (((j - home) & s->mask) >= ((j - i) & s->mask)) {
+            s->slots[i] = s->slots[j];
+            i = j;
+        }
+    }
+    s->slots[i].state = KMT_EMPTY;
+    s->used--;
+}
+
+// room for one more entry, keeping the load under 7/8
+static int kmt_has_room(const kmt_shard *s)
+{
+    return s->used < s->mask - (s->mask >> 3);
+}
+
+static void kmt_on_alloc(kmt_reader *r, uint64_t ptr, uint64_t site, uint64_t bytes, uint64_t ts)
+{
+    uint64_t h = kmt_hash(ptr);
+    kmt_shard *s = kmt_shard_of(h);
+    kmt_lock(s);
+    uint32_t i = kmt_find(s, ptr, h);
+    kmt_slot *slot = &s->slots[i];
+    if (slot->state == KMT_FREED_EARLY && slot->ts >= ts) {
+        kmt_erase(s, i);               // its free was seen first
+    } else if (slot->state == KMT_LIVE && slot->ts > ts) {
+        // a newer allocation of the address is already live: this one is gone
+    } else if (slot->state != KMT_EMPTY || kmt_has_room(s)) {
+        if (slot->state == KMT_LIVE)
+            r->reused++;               // its free was lost
+        if (slot->state == KMT_EMPTY)
+            s->used++;
+        slot->ptr = ptr;
+        slot->call_site = site;
+        slot->ts = ts;
+        slot->bytes = bytes > UINT32_MAX ? UINT32_MAX : (uint32_t)bytes;
+        slot->state = KMT_LIVE;
+    } else {
+        r->table_full++;
+    }
+    kmt_unlock(s);
+}
+
+static void kmt_on_free(uint64_t ptr, uint64_t ts)
+{
+    uint64_t h = kmt_hash(ptr);
+    kmt_shard *s = kmt_shard_of(h);
+    kmt_lock(s);
+    uint32_t i = kmt_find(s, ptr, h);
+    kmt_slot *slot = &s->slots[i];
+    if (slot->state == KMT_LIVE) {
+        if (slot->ts <= ts)
+            kmt_erase(s, i);
+    } else if (slot->state == KMT_FREED_EARLY) {
+        if (ts > slot->ts)
+            slot->ts = ts;
+    } else if (kmt_has_room(s)) {
+        // allocated on another CPU whose buffer we have not read yet,
+        // or before tracing started
+        slot->ptr = ptr;
+        slot->ts = ts;
+        slot->bytes = 0;
+        slot->state = KMT_FREED_EARLY;
+        s->used++;
+    }
+    kmt_unlock(s);
+}
+
+static uint64_t kmt_field(const unsigned char *data, uint32_t len, int off, int size)
+{
+    if (off < 0 || (uint32_t)(off + size) > len)
+        return 0;
+    if (size == 4) {
+        uint32_t v;
+        memcpy(&v, data + off, 4);
+        return v;
+    }
+    uint64_t v;
+    memcpy(&v, data + off, 8);
+    return v;
+}
+
+static void kmt_event(kmt_reader *r, const unsigned char *data, uint32_t len, uint64_t ts)
+{
+    if (len < 8)
+        return;
+    uint16_t type;
+    memcpy(&type, data, 2);
+    for (int e = 0; e < KMT_NEVENTS; e++) {
+        const kmt_event_fmt *f = &kmt_fmt[e];
+        if (f->id != type)
+            continue;
+        uint64_t ptr = kmt_field(data, len, f->ptr_off, f->ptr_size);
+        if (ptr <= 16)                 // NULL and ZERO_SIZE_PTR
+            return;
+        if (e == KMT_KMALLOC || e == KMT_CACHE_ALLOC) {
+            r->allocs++;
+            kmt_on_alloc(r, ptr, kmt_field(data, len, f->call_site_off, f->call_site_size),
+                         kmt_field(data, len, f->bytes_off, f->bytes_size), ts);
+        } else {
+            r->frees++;
+            kmt_on_free(ptr, ts);
+        }
+        return;
+    }
+}
+
+// One ring-buffer page: header (timestamp, commit), then compressed events.
+static void kmt_page(kmt_reader *r, const unsigned char *page, size_t len)
+{
+    if (len < (size_t)kmt_data_off)
+        return;
+    uint64_t ts, commit = 0;
+    memcpy(&ts, page, 8);
+    memcpy(&commit, page + 8, kmt_commit_size);
+    if (commit & KMT_MISSED_EVENTS)
+        r->missed_pages++;
+    size_t size = commit & (KMT_MISSED_STORED - 1);
+    const unsigned char *p = page + kmt_data_off;
+    const unsigned char *end = p + (size < len - kmt_data_off ? size : len - kmt_data_off);
+    r->pages++;
+
+    while (p + 4 <= end) {
+        uint32_t hdr, arr = 0;
+        memcpy(&hdr, p, 4);
+        uint32_t type_len = hdr & 0x1f, delta = hdr >> 5;
+        if (p + 8 <= end)
+            memcpy(&arr, p + 4, 4);
+
+        if (type_len == KMT_TYPE_PADDING) {
+            if (delta == 0)
+                break;                 // rest of the page is unused
+            ts += delta;
+            p += 4 + arr;
+        } else if (type_len == KMT_TYPE_TIME_EXTEND) {
+            ts += ((uint64_t)arr << 27) + delta;
+            p += 8;
+        } else if (type_len == KMT_TYPE_TIME_STAMP) {
+            ts = ((uint64_t)arr << 27) | delta;
+            p += 8;
+        } else if (type_len == 0) {    // length in array[0]
+            ts += delta;
+            if (arr < 4 || p + 4 + arr > end)
+                break;
+            kmt_event(r, p + 8, arr - 4, ts);
+            p += 4 + arr;
+        } else {
+            ts += delta;
+            uint32_t n = type_len * 4;
+            if (p + 4 + n > end)
+                break;
+            kmt_event(r, p + 4, n, ts);
+            p += 4 + n;
+        }
+    }
+    if (ts > r->last_ts)
+        __atomic_store_n(&r->last_ts, ts, __ATOMIC_RELAXED);
+}
+
+static void *kmt_reader_run(void *arg)
+{
+    kmt_reader *r = arg;
+    while (!kmt_stop) {
+        ssize_t n = read(r->fd, r->page, kmt_page_size);
+        if (n > 0) {
+            kmt_page(r, r->page, (size_t)n);
+        } else if (n == 0 && kmt_replay) {
+            break;                     // recording played to the end
+        } else if (n == 0 || errno == EAGAIN || errno == EINTR) {
+            struct pollfd pfd = {r->fd, POLLIN, 0};
+            poll(&pfd, 1, KMT_POLL_MS);
+        } else {
+            perror("kmemtrace: trace_pipe_raw");
+            break;
+        }
+    }
+    __atomic_store_n(&r->running, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// "field:unsigned long call_site;\toffset:8;\tsize:8;" -> offset and size
+static int kmt_read_format(const char *dir, const char *event, kmt_event_fmt *f)
+{
+    char path[512], line[LINE_BUFFER];
+    snprintf(path, sizeof(path), "%s/events/kmem/%s/format", dir, event);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    f->id = -1;
+    f->call_site_off = f->ptr_off = f->bytes_off = -1;
+    while (fgets(line, sizeof(line), fp)) {
+        int off, size;
+        char *semi, *name;
+        if (sscanf(line, "ID: %d", &f->id) == 1)
+            continue;
+        char *at = strstr(line, "offset:");
+        if (!at || (semi = strchr(line, ';')) == NULL || semi > at ||
+            sscanf(at, "offset:%d;%*[ \t]size:%d;", &off, &size) != 2)
+            continue;
+        *semi = '\0';
+        name = strrchr(line, ' ');
+        name = name ? name + 1 : line;
+        if (strcmp(name, "call_site") == 0) {
+            f->call_site_off = off;
+            f->call_site_size = size;
+        } else if (strcmp(name, "ptr") == 0) {
+            f->ptr_off = off;
+            f->ptr_size = size;
+        } else if (strcmp(name, "bytes_alloc") == 0) {
+            f->bytes_off = off;
+            f->bytes_size = size;
+        }
+    }
+    fclose(fp);
+    return f->id >= 0 && f->ptr_off >= 0 ? 0 : -1;
+}
+
+// page layout from events/header_page; the sub-buffer size when configurable
+static void kmt_read_header_page(const char *dir)
+{
+    char path[512], line[LINE_BUFFER];
+    snprintf(path, sizeof(path), "%s/events/header_page", dir);
+    FILE *fp = fopen(path, "r");
+    if (fp) {
+        while (fgets(line, sizeof(line), fp)) {
+            int off, size;
+            char *at = strstr(line, "offset:");
+            if (!at || sscanf(at, "offset:%d;%*[ \t]size:%d;", &off, &size) != 2)
+                continue;
+            if (strstr(line, " commit;")) {
+                kmt_commit_size = size == 4 ? 4 : 8;
+            } else if (strstr(line, " data;")) {
+                kmt_data_off = off;
+                kmt_page_size = (size_t)off + size;
+            }
+        }
+        fclose(fp);
+    }
+    snprintf(path, sizeof(path), "%s/buffer_subbuf_size_kb", dir);
+    if ((fp = fopen(path, "r")) != NULL) {
+        unsigned kb;
+        if (fscanf(fp, "%u", &kb) == 1 && kb * 1024 > kmt_page_size)
+            kmt_page_size = (size_t)kb * 1024;
+        fclose(fp);
+    }
+}
+
+static int kmt_write_enable(const char *dir, int e, const char *val, int *prev)
+{
+    char path[512], cur = '0';
+    snprintf(path, sizeof(path), "%s/events/kmem/%s/enable", dir, kmt_event_names[e]);
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (prev && pread(fd, &cur, 1, 0) == 1)
+        *prev = cur == '1';
+    int ok = pwrite(fd, val, 1, 0) == 1;
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+static uint32_t kmt_shard_slots(void)
+{
+    uint32_t per = 1024;
+    while ((uint64_t)per * KMT_SHARDS < kmt_slots_total && per < (1u << 26))
+        per <<= 1;
+    return per;
+}
+
+static const char *kmt_root(void);
+
+size_t kmt_footprint(void)
+{
+    const char *dir = kmt_root();
+    kmt_read_header_page(dir);
+    // a page buffer per per_cpu/cpuN, which a recording may have more of
+    char path[512];
+    snprintf(path, sizeof(path), "%s/per_cpu", dir);
+    long cpus = 0;
+    DIR *d = opendir(path);
+    for (struct dirent *de; d && (de = readdir(d)) != NULL; )
+        cpus += strncmp(de->d_name, "cpu", 3) == 0;
+    if (d)
+        closedir(d);
+    if (cpus < 1 || cpus > KMT_MAX_CPUS)
+        cpus = KMT_MAX_CPUS;
+    return (size_t)KMT_SHARDS * (kmt_shard_slots() * sizeof(kmt_slot) + ARENA_ALIGN)
+         + (size_t)cpus * (kmt_page_size + ARENA_ALIGN);
+}
+
+// The table and one page buffer per CPU, before the readers start.
+int kmt_reserve(void)
+{
+    uint32_t per = kmt_shard_slots();
+    for (int i = 0; i < KMT_SHARDS; i++) {
+        if (kmt_shards[i].slots)
+            continue;
+        kmt_shards[i].slots = kml_alloc(per * sizeof(kmt_slot), "kmemtrace table");
+        if (!kmt_shards[i].slots)
+            return -1;
+        memset(kmt_shards[i].slots, 0, per * sizeof(kmt_slot));
+        kmt_shards[i].mask = per - 1;
+    }
+    return 0;
+}
+
+static const char *kmt_root(void)
+{
+    if (kmt_dir)
+        return kmt_dir;
+    struct stat st;
+    return stat(KMT_TRACEFS "/events", &st) == 0 ? KMT_TRACEFS : KMT_TRACEFS_OLD;
+}
+
+// Opens every CPU's buffer, enables the events and starts one reader per CPU.
+int kmemtrace_start(void)
+{
+    const char *dir = kmt_root();
+    kmt_read_header_page(dir);
+    for (int e = 0; e < KMT_NEVENTS; e++) {
+        if (kmt_read_format(dir, kmt_event_names[e], &kmt_fmt[e]) != 0) {
+            fprintf(stderr, "kmemtrace: no usable %s/events/kmem/%s/format\n", dir, kmt_event_names[e]);
+            return -1;
+        }
+    }
+    if (kmt_reserve() != 0)
+        return -1;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/per_cpu", dir);
+    DIR *d = opendir(path);
+    if (!d) {
+        perror("kmemtrace: per_cpu");
+        return -1;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL && kmt_nreaders < KMT_MAX_CPUS) {
+        int cpu;
+        if (sscanf(de->d_name, "cpu%d", &cpu) != 1)
+            continue;
+        snprintf(path, sizeof(path), "%s/per_cpu/%s/trace_pipe_raw", dir, de->d_name);
+        int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        unsigned char *page = kml_alloc(kmt_page_size, "kmemtrace page buffers");
+        if (!page) {
+            close(fd);
+            break;
+        }
+        // tracefs files look regular too; the filesystem tells them apart
+        struct statfs fs;
+        if (fstatfs(fd, &fs) == 0 && fs.f_type != KMT_TRACEFS_MAGIC && fs.f_type != KMT_DEBUGFS_MAGIC)
+            kmt_replay = 1;
+        kmt_reader *r = &kmt_readers[kmt_nreaders++];
+        memset(r, 0, sizeof(*r));
+        r->cpu = cpu;
+        r->fd = fd;
+        r->page = page;
+    }
+    closedir(d);
+    if (kmt_nreaders == 0) {
+        fprintf(stderr, "kmemtrace: no readable per_cpu/cpu*/trace_pipe_raw under %s\n", dir);
+        return -1;
+    }
+
+    if (!kmt_replay) {
+        for (int e = 0; e < KMT_NEVENTS; e++) {
+            if (kmt_write_enable(dir, e, "1", &kmt_was_enabled[e]) != 0) {
+                perror("kmemtrace: enabling kmem events");
+                return -1;
+            }
+        }
+    }
+
+    // readers leave SIGINT/SIGTERM to the main loop
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    for (int i = 0; i < kmt_nreaders; i++) {
+        kmt_readers[i].running = 1;
+        int err = pthread_create(&kmt_readers[i].tid, NULL, kmt_reader_run, &kmt_readers[i]);
+        kmt_readers[i].spawned = err == 0;
+        if (err != 0) {
+            kmt_readers[i].running = 0;
+            errno = err;
+            perror("pthread_create kmemtrace");
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    kmt_started = 1;
+    clock_gettime(CLOCK_MONOTONIC, &kmt_prev_time);
+    printf("kmemtrace: %d CPU readers on %s%s, %u table slots\n", kmt_nreaders, dir,
+           kmt_replay ? " (replay)" : "", kmt_shard_slots() * KMT_SHARDS);
+    return 0;
+}
+
+void kmemtrace_stop(void)
+{
+    if (!kmt_started)
+        return;
+    kmt_stop = 1;
+    for (int i = 0; i < kmt_nreaders; i++) {
+        if (kmt_readers[i].spawned)
+            pthread_join(kmt_readers[i].tid, NULL);
+        close(kmt_readers[i].fd);
+    }
+    if (!kmt_replay) {
+        const char *dir = kmt_root();
+        for (int e = 0; e < KMT_NEVENTS; e++)
+            if (!kmt_was_enabled[e])
+                kmt_write_enable(dir, e, "0", NULL);
+    }
+    kmt_started = 0;
+}
+
+static kmt_site *kmt_site_of(uint64_t site)
+{
+    uint32_t i = (uint32_t)(kmt_hash(site) >> 40) & (KMT_SITE_HASH - 1);
+    while (kmt_site_index[i]) {
+        kmt_site *s = &kmt_sites[kmt_site_index[i] - 1];
+        if (s->site == site)
+            return s;
+        i = (i + 1) & (KMT_SITE_HASH - 1);
+    }
+    if (kmt_nsites == KMT_MAX_SITES)
+        return NULL;
+    kmt_site *s = &kmt_sites[kmt_nsites++];
+    memset(s, 0, sizeof(*s));
+    s->site = site;
+    kmt_site_index[i] = kmt_nsites;
+    return s;
+}
+
+static int kmt_age_bucket(uint64_t age_ns)
+{
+    if (age_ns < 1000000000ULL)
+        return KMT_AGE_1S;
+    if (age_ns < 10000000000ULL)
+        return KMT_AGE_10S;
+    if (age_ns < 60000000000ULL)
+        return KMT_AGE_1M;
+    if (age_ns < 600000000000ULL)
+        return KMT_AGE_10M;
+    return KMT_AGE_OLDER;
+}
+
+// Folds the live table into per-site totals; also expires frees whose
+// allocation never showed up. Call once per cycle.
+void update_kmemtrace(void)
+{
+    if (!kmt_enabled || !kmt_started)
+        return;
+
+    uint64_t now = 0, events = 0;
+    for (int i = 0; i < kmt_nreaders; i++) {
+        uint64_t t = __atomic_load_n(&kmt_readers[i].last_ts, __ATOMIC_RELAXED);
+        if (t > now)
+            now = t;
+        events += __atomic_load_n(&kmt_readers[i].allocs, __ATOMIC_RELAXED);
+    }
+    uint64_t allocs = events;
+    for (int i = 0; i < kmt_nreaders; i++)
+        events += __atomic_load_n(&kmt_readers[i].frees, __ATOMIC_RELAXED);
+
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double dt = (t1.tv_sec - kmt_prev_time.tv_sec) + (t1.tv_nsec - kmt_prev_time.tv_nsec) / 1e9;
+    if (dt > 0.0) {
+        kmt_rate = (events - kmt_prev_events) / dt;
+        kmt_alloc_rate = kmt_rate > 0.0 ? (double)allocs / events * kmt_rate : 0.0;
+    }
+    kmt_prev_events = events;
+    kmt_prev_time = t1;
+
+    for (int i = 0; i < kmt_nsites; i++) {
+        kmt_sites[i].prev_bytes = kmt_sites[i].bytes;
+        kmt_sites[i].bytes = kmt_sites[i].objs = 0;
+        memset(kmt_sites[i].age_bytes, 0, sizeof(kmt_sites[i].age_bytes));
+    }
+    kmt_other_bytes = kmt_live_objs = kmt_live_bytes = kmt_pending_frees = 0;
+
+    // sites stay in one slot for good, so the last one found is cached
+    kmt_site *last = NULL;
+    for (int sh = 0; sh < KMT_SHARDS; sh++) {
+        kmt_shard *s = &kmt_shards[sh];
+        kmt_lock(s);
+        for (uint32_t i = 0; i <= s->mask; ) {
+            kmt_slot *slot = &s->slots[i];
+            if (slot->state == KMT_FREED_EARLY) {
+                if (now > slot->ts + KMT_EARLY_FREE_NS) {
+                    kmt_erase(s, i);   // a later slot may have moved here
+                    continue;
+                }
+                kmt_pending_frees++;
+            } else if (slot->state == KMT_LIVE) {
+                kmt_live_objs++;
+                kmt_live_bytes += slot->bytes;
+                kmt_site *site = last && last->site == slot->call_site ? last
+                               : kmt_site_of(slot->call_site);
+                if (site) {
+                    site->bytes += slot->bytes;
+                    site->objs++;
+                    site->age_bytes[kmt_age_bucket(now > slot->ts ? now - slot->ts : 0)] += slot->bytes;
+                    last = site;
+                } else {
+                    kmt_other_bytes += slot->bytes;
+                }
+            }
+            i++;
+        }
+        kmt_unlock(s);
+    }
+
+    for (int i = 0; i < kmt_nsites; i++) {
+        kmt_site *s = &kmt_sites[i];
+        s->rising = s->bytes > s->prev_bytes ? s->rising + 1 : 0;
+    }
+}
+
+// Names the given sites from kallsyms in one pass: the closest symbol at
+// or below each address.
+static void kmt_resolve(kmt_site **sites, int n)
+{
+    char path[512], line[LINE_BUFFER];
+    if (kmt_replay)
+        snprintf(path, sizeof(path), "%s/kallsyms", kmt_dir);
+    FILE *fp = fopen(kmt_replay ? path : KMT_KALLSYMS, "r");
+    uint64_t best[KMT_SHOW] = {0};
+    while (fp && fgets(line, sizeof(line), fp)) {
+        char *end;
+        uint64_t addr = strtoull(line, &end, 16);
+        if (addr == 0)
+            break;                     // addresses hidden from us
+        for (int k = 0; k < n; k++) {
+            if (addr > sites[k]->site || addr <= best[k])
+                continue;
+            char type, name[64];
+            if (sscanf(end, " %c %63s", &type, name) != 2)
+                break;
+            best[k] = addr;
+            snprintf(sites[k]->sym, sizeof(sites[k]->sym), "%s+0x%llx", name,
+                     (unsigned long long)(sites[k]->site - addr));
+        }
+    }
+    if (fp)
+        fclose(fp);
+    for (int k = 0; k < n; k++) {
+        if (!best[k])
+            snprintf(sites[k]->sym, sizeof(sites[k]->sym), "0x%llx", (unsigned long long)sites[k]->site);
+        sites[k]->resolved = 1;
+    }
+}
+
+void show_kmemtrace(void)
+{
+    if (!kmt_enabled || !kmt_started)
+        return;
+
+    uint64_t missed = 0, reused = 0, full = 0;
+    int live_readers = 0;
+    for (int i = 0; i < kmt_nreaders; i++) {
+        const kmt_reader *r = &kmt_readers[i];
+        missed += r->missed_pages;
+        reused += r->reused;
+        full += r->table_full;
+        live_readers += __atomic_load_n(&r->running, __ATOMIC_ACQUIRE);
+    }
+    rprintf("[KMEMTRACE] %.0f events/s (%.0f allocs/s) live=%llu objs %.1f KB, frees awaiting "
+            "their alloc=%llu, readers=%d/%d",
+            kmt_rate, kmt_alloc_rate, (unsigned long long)kmt_live_objs, kmt_live_bytes / 1024.0,
+            (unsigned long long)kmt_pending_frees, live_readers, kmt_nreaders);
+    if (missed || reused || full)
+        rprintf(" \033[1;33mlost: %llu pages overrun, %llu frees missed, %llu table full\033[0m",
+                (unsigned long long)missed, (unsigned long long)reused, (unsigned long long)full);
+    rprintf("\n");
+
+    // largest outstanding call sites, named once
+    kmt_site *top[KMT_SHOW], *unresolved[KMT_SHOW];
+    int ntop = 0, nun = 0;
+    for (int k = 0; k < KMT_SHOW; k++) {
+        kmt_site *best = NULL;
+        for (int i = 0; i < kmt_nsites; i++) {
+            kmt_site *s = &kmt_sites[i];
+            int taken = 0;
+            for (int j = 0; j < ntop; j++)
+                taken |= top[j] == s;
+            if (!taken && s->bytes > 0 && (!best || s->bytes > best->bytes))
+                best = s;
+        }
+        if (!best)
+            break;
+        top[ntop++] = best;
+        if (!best->resolved)
+            unresolved[nun++] = best;
+    }
+    if (nun)
+        kmt_resolve(unresolved, nun);
+
+    for (int k = 0; k < ntop; k++) {
+        const kmt_site *s = top[k];
+        rprintf("[KMEMTRACE] %-40s %9.1f KB in %6llu objs %+8.1f KB ages",
+                s->sym, s->bytes / 1024.0, (unsigned long long)s->objs,
+                ((double)s->bytes - (double)s->prev_bytes) / 1024.0);
+        for (int a = 0; a < KMT_AGES; a++)
+            rprintf(" %s=%.0f%%", kmt_age_names[a], 100.0 * s->age_bytes[a] / s->bytes);
+        uint64_t old = s->age_bytes[KMT_AGE_10M] + s->age_bytes[KMT_AGE_OLDER];
+        if (s->rising >= KMT_RISING_CYCLES && old * 2 > s->bytes)
+            rprintf(" \033[1;31m-> growing %d cycles, mostly long-lived (leak candidate)\033[0m", s->rising);
+        else if (s->rising >= KMT_RISING_CYCLES)
+            rprintf(" \033[1;33m-> growing %d cycles\033[0m", s->rising);
+        rprintf("\n");
+    }
+    if (kmt_other_bytes)
+        rprintf("[KMEMTRACE] %.1f KB at call sites beyond the first %d\n", kmt_other_bytes / 1024.0,
+                KMT_MAX_SITES);
+}
+
+#endif // KMEMTRACE_H
@@ -0,0 +1,302 @@
+#ifndef KPAGEFLAGS_H
+#define KPAGEFLAGS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "report.h"
+
+// /proc/kpageflags holds one 64-bit flag word per PFN (root only).
+// slabinfo counts objects; this counts the physical pages slab really pins.
+#define FILE_KPAGEFLAGS "/proc/kpageflags"
+#define FILE_ZONEINFO "/proc/zoneinfo"
+
+// bit numbers from include/uapi/linux/kernel-page-flags.h
+#define KPF_SLAB          7
+#define KPF_COMPOUND_HEAD 15
+#define KPF_COMPOUND_TAIL 16
+#define KPF_HUGE          17
+#define KPF_NOPAGE        20
+
+// 64Ki words = 512 KiB per pread, large enough to amortize the syscall
+#define KPAGE_CHUNK_WORDS (1u << 16)
+#define KPAGE_MAX_THREADS 64
+
+typedef struct
+{
+    uint64_t pages;     // PFNs actually returned by the kernel
+    uint64_t slab;      // pages with KPF_SLAB
+    uint64_t slab_head; // slab pages that are compound heads
+    uint64_t slab_tail; // slab pages that are compound tails
+    uint64_t huge;      // hugetlb pages
+    uint64_t nopage;    // holes in the memory map
+} kpage_counts;
+
+typedef struct
+{
+    int fd;
+    uint64_t *buf;      // KPAGE_CHUNK_WORDS, kept across scans
+    uint64_t start_pfn;
+    uint64_t end_pfn;
+    kpage_counts counts;
+} kpage_worker;
+
+typedef struct
+{
+    kpage_counts total;
+    uint64_t slabinfo_pages; // pages implied by /proc/slabinfo
+    double scan_ms;
+} kpage_report;
+
+//opt-in from the command line
+static int kpage_enabled = 0;
+static int kpage_threads = 4;
+static const char *kpage_path = NULL;       // NULL = FILE_KPAGEFLAGS under --root
+static uint64_t *kpage_bufs[KPAGE_MAX_THREADS];
+static uint64_t kpage_zoneinfo_max_pfn = 0; // memory map is fixed, read once
+static int kpage_fd = -1;                   // opened by the first scan, kept
+static kpage_report kpage_last;
+static int kpage_have = 0;
+
+// Count the flag bits of one chunk. Written as shift-and-mask sums with no
+// branches so the compiler turns it into SIMD adds over the 64-bit words.
+static void kpage_count_chunk(const uint64_t *w, size_t n, kpage_counts *c)
+{
+    uint64_t slab = 0, head = 0, tail = 0, huge = 0, nopage = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        uint64_t s = (w[i] >> KPF_SLAB) & 1;
+        slab   += s;
+        head   += s & (w[i] >> KPF_COMPOUND_HEAD);
+        tail   += s & (w[i] >> KPF_COMPOUND_TAIL);
+        huge   += (w[i] >> KPF_HUGE) & 1;
+        nopage += (w[i] >> KPF_NOPAGE) & 1;
+    }
+
+    c->pages += n;
+    c->slab += slab;
+    c->slab_head += head;
+    c->slab_tail += tail;
+    c->huge += huge;
+    c->nopage += nopage;
+}
+
+static void *kpage_worker_run(void *arg)
+{
+    kpage_worker *wk = arg;
+    uint64_t *buf = wk->buf;
+
+    uint64_t pfn = wk->start_pfn;
+    while (pfn < wk->end_pfn) {
+        uint64_t want = wk->end_pfn - pfn;
+        if (want > KPAGE_CHUNK_WORDS)
+            want = KPAGE_CHUNK_WORDS;
+
+        ssize_t got = pread(wk->fd, buf, want * sizeof(uint64_t),
+                            (off_t)(pfn * sizeof(uint64_t)));
+        if (got <= 0)
+            break;
+
+        size_t words = (size_t)got / sizeof(uint64_t);
+        kpage_count_chunk(buf, words, &wk->counts);
+        pfn += words;
+    }
+    return NULL;
+}
+
+// Highest PFN + 1. procfs reports size 0 for kpageflags, so take the end
+// of the last zone span from zoneinfo; a regular (fixture) file has a size.
+static uint64_t kpage_max_pfn(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        return (uint64_t)st.st_size / sizeof(uint64_t);
+
+    if (kpage_zoneinfo_max_pfn)
+        return kpage_zoneinfo_max_pfn;
+
+    char path[PROCFILE_PATH_MAX];
+    FILE *fp = fopen(procfile_path(path, sizeof(path), FILE_ZONEINFO), "r");
+    if (!fp)
+        return 0;
+
+    char line[LINE_BUFFER];
+    uint64_t spanned = 0, max_pfn = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned long long v;
+        if (sscanf(line, " spanned %llu", &v) == 1) {
+            spanned = v;
+        } else if (sscanf(line, " start_pfn: %llu", &v) == 1) {
+            if (v + spanned > max_pfn)
+                max_pfn = v + spanned;
+        }
+    }
+    fclose(fp);
+    kpage_zoneinfo_max_pfn = max_pfn;
+    return max_pfn;
+}
+
+static int kpage_clamp_threads(void)
+{
+    if (kpage_threads < 1)
+        return 1;
+    if (kpage_threads > KPAGE_MAX_THREADS)
+        return KPAGE_MAX_THREADS;
+    return kpage_threads;
+}
+
+// One chunk buffer per thread, allocated once and reused by every scan.
+int kpage_reserve(void)
+{
+    int nthreads = kpage_clamp_threads();
+    for (int i = 0; i < nthreads; i++) {
+        if (!kpage_bufs[i])
+            kpage_bufs[i] = kml_alloc(KPAGE_CHUNK_WORDS * sizeof(uint64_t), "kpageflags buffers");
+        if (!kpage_bufs[i])
+            return -1;
+    }
+    return 0;
+}
+
+// pages slab should be using according to /proc/slabinfo: the slabdata
+// num_slabs column, or whole slabs of objects when a source leaves it 0
+uint64_t kpage_slabinfo_pages(void)
+{
+    uint64_t pages = 0;
+    list *cur = get_slab_list_head();
+    while (cur) {
+        slabinfo *s = cur->slab;
+        uint64_t slabs = s->num_slabs;
+        if (slabs == 0 && s->objperslab > 0)
+            slabs = (s->num_objs + s->objperslab - 1) / s->objperslab;
+        pages += slabs * s->pagesperslab;
+        cur = cur->next;
+    }
+    return pages;
+}
+
+// Opens kpageflags on first use. A failure switches the collector off for
+// good instead of retrying (and reporting) every cycle.
+static int kpage_open(void)
+{
+    if (kpage_fd >= 0)
+        return 0;
+
+    char path[PROCFILE_PATH_MAX];
+    const char *p = kpage_path ? kpage_path : procfile_path(path, sizeof(path), FILE_KPAGEFLAGS);
+    kpage_fd = open(p, O_RDONLY | O_CLOEXEC);
+    if (kpage_fd < 0) {
+        perror("cannot open kpageflags");
+        return -1;
+    }
+    return 0;
+}
+
+// Scan the whole PFN range, split into one contiguous slice per thread.
+int kpage_scan(kpage_report *rep)
+{
+    memset(rep, 0, sizeof(*rep));
+    if (kpage_open() != 0)
+        return -1;
+    int fd = kpage_fd;
+
+    uint64_t max_pfn = kpage_max_pfn(fd);
+    if (max_pfn == 0) {
+        fprintf(stderr, "kpageflags: cannot determine max pfn\n");
+        return -1;
+    }
+
+    int nthreads = kpage_clamp_threads();
+    if (kpage_reserve() != 0)
+        return -1;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    kpage_worker workers[KPAGE_MAX_THREADS];
+    pthread_t tids[KPAGE_MAX_THREADS];
+    uint64_t slice = (max_pfn + nthreads - 1) / nthreads;
+    // keep slices chunk aligned so no pread straddles two workers
+    slice = (slice + KPAGE_CHUNK_WORDS - 1) / KPAGE_CHUNK_WORDS * KPAGE_CHUNK_WORDS;
+
+    int used = 0;
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].fd = fd;
+        workers[i].buf = kpage_bufs[i];
+        workers[i].start_pfn = (uint64_t)i * slice;
+        workers[i].end_pfn = workers[i].start_pfn + slice;
+        if (workers[i].end_pfn > max_pfn)
+            workers[i].end_pfn = max_pfn;
+        memset(&workers[i].counts, 0, sizeof(kpage_counts));
+        if (workers[i].start_pfn >= max_pfn)
+            break;
+        used++;
+    }
+
+    // slice 0 (and any slice whose thread failed to spawn) runs here
+    int spawned[KPAGE_MAX_THREADS] = {0};
+    for (int i = 1; i < used; i++)
+        spawned[i] = pthread_create(&tids[i], NULL, kpage_worker_run, &workers[i]) == 0;
+    for (int i = 0; i < used; i++) {
+        if (!spawned[i])
+            kpage_worker_run(&workers[i]);
+    }
+
+    for (int i = 0; i < used; i++) {
+        if (spawned[i])
+            pthread_join(tids[i], NULL);
+        rep->total.pages += workers[i].counts.pages;
+        rep->total.slab += workers[i].counts.slab;
+        rep->total.slab_head += workers[i].counts.slab_head;
+        rep->total.slab_tail += workers[i].counts.slab_tail;
+        rep->total.huge += workers[i].counts.huge;
+        rep->total.nopage += workers[i].counts.nopage;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    rep->scan_ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    rep->slabinfo_pages = kpage_slabinfo_pages();
+    return 0;
+}
+
+// Physical page cross-check for this cycle (opt-in)
+void update_kpageflags(void)
+{
+    kpage_have = 0;
+    if (!kpage_enabled)
+        return;
+    if (kpage_scan(&kpage_last) != 0) {
+        fprintf(stderr, "kpageflags: collector off\n");
+        kpage_enabled = 0;
+        return;
+    }
+    kpage_have = 1;
+}
+
+void show_kpage_summary(void)
+{
+    if (!kpage_have)
+        return;
+    const kpage_report *rep = &kpage_last;
+    unsigned long long page_kb = vm_page_kb;
+    int64_t gap = (int64_t)rep->total.slab - (int64_t)rep->slabinfo_pages;
+
+    rprintf("[KPAGEFLAGS] pfns=%llu slab_pages=%llu (%llu KB) heads=%llu tails=%llu huge=%llu scan=%.1fms\n",
+            (unsigned long long)rep->total.pages,
+            (unsigned long long)rep->total.slab,
+            (unsigned long long)rep->total.slab * page_kb,
+            (unsigned long long)rep->total.slab_head,
+            (unsigned long long)rep->total.slab_tail,
+            (unsigned long long)rep->total.huge,
+            rep->scan_ms);
+    rprintf("[KPAGEFLAGS] slabinfo accounts for %llu pages, unaccounted %lld pages\n",
+            (unsigned long long)rep->slabinfo_pages, (long long)gap);
+}
+
+#endif // KPAGEFLAGS_H
@@ -0,0 +1,292 @@
+#ifndef LEAKSCORE_H
+#define LEAKSCORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include "report.h"
+
+// Composite leak score per cache. Every cycle the slab list is gathered
+// into flat columns (one slot per slabinfo.idx) and a single loop updates
+// the trend regression and the score of every cache at once.
+
+#define FILE_PSI_MEMORY "/proc/pressure/memory"
+#define SCORE_DEFAULT_CONFIG "leakscore.conf"
+// a line through two points always has r^2 = 1; trust the fit after this
+#define SCORE_MIN_SAMPLES 3
+
+typedef struct
+{
+    // per-cache signals
+    double w_slope;       // bytes/hour growth, normalised by slope_ref
+    double w_confidence;  // r^2 of the trend fit
+    double w_share;       // share of SUnreclaim held by the cache
+    // system signals, scale every cache
+    double w_pressure;    // reclaim struggling (1 - pgsteal/pgscan)
+    double w_psi;         // memory PSI some avg10
+    double w_frag;        // unusable free space at order 3
+    double w_watermark;   // free pages from the high watermark down to min
+    double slope_ref;     // bytes/hour that counts as full slope signal
+    double halflife_sec;  // decay of the trend regression
+    double alert_score;   // score that raises a correlation alert
+} score_config;
+
+// the weights live in the detector config (config.h) and are reloaded with it
+static const score_config score_defaults = {
+    .w_slope = 0.45,
+    .w_confidence = 0.35,
+    .w_share = 0.20,
+    .w_pressure = 0.30,
+    .w_psi = 0.40,
+    .w_frag = 0.20,
+    .w_watermark = 0.30,
+    .slope_ref = 10.0 * 1024 * 1024,
+    .halflife_sec = 600.0,
+    .alert_score = 60.0,
+};
+
+// SoA columns indexed by slabinfo.idx
+static double sc_bytes[MAX_SLABS];
+static double sc_base[MAX_SLABS];     // first bytes seen, keeps the sums centred
+static double sc_s0[MAX_SLABS], sc_st[MAX_SLABS], sc_sy[MAX_SLABS];
+static double sc_stt[MAX_SLABS], sc_sty[MAX_SLABS], sc_syy[MAX_SLABS];
+static double sc_slope[MAX_SLABS];    // bytes per hour
+static double sc_r2[MAX_SLABS];
+static double sc_share[MAX_SLABS];
+static double sc_score[MAX_SLABS];
+static unsigned char sc_seen[MAX_SLABS];
+static unsigned char sc_fresh[MAX_SLABS]; // re-read this cycle, not stale
+
+// system-wide inputs of the last cycle
+typedef struct
+{
+    double pressure;
+    double psi;
+    double frag;
+    double watermark;
+    double system_factor;
+} score_system;
+
+static score_system score_sys;
+static procfile psi_file = PROCFILE_INIT(FILE_PSI_MEMORY);
+static int psi_missing = 0; // kernel without PSI, stop retrying
+static struct timespec score_t0;
+static int score_started = 0;
+static volatile sig_atomic_t score_breakdown_requested = 0;
+
+static void score_sigusr1(int signum)
+{
+    (void)signum;
+    score_breakdown_requested = 1;
+}
+
+// "key = value" lines, '#' starts a comment, over whatever *cfg holds.
+// Unknown keys are reported.
+int load_score_config(const char *path, score_config *cfg)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+
+    char line[LINE_BUFFER];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+
+        char key[64];
+        double val;
+        if (sscanf(line, " %63[^= \t] = %lf", key, &val) != 2)
+            continue;
+
+        if (strcmp(key, "weight.slope") == 0) cfg->w_slope = val;
+        else if (strcmp(key, "weight.confidence") == 0) cfg->w_confidence = val;
+        else if (strcmp(key, "weight.share") == 0) cfg->w_share = val;
+        else if (strcmp(key, "weight.pressure") == 0) cfg->w_pressure = val;
+        else if (strcmp(key, "weight.psi") == 0) cfg->w_psi = val;
+        else if (strcmp(key, "weight.frag") == 0) cfg->w_frag = val;
+        else if (strcmp(key, "weight.watermark") == 0) cfg->w_watermark = val;
+        else if (strcmp(key, "slope_ref_bytes_per_hour") == 0) cfg->slope_ref = val;
+        else if (strcmp(key, "halflife_sec") == 0) cfg->halflife_sec = val;
+        else if (strcmp(key, "alert_score") == 0) cfg->alert_score = val;
+        else
+            fprintf(stderr, "%s:%d: unknown key '%s'\n", path, lineno, key);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+void init_leak_score(void)
+{
+    score_t0 = slab_sample_ts;
+    score_started = 1;
+    signal(SIGUSR1, score_sigusr1);
+}
+
+// "some avg10=1.23 avg60=..." -> 0.0123
+static double read_psi_some_avg10(void)
+{
+    if (psi_missing || procfile_read(&psi_file) < 0) {
+        psi_missing = 1;
+        return 0.0;
+    }
+    double avg10 = 0.0;
+    if (sscanf(psi_file.buf, "some avg10=%lf", &avg10) != 1)
+        avg10 = 0.0;
+    return avg10 / 100.0;
+}
+
+static double clamp01(double v)
+{
+    return v < 0.0 ? 0.0 : (v > 1.0 ? 1.0 : v);
+}
+
+static void score_update_system(const score_config *cfg)
+{
+    const vmrate_derived *d = get_vmrate_derived();
+    score_system *s = &score_sys;
+
+    s->pressure = d->pgscan_per_sec > 0.0 ? clamp01(1.0 - d->reclaim_efficiency) : 0.0;
+    s->psi = clamp01(read_psi_some_avg10());
+    s->frag = buddy_nzones > 0 ? clamp01(buddy_unusable_index(BUDDY_COSTLY_ORDER)) : 0.0;
+    // 0 at or above the high watermark, 1 at min where allocations stall
+    double free_pages = (double)get_vmstat("nr_free_pages");
+    s->watermark = wmark_total_high > wmark_total_min
+                       ? clamp01(((double)wmark_total_high - free_pages) /
+                                 (double)(wmark_total_high - wmark_total_min))
+                       : 0.0;
+
+    // 1.0 on a calm system, up to 2.0 when every system signal is maxed;
+    // the cache signals alone reach 100 only for a steep, clean trend
+    double wsum = cfg->w_pressure + cfg->w_psi + cfg->w_frag + cfg->w_watermark;
+    double sys = cfg->w_pressure * s->pressure + cfg->w_psi * s->psi +
+                 cfg->w_frag * s->frag + cfg->w_watermark * s->watermark;
+    s->system_factor = 1.0 + (wsum > 0.0 ? sys / wsum : 0.0);
+}
+
+// Run once per cycle after parse_slabinfo() and parse_buddyinfo().
+void update_leak_scores(const score_config *cfg)
+{
+    if (!score_started)
+        init_leak_score();
+
+    // the regression runs on sample time, not on when the analysis got to it
+    double t = (slab_sample_ts.tv_sec - score_t0.tv_sec) +
+               (slab_sample_ts.tv_nsec - score_t0.tv_nsec) / 1e9;
+
+    static double last_t = 0.0;
+    double decay = (cfg->halflife_sec > 0.0)
+                       ? exp2(-(t - last_t) / cfg->halflife_sec) : 1.0;
+    last_t = t;
+
+    // gather the list into the byte column
+    int n = 0;
+    list *cur = get_slab_list_head();
+    while (cur) {
+        slabinfo *s = cur->slab;
+        if (s->idx >= 0) {
+            sc_bytes[s->idx] = (double)slab_trend_objs(s) * (double)s->objsize;
+            sc_fresh[s->idx] = !s->stale;
+            if (!sc_seen[s->idx]) {
+                sc_base[s->idx] = sc_bytes[s->idx];
+                sc_seen[s->idx] = 1;
+            }
+            if (s->idx >= n)
+                n = s->idx + 1;
+        }
+        cur = cur->next;
+    }
+
+    score_update_system(cfg);
+
+    double sunreclaim = (double)get_vmstat("nr_slab_unreclaimable") * vm_page_kb * 1024.0;
+    double inv_unrecl = sunreclaim > 0.0 ? 1.0 / sunreclaim : 0.0;
+    double cw = cfg->w_slope + cfg->w_confidence + cfg->w_share;
+    double inv_cw = cw > 0.0 ? 1.0 / cw : 0.0;
+    double inv_ref = cfg->slope_ref > 0.0 ? 1.0 / cfg->slope_ref : 0.0;
+    double scale = 100.0 * inv_cw * score_sys.system_factor;
+
+    // one pass over all caches; a stale cache only decays, its held
+    // value is not a sample
+    for (int i = 0; i < n; i++) {
+        double w = sc_fresh[i] ? 1.0 : 0.0;
+        double y = sc_bytes[i] - sc_base[i];
+        sc_fresh[i] = 0;
+        sc_s0[i] = decay * sc_s0[i] + w;
+        sc_st[i] = decay * sc_st[i] + w * t;
+        sc_sy[i] = decay * sc_sy[i] + w * y;
+        sc_stt[i] = decay * sc_stt[i] + w * t * t;
+        sc_sty[i] = decay * sc_sty[i] + w * t * y;
+        sc_syy[i] = decay * sc_syy[i] + w * y * y;
+
+        double cov = sc_s0[i] * sc_sty[i] - sc_st[i] * sc_sy[i];
+        double vt = sc_s0[i] * sc_stt[i] - sc_st[i] * sc_st[i];
+        double vy = sc_s0[i] * sc_syy[i] - sc_sy[i] * sc_sy[i];
+        double slope = vt > 0.0 ? cov / vt : 0.0;           // bytes per second
+        double r2 = (vt > 0.0 && vy > 0.0 && sc_s0[i] >= SCORE_MIN_SAMPLES - 0.5)
+                        ? (cov * cov) / (vt * vy) : 0.0;
+
+        sc_slope[i] = slope * 3600.0;
+        sc_r2[i] = r2 > 1.0 ? 1.0 : r2;
+        sc_share[i] = clamp01(sc_bytes[i] * inv_unrecl);
+
+        double grow = sc_slope[i] > 0.0 ? 1.0 : 0.0;
+        double cache = cfg->w_slope * clamp01(sc_slope[i] * inv_ref) +
+                       cfg->w_confidence * sc_r2[i] * grow +
+                       cfg->w_share * sc_share[i];
+        double score = scale * cache * grow;
+        sc_score[i] = score > 100.0 ? 100.0 : score;
+    }
+}
+
+double get_leak_score(const slabinfo *s)
+{
+    return s->idx >= 0 ? sc_score[s->idx] : 0.0;
+}
+
+// Per-signal contribution (before the 100 cap) for every cache above `min_score`.
+void show_score_breakdown(const score_config *cfg, double min_score)
+{
+    double cw = cfg->w_slope + cfg->w_confidence + cfg->w_share;
+    double scale = cw > 0.0 ? 100.0 * score_sys.system_factor / cw : 0.0;
+    double inv_ref = cfg->slope_ref > 0.0 ? 1.0 / cfg->slope_ref : 0.0;
+
+    rprintf("\n--- Leak Score Breakdown (pressure=%.2f psi=%.2f frag=%.2f watermark=%.2f x%.2f) ---\n",
+            score_sys.pressure, score_sys.psi, score_sys.frag, score_sys.watermark,
+            score_sys.system_factor);
+    rprintf("%-24s %7s %9s %9s %9s %12s %6s\n",
+            "cache", "score", "slope", "conf", "share", "bytes/h", "r2");
+
+    list *cur = get_slab_list_head();
+    while (cur) {
+        int i = cur->slab->idx;
+        if (i >= 0 && sc_score[i] >= min_score) {
+            double grow = sc_slope[i] > 0.0 ? 1.0 : 0.0;
+            rprintf("%-24s %7.1f %9.1f %9.1f %9.1f %12.0f %6.3f\n",
+                    cur->slab->name, sc_score[i],
+                    scale * cfg->w_slope * clamp01(sc_slope[i] * inv_ref) * grow,
+                    scale * cfg->w_confidence * sc_r2[i] * grow,
+                    scale * cfg->w_share * sc_share[i] * grow,
+                    sc_slope[i], sc_r2[i]);
+        }
+        cur = cur->next;
+    }
+    rprintf("\n");
+}
+
+// SIGUSR1 asks for a breakdown; printed at the end of the next cycle
+void show_score_breakdown_if_requested(const score_config *cfg)
+{
+    if (!score_breakdown_requested)
+        return;
+    score_breakdown_requested = 0;
+    show_score_breakdown(cfg, 0.1);
+}
+
+#endif // LEAKSCORE_H
@@ -1,43 +1,428 @@
 #include "vmstatlist.h"
 #include "slabinfolist.h"
+#include "slabsource.h"
+#include "slubcpu.h"
+#include "sockstat.h"
+#include "fsobjs.h"
+#include "vmrate.h"
+#include "numa.h"
+#include "buddyinfo.h"
+#include "leakscore.h"
+#include "compaction.h"
+#include "rules.h"
+#include "config.h"
 #include "analysis.h"
+#include "kpageflags.h"
+#include "kmemtrace.h"
+#include "procconn.h"
+#include "procattr.h"
+#include "selfprof.h"
+#include "governor.h"
+#include "pipeline.h"
 #include "stdint.h"
+#include <signal.h>
 
-#define INTERVAL 5
-#define TOP_N 10
+static volatile sig_atomic_t running = 1;
 
+static void stop_handler(int signum)
+{
+    (void)signum;
+    running = 0;
+}
+
+// Size every table from one probe of /proc plus headroom and carve them all
+// out of a single region; steady state then never touches the heap.
+static int setup_fixed_footprint(int headroom_pct, int lock)
+{
+    procfile probe_slab = PROCFILE_INIT(FILE_SLABINFO);
+    procfile probe_vm = PROCFILE_INIT("/proc/vmstat");
+    if (procfile_read(&probe_slab) < 0 || procfile_read(&probe_vm) < 0) {
+        perror("fixed-footprint probe");
+        return -1;
+    }
+
+    size_t caches = 0, counters = 0;
+    for (char *p = probe_slab.buf; p; p = procfile_next_line(p))
+        caches++;
+    for (char *p = probe_vm.buf; p; p = procfile_next_line(p))
+        counters++;
+
+    double grow = 1.0 + headroom_pct / 100.0;
+    size_t cache_cap = (size_t)(caches * grow) + 16;
+    size_t counter_cap = (size_t)(counters * grow) + 16;
+    size_t slab_buf = (size_t)(probe_slab.len * grow) + PROCFILE_INITIAL_CAP;
+    size_t vm_buf = (size_t)(probe_vm.len * grow) + PROCFILE_INITIAL_CAP;
+
+    size_t size = cache_cap * (sizeof(list) + sizeof(slabinfo) + 2 * ARENA_ALIGN)
+                + counter_cap * (sizeof(struct vmstat) + ARENA_ALIGN)
+                + slab_buf + vm_buf + 6 * PROCFILE_INITIAL_CAP
+                + zoneinfo_footprint(grow);
+    if (kpage_enabled)
+        size += (size_t)kpage_clamp_threads() * (KPAGE_CHUNK_WORDS * sizeof(uint64_t) + ARENA_ALIGN);
+    if (pipe_enabled)
+        size += pipe_footprint((int)cache_cap, (int)counter_cap);
+    if (numa_enabled)
+        size += numa_footprint(grow);
+    if (kmt_enabled)
+        size += kmt_footprint();
+    if (attr_enabled)
+        size += attr_footprint();
+    if (pc_policy != PC_OFF)
+        size += pc_footprint();
+    if (sock_enabled)
+        size += sock_footprint();
+
+    procfile_close(&probe_slab);
+    procfile_close(&probe_vm);
+
+    if (arena_init(size, lock) != 0)
+        return -1;
+    fixed_footprint = 1;
 
-int main()
+    procfile_reserve(&slabinfo_file, slab_buf);
+    procfile_reserve(&vmstat_file, vm_buf);
+    procfile_reserve(&buddyinfo_file, PROCFILE_INITIAL_CAP);
+    procfile_reserve(&psi_file, PROCFILE_INITIAL_CAP);
+    procfile_reserve(&dentry_state_file, PROCFILE_INITIAL_CAP);
+    procfile_reserve(&inode_nr_file, PROCFILE_INITIAL_CAP);
+    procfile_reserve(&file_nr_file, PROCFILE_INITIAL_CAP);
+    procfile_reserve(&zoneinfo_file, zoneinfo_cap);
+    if (numa_enabled)
+        numa_reserve();
+    if (kpage_enabled && kpage_reserve() != 0)
+        return -1;
+    if (kmt_enabled && kmt_reserve() != 0)
+        return -1;
+    if (attr_enabled && attr_reserve() != 0)
+        return -1;
+    if (pc_policy != PC_OFF && pc_reserve() != 0)
+        return -1;
+    if (sock_enabled && sock_reserve() != 0)
+        return -1;
+    if (pipe_enabled && pipe_init((int)cache_cap, (int)counter_cap) != 0)
+        return -1;
+
+    printf("Fixed footprint: %zu caches, %zu vmstat counters (+%d%% headroom), %zu KB region%s\n",
+           caches, counters, headroom_pct, size / 1024, lock ? ", locked" : "");
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [--config PATH] [--score-config PATH] [--kpageflags[=PATH]] [--kpage-threads N] [--self-stats]\n"
+                    "          [--interval SEC] [--cpu-budget PCT] [--idle]\n"
+                    "          [--fixed-footprint [--headroom PCT] [--mlock]] [--pipeline]\n"
+                    "          [--slab-source auto|full|hybrid] [--slab-cost-ms MS] [--discovery N]\n"
+                    "          [--slub-cpu[=CACHE,...]] [--netns[=DIR]] [--numa]\n"
+                    "          [--kmemtrace[=DIR] [--kmemtrace-slots N]] [--attr-threads N]\n"
+                    "          [--proc-events netlink|scan|off] [--rules PATH]\n"
+                    "          [--root DIR] [--cycles N]\n", prog);
+    fprintf(stderr, "  --config          interval, thresholds and the files below (default ./"
+                    CONFIG_DEFAULT_PATH "),\n");
+    fprintf(stderr, "                    all reloaded on SIGHUP or when one of them is rewritten\n");
+    fprintf(stderr, "  --score-config    leak score weights (default ./" SCORE_DEFAULT_CONFIG ")\n");
+    fprintf(stderr, "  --kpageflags      count physical slab pages from /proc/kpageflags (root)\n");
+    fprintf(stderr, "                    PATH may point at a recorded kpageflags fixture\n");
+    fprintf(stderr, "  --kpage-threads   threads used to scan the PFN range (default 4)\n");
+    fprintf(stderr, "  --self-stats      print the detector's own per-phase cost every cycle\n");
+    fprintf(stderr, "  --interval SEC    sampling interval, overrides the config (default 5)\n");
+    fprintf(stderr, "  --cpu-budget PCT  percent of one core the detector may use, e.g. 0.2\n");
+    fprintf(stderr, "  --idle            run under SCHED_IDLE and the idle I/O class\n");
+    fprintf(stderr, "  --fixed-footprint size all tables at startup, never allocate afterwards\n");
+    fprintf(stderr, "  --headroom PCT    spare table room in fixed-footprint mode (default 50)\n");
+    fprintf(stderr, "  --mlock           lock the detector in memory (fixed-footprint mode)\n");
+    fprintf(stderr, "  --pipeline        collect, analyze and print on separate threads\n");
+    fprintf(stderr, "  --slab-source     auto (default) turns hybrid when a full read costs more\n");
+    fprintf(stderr, "                    than --slab-cost-ms (default %.0f): /proc/slabinfo every\n", SLAB_COST_MS);
+    fprintf(stderr, "                    --discovery cycles (default %d), sysfs for hot caches between\n",
+            SLAB_DISCOVERY_CYCLES);
+    fprintf(stderr, "  --slub-cpu        watch SLUB per-CPU and partial slabs of the largest caches\n");
+    fprintf(stderr, "                    (or the listed ones) and keep them out of the trends\n");
+    fprintf(stderr, "  --netns           add socket counts of the network namespaces bound in DIR\n");
+    fprintf(stderr, "                    (default " SOCK_NETNS_DIR ", needs CAP_SYS_ADMIN)\n");
+    fprintf(stderr, "  --numa            per-node vmstat, meminfo and watermarks even on one node\n");
+    fprintf(stderr, "                    (on by itself with more than one node)\n");
+    fprintf(stderr, "  --kmemtrace       outstanding kmalloc/kmem_cache bytes per call site from the\n");
+    fprintf(stderr, "                    kmem trace events, one reader thread per CPU (root);\n");
+    fprintf(stderr, "                    DIR may point at a recorded tracefs tree to replay\n");
+    fprintf(stderr, "  --kmemtrace-slots live allocations the table can hold (default %u)\n", KMT_DEFAULT_SLOTS);
+    fprintf(stderr, "  --attr-threads    threads scanning /proc/<pid> when VMA, task, mm or page\n");
+    fprintf(stderr, "                    table caches alert (default 4, 0 turns the pass off)\n");
+    fprintf(stderr, "  --proc-events     process table from the proc connector (default netlink,\n");
+    fprintf(stderr, "                    needs CAP_NET_ADMIN) or from /proc every %d cycles (scan)\n",
+            PC_RESCAN_CYCLES);
+    fprintf(stderr, "  --rules           alert rules, \"name: expression\" per line\n");
+    fprintf(stderr, "                    (default ./" RULES_DEFAULT_CONFIG ")\n");
+    fprintf(stderr, "  --root DIR        read /proc and /sys under DIR, e.g. a recorded tree\n");
+    fprintf(stderr, "  --cycles N        stop after N cycles (default: until SIGINT)\n");
+}
+
+// Shared by the sequential loop and the pipeline's analyzer thread.
+// The config pinned here stays until render_cycle() has printed the cycle.
+static void analyze_cycle(void)
 {
+    config_enter();
+    const detector_config *c = cfg();
+    prof_begin(PHASE_ANALYZE);
+    vmrate_update();
+    update_watermarks();
+    update_numa();
+    update_slub_cpu();
+    update_sockstat();
+    update_fs_objects();
+    update_kmemtrace();
+    update_kpageflags();
+
+    // Trend updates
+    update_ema_for_slabs();
+    compute_growth_for_slabs();
+    update_monotonic_for_slabs();
+    update_slab_churn();
+    update_leak_scores(&c->score);
+    update_compaction_health();
+
+    // Correlate VMStat & slab growth
+    correlate_vmstat_slab();
+    evaluate_rules(&c->rules);
+
+    // which processes hold the objects of alerting per-process caches
+    update_proc_events();
+    update_proc_attr();
+    prof_end(PHASE_ANALYZE);
+}
+
+static void render_cycle(void)
+{
+    // Display alerts & rankings
+    const detector_config *c = cfg();
+    prof_begin(PHASE_RENDER);
+    show_topN_slabs(c->top_n);
+    show_vmstat_summary();
+    show_numa();
+    show_slab_churn();
+    show_slab_source();
+    show_slub_cpu();
+    show_sockstat();
+    show_fs_objects();
+    show_kmemtrace();
+    show_proc_events();
+    show_proc_attr();
+    show_vmrate_summary();
+    show_compaction_health();
+    show_kpage_summary();
+    show_score_breakdown_if_requested(&c->score);
+    prof_end(PHASE_RENDER);
+
+    show_self_stats_live();
+    config_leave();
+}
+
+int main(int argc, char *argv[])
+{
+    config_overrides opts = {CONFIG_DEFAULT_PATH, 0.0, NULL, NULL};
+    double cpu_budget = 0.0;
+    int idle = 0;
+    int fixed = 0, headroom = 50, lock = 0;
+    int numa_forced = 0;
+    long cycles = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            opts.path = argv[++i];
+        } else if (strcmp(argv[i], "--score-config") == 0 && i + 1 < argc) {
+            opts.score_path = argv[++i];
+        } else if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) {
+            opts.rules_path = argv[++i];
+        } else if (strcmp(argv[i], "--kpageflags") == 0) {
+            kpage_enabled = 1;
+        } else if (strncmp(argv[i], "--kpageflags=", 13) == 0) {
+            kpage_enabled = 1;
+            kpage_path = argv[i] + 13;
+        } else if (strcmp(argv[i], "--kpage-threads") == 0 && i + 1 < argc) {
+            kpage_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--self-stats") == 0) {
+            prof_live = 1;
+        } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            opts.interval = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--cpu-budget") == 0 && i + 1 < argc) {
+            cpu_budget = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--idle") == 0) {
+            idle = 1;
+        } else if (strcmp(argv[i], "--fixed-footprint") == 0) {
+            fixed = 1;
+        } else if (strcmp(argv[i], "--headroom") == 0 && i + 1 < argc) {
+            headroom = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mlock") == 0) {
+            lock = 1;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            pipe_enabled = 1;
+        } else if (strcmp(argv[i], "--slab-source") == 0 && i + 1 < argc) {
+            i++;
+            slabsrc_mode = strcmp(argv[i], "full") == 0 ? SLABSRC_FULL
+                         : strcmp(argv[i], "hybrid") == 0 ? SLABSRC_HYBRID : SLABSRC_AUTO;
+        } else if (strcmp(argv[i], "--slab-cost-ms") == 0 && i + 1 < argc) {
+            slabsrc_cost_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--slub-cpu") == 0) {
+            slub_enabled = 1;
+        } else if (strncmp(argv[i], "--slub-cpu=", 11) == 0) {
+            slub_enabled = 1;
+            slub_names = argv[i] + 11;
+        } else if (strcmp(argv[i], "--numa") == 0) {
+            numa_forced = 1;
+        } else if (strcmp(argv[i], "--netns") == 0) {
+            sock_netns = 1;
+        } else if (strncmp(argv[i], "--netns=", 8) == 0) {
+            sock_netns = 1;
+            sock_netns_dir = argv[i] + 8;
+        } else if (strcmp(argv[i], "--kmemtrace") == 0) {
+            kmt_enabled = 1;
+        } else if (strncmp(argv[i], "--kmemtrace=", 12) == 0) {
+            kmt_enabled = 1;
+            kmt_dir = argv[i] + 12;
+        } else if (strcmp(argv[i], "--kmemtrace-slots") == 0 && i + 1 < argc) {
+            kmt_slots_total = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--attr-threads") == 0 && i + 1 < argc) {
+            attr_threads = atoi(argv[++i]);
+            attr_enabled = attr_threads > 0;
+        } else if (strcmp(argv[i], "--proc-events") == 0 && i + 1 < argc) {
+            i++;
+            pc_policy = strcmp(argv[i], "off") == 0 ? PC_OFF
+                      : strcmp(argv[i], "scan") == 0 ? PC_SCAN : PC_NETLINK;
+        } else if (strcmp(argv[i], "--discovery") == 0 && i + 1 < argc) {
+            slabsrc_discovery = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--root") == 0 && i + 1 < argc) {
+            procfile_root = argv[++i];
+        } else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            cycles = atol(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opts.interval < 0.0)
+        opts.interval = 0.0;
+    if (slabsrc_discovery < 1)
+        slabsrc_discovery = SLAB_DISCOVERY_CYCLES;
+
     printf("Starting Kernel Memory Leak Detector...\n");
 
+    numa_probe();
+    if (numa_forced && numa_nnodes > 0)
+        numa_enabled = 1;
+
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+    if (config_start(&opts) != 0)
+        fprintf(stderr, "config: reloading off\n");
+    init_self_profiling();
+    if (idle)
+        governor_go_idle();
+
+    if (fixed && setup_fixed_footprint(headroom, lock) != 0)
+        return 1;
+
     init_vmstat_list();
     init_slab_list();
 
     // Initial snapshots for both proc dirs
     parse_vmstat();
+    vmrate_update();
     parse_slabinfo();
+    parse_buddyinfo();
 
     init_trend_tracking();
+    init_leak_score();
+    if (proc_events_start() != 0)
+        fprintf(stderr, "proc events: collector off\n");
+    if (kmt_enabled && kmemtrace_start() != 0) {
+        fprintf(stderr, "kmemtrace: collector off\n");
+        kmt_enabled = 0;
+    }
+
+    // optional collectors, the governor drops the last registered first
+    governor_register_optional("compaction", &compact_enabled);
+    governor_register_optional("slub-cpu", &slub_enabled);
+    governor_register_optional("sockstat", &sock_enabled);
+    governor_register_optional("fs-objects", &fs_enabled);
+    governor_register_optional("numa", &numa_enabled);
+    governor_register_optional("proc-attr", &attr_enabled);
+    governor_register_optional("proc-events", &pc_enabled);
+    governor_register_optional("kpageflags", &kpage_enabled);
+    config_enter();
+    unsigned config_gen = cfg()->generation;
+    init_governor(cfg()->interval, cpu_budget);
+    config_leave();
 
-    while (1)
+    fflush(stdout);
+    if (pipe_enabled && (pipe_init(MAX_SLABS, MAX_VMSTAT) != 0 ||
+                         pipe_start(analyze_cycle, render_cycle) != 0))
+        return 1;
+
+    while (running)
     {
-        sleep(INTERVAL);
+        governor_sleep();
+        if (!running)
+            break;
+
+        if (pipe_enabled) {
+            if (pipe_collect() != 0)
+                continue;
+        } else {
+            prof_begin(PHASE_READ);
+            read_vmstat();
+            int slab_ok = slabsrc_read() == 0;
+            parse_buddyinfo();
+            prof_end(PHASE_READ);
 
-        parse_vmstat();
-        parse_slabinfo();
+            prof_begin(PHASE_PARSE);
+            parse_vmstat_buffer();
+            if (slab_ok) {
+                slabsrc_parse();
+                slabsrc_apply();
+            } else {
+                slabsrc_apply_failed();
+            }
+            prof_end(PHASE_PARSE);
 
-        // Trend updates
-        update_ema_for_slabs();
-        compute_growth_for_slabs();
-        update_monotonic_for_slabs();
+            analyze_cycle();
+            render_cycle();
+            prof_begin(PHASE_EXPORT);
+            fflush(stdout);
+            prof_end(PHASE_EXPORT);
+        }
+        governor_account_cycle();
 
-        // Correlate VMStat & slab growth
-        correlate_vmstat_slab();
+        // a reload that changed the interval takes effect from the next sleep
+        config_enter();
+        if (cfg()->generation != config_gen) {
+            config_gen = cfg()->generation;
+            if (cfg()->interval != gov_base_interval)
+                governor_set_interval(cfg()->interval);
+        }
+        config_leave();
+
+        // first cycle warms up stdio and lazily created state
+        if (fixed) {
+            static int warmed = 0;
+            if (warmed++)
+                fixed_footprint_check();
+            else
+                fixed_footprint_mark();
+        }
+        if (cycles > 0 && --cycles == 0)
+            running = 0;
+    }
 
-        // Display alerts & rankings
-        show_topN_slabs(TOP_N);
-        show_vmstat_summary();
+    if (pipe_enabled) {
+        pipe_stop();
+        show_pipeline_summary();
     }
+    kmemtrace_stop();
+    proc_events_stop();
+    attr_stop();
+    config_stop();
+    show_self_report();
+    if (fixed)
+        show_fixed_footprint();
     return 0;
 }
@@ -0,0 +1,345 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include "procfile.h"
+#include "report.h"
+
+// Per-node vmstat and meminfo from /sys/devices/system/node/node<N>. The
+// global /proc/vmstat hides one node running out while the others are
+// fine. Every counter goes into a node x counter matrix; vmstat keys use
+// the dense slot the global vmstat already gave them, meminfo keys (kB)
+// and node-only counters get slots past MAX_VMSTAT. Each file keeps a
+// line -> slot plan, so steady state resolves no names. Watermarks come
+// from /proc/zoneinfo, summed per node, at a lower cadence. Their totals
+// over every zone feed the leak score, so zoneinfo is read even when the
+// per-node collector is off.
+
+#define NODE_SYSFS_DIR "/sys/devices/system/node"
+#define NUMA_MAX_NODES 16
+#define NUMA_EXTRA_KEYS 128
+#define NUMA_COLS (MAX_VMSTAT + NUMA_EXTRA_KEYS)
+#define NUMA_LINES 256
+#define NUMA_WMARK_EVERY 12
+#define NUMA_HISTORY 60
+#define FILE_ZONEINFO "/proc/zoneinfo"
+
+typedef struct
+{
+    int nid;
+    char vm_path[64], mi_path[64];
+    procfile vm, mi;
+    size_t vm_cap, mi_cap;             // fixed-footprint reservations
+    short vm_plan[NUMA_LINES];         // line -> column, -1 = not resolved
+    short mi_plan[NUMA_LINES];
+    unsigned long long wmark_min, wmark_low, wmark_high; // pages, all zones
+} numa_node;
+
+static int numa_enabled = 0;           // auto with more than one node, or --numa
+static int numa_nnodes = 0;
+static numa_node numa_nodes[NUMA_MAX_NODES];
+static unsigned long long numa_values[NUMA_MAX_NODES][NUMA_COLS];
+static const char *numa_col_name[NUMA_COLS];
+static char numa_extra_keys[NUMA_EXTRA_KEYS][48];
+static int numa_nextra = 0;
+static procfile zoneinfo_file = PROCFILE_INIT(FILE_ZONEINFO);
+static size_t zoneinfo_cap = 0;
+static unsigned long long wmark_total_min, wmark_total_high; // pages, every zone
+static int wmark_cycle = 0;
+static int numa_col_free = -1, numa_col_unreclaim = -1;
+
+static double numa_hist_t[NUMA_HISTORY];
+static double numa_hist_free[NUMA_HISTORY][NUMA_MAX_NODES];
+static double numa_hist_unreclaim[NUMA_HISTORY][NUMA_MAX_NODES];
+static int numa_head = 0, numa_len = 0;
+
+// Finds the nodes; turns the collector on by itself when there is more
+// than one. Call before the fixed-footprint setup.
+void numa_probe(void)
+{
+    char path[PROCFILE_PATH_MAX];
+    DIR *d = opendir(procfile_path(path, sizeof(path), NODE_SYSFS_DIR));
+    if (!d) {
+        numa_enabled = 0;
+        return;
+    }
+    struct dirent *e;
+    int nid;
+    while ((e = readdir(d)) != NULL && numa_nnodes < NUMA_MAX_NODES) {
+        if (sscanf(e->d_name, "node%d", &nid) != 1)
+            continue;
+        numa_node *n = &numa_nodes[numa_nnodes++];
+        n->nid = nid;
+        snprintf(n->vm_path, sizeof(n->vm_path), NODE_SYSFS_DIR "/node%d/vmstat", nid);
+        snprintf(n->mi_path, sizeof(n->mi_path), NODE_SYSFS_DIR "/node%d/meminfo", nid);
+        n->vm = (procfile)PROCFILE_INIT(n->vm_path);
+        n->mi = (procfile)PROCFILE_INIT(n->mi_path);
+        memset(n->vm_plan, -1, sizeof(n->vm_plan));
+        memset(n->mi_plan, -1, sizeof(n->mi_plan));
+    }
+    closedir(d);
+    // readdir order is not numeric
+    for (int i = 1; i < numa_nnodes; i++)
+        for (int j = i; j > 0 && numa_nodes[j].nid < numa_nodes[j - 1].nid; j--) {
+            numa_node t = numa_nodes[j];
+            numa_nodes[j] = numa_nodes[j - 1];
+            numa_nodes[j - 1] = t;
+        }
+    for (int i = 0; i < numa_nnodes; i++) {
+        numa_nodes[i].vm.path = numa_nodes[i].vm_path;
+        numa_nodes[i].mi.path = numa_nodes[i].mi_path;
+    }
+    if (numa_nnodes > 1)
+        numa_enabled = 1;
+}
+
+static size_t numa_probe_len(const char *path, double grow)
+{
+    procfile pf = PROCFILE_INIT(path);
+    size_t len = procfile_read(&pf) > 0 ? pf.len : 0;
+    procfile_close(&pf);
+    return (size_t)(len * grow) + PROCFILE_INITIAL_CAP;
+}
+
+// Buffer room for zoneinfo, probed now.
+size_t zoneinfo_footprint(double grow)
+{
+    zoneinfo_cap = numa_probe_len(FILE_ZONEINFO, grow);
+    return zoneinfo_cap + ARENA_ALIGN;
+}
+
+// Buffer room for every node file, probed now.
+size_t numa_footprint(double grow)
+{
+    size_t size = 0;
+    for (int i = 0; i < numa_nnodes; i++) {
+        numa_node *n = &numa_nodes[i];
+        n->vm_cap = numa_probe_len(n->vm_path, grow);
+        n->mi_cap = numa_probe_len(n->mi_path, grow);
+        size += n->vm_cap + n->mi_cap + 2 * ARENA_ALIGN;
+    }
+    return size + ARENA_ALIGN;
+}
+
+void numa_reserve(void)
+{
+    for (int i = 0; i < numa_nnodes; i++) {
+        procfile_reserve(&numa_nodes[i].vm, numa_nodes[i].vm_cap);
+        procfile_reserve(&numa_nodes[i].mi, numa_nodes[i].mi_cap);
+    }
+}
+
+// Interns a key: the global vmstat slot if there is one, else a slot of
+// our own past MAX_VMSTAT. -1 when every slot is taken.
+static int numa_column(const char *key, size_t len)
+{
+    char name[48];
+    if (len >= sizeof(name))
+        return -1;
+    memcpy(name, key, len);
+    name[len] = '\0';
+
+    struct vmstat *v = list_find_vmstat(name);
+    if (v && v->idx >= 0) {
+        numa_col_name[v->idx] = v->name;
+        return v->idx;
+    }
+    for (int i = 0; i < numa_nextra; i++)
+        if (strcmp(numa_extra_keys[i], name) == 0)
+            return MAX_VMSTAT + i;
+    if (numa_nextra == NUMA_EXTRA_KEYS)
+        return -1;
+    strcpy(numa_extra_keys[numa_nextra], name);
+    numa_col_name[MAX_VMSTAT + numa_nextra] = numa_extra_keys[numa_nextra];
+    return MAX_VMSTAT + numa_nextra++;
+}
+
+// The planned slot for line `i` if it still holds `key`, else a fresh lookup.
+static int numa_plan_column(short *plan, int i, const char *key, size_t len)
+{
+    if (i >= NUMA_LINES)
+        return numa_column(key, len);
+    int c = plan[i];
+    if (c < 0 || strncmp(numa_col_name[c], key, len) != 0 || numa_col_name[c][len] != '\0')
+        plan[i] = (short)(c = numa_column(key, len));
+    return c;
+}
+
+static void numa_parse_vmstat(numa_node *n, unsigned long long *row)
+{
+    int i = 0;
+    for (char *line = n->vm.len ? n->vm.buf : NULL; line; line = procfile_next_line(line), i++) {
+        const char *sp = strchr(line, ' ');
+        if (!sp)
+            continue;
+        int c = numa_plan_column(n->vm_plan, i, line, (size_t)(sp - line));
+        if (c >= 0)
+            row[c] = strtoull(sp + 1, NULL, 10);
+    }
+}
+
+// "Node 0 MemFree:         3736644 kB"
+static void numa_parse_meminfo(numa_node *n, unsigned long long *row)
+{
+    int i = 0;
+    for (char *line = n->mi.len ? n->mi.buf : NULL; line; line = procfile_next_line(line), i++) {
+        char *key = line, *colon;
+        for (int words = 0; words < 2 && key; words++) {  // skip "Node <n>"
+            key = strchr(key, ' ');
+            if (key)
+                key++;
+        }
+        if (!key || !(colon = strchr(key, ':')))
+            continue;
+        int c = numa_plan_column(n->mi_plan, i, key, (size_t)(colon - key));
+        if (c >= 0)
+            row[c] = strtoull(colon + 1, NULL, 10);
+    }
+}
+
+// min/low/high of every zone, summed per node and over all nodes
+static void numa_parse_watermarks(void)
+{
+    if (procfile_read(&zoneinfo_file) < 0)
+        return;
+    for (int i = 0; i < numa_nnodes; i++)
+        numa_nodes[i].wmark_min = numa_nodes[i].wmark_low = numa_nodes[i].wmark_high = 0;
+    wmark_total_min = wmark_total_high = 0;
+
+    numa_node *cur = NULL;
+    for (char *line = zoneinfo_file.buf; line; line = procfile_next_line(line)) {
+        int nid;
+        if (sscanf(line, "Node %d,", &nid) == 1) {
+            cur = NULL;
+            for (int i = 0; i < numa_nnodes; i++)
+                if (numa_nodes[i].nid == nid)
+                    cur = &numa_nodes[i];
+            continue;
+        }
+        char *p = line;
+        while (*p == ' ')
+            p++;
+        // "high:" in the pagesets has a colon and is not a watermark
+        if (strncmp(p, "min ", 4) == 0) {
+            unsigned long long v = strtoull(p + 4, NULL, 10);
+            wmark_total_min += v;
+            if (cur)
+                cur->wmark_min += v;
+        } else if (strncmp(p, "low ", 4) == 0) {
+            if (cur)
+                cur->wmark_low += strtoull(p + 4, NULL, 10);
+        } else if (strncmp(p, "high ", 5) == 0) {
+            unsigned long long v = strtoull(p + 5, NULL, 10);
+            wmark_total_high += v;
+            if (cur)
+                cur->wmark_high += v;
+        }
+    }
+}
+
+// Every cycle, before update_numa() and the leak score.
+void update_watermarks(void)
+{
+    if (wmark_cycle++ % NUMA_WMARK_EVERY == 0)
+        numa_parse_watermarks();
+}
+
+// Call after the global vmstat is parsed, so its slots exist.
+void update_numa(void)
+{
+    if (!numa_enabled)
+        return;
+
+    for (int i = 0; i < numa_nnodes; i++) {
+        numa_node *n = &numa_nodes[i];
+        if (procfile_read(&n->vm) < 0)
+            n->vm.len = 0;
+        if (procfile_read(&n->mi) < 0)
+            n->mi.len = 0;
+        numa_parse_vmstat(n, numa_values[i]);
+        numa_parse_meminfo(n, numa_values[i]);
+    }
+    if (numa_col_free < 0) {
+        numa_col_free = numa_column("nr_free_pages", 13);
+        numa_col_unreclaim = numa_column("nr_slab_unreclaimable", 21);
+    }
+
+    int k = numa_head;
+    numa_hist_t[k] = vm_sample_ts.tv_sec + vm_sample_ts.tv_nsec / 1e9;
+    for (int i = 0; i < numa_nnodes; i++) {
+        numa_hist_free[k][i] = numa_col_free >= 0 ? (double)numa_values[i][numa_col_free] : 0.0;
+        numa_hist_unreclaim[k][i] = numa_col_unreclaim >= 0 ? (double)numa_values[i][numa_col_unreclaim] : 0.0;
+    }
+    numa_head = (numa_head + 1) % NUMA_HISTORY;
+    if (numa_len < NUMA_HISTORY)
+        numa_len++;
+}
+
+// Least-squares slope of one node's series, pages per second.
+static double numa_slope(double (*hist)[NUMA_MAX_NODES], int node)
+{
+    int n = numa_len;
+    int first = (numa_head - n + NUMA_HISTORY) % NUMA_HISTORY;
+    double t0 = numa_hist_t[first];
+    double st = 0.0, sy = 0.0, stt = 0.0, sty = 0.0;
+    for (int i = 0; i < n; i++) {
+        int k = (first + i) % NUMA_HISTORY;
+        double t = numa_hist_t[k] - t0;
+        st += t;
+        sy += hist[k][node];
+        stt += t * t;
+        sty += t * hist[k][node];
+    }
+    double den = n * stt - st * st;
+    return den > 0.0 ? (n * sty - st * sy) / den : 0.0;
+}
+
+void show_numa(void)
+{
+    if (!numa_enabled || numa_len == 0)
+        return;
+    int last = (numa_head - 1 + NUMA_HISTORY) % NUMA_HISTORY;
+
+    double total_growth = 0.0;
+    for (int i = 0; i < numa_nnodes; i++) {
+        double g = numa_slope(numa_hist_unreclaim, i);
+        if (g > 0.0)
+            total_growth += g;
+    }
+
+    for (int i = 0; i < numa_nnodes; i++) {
+        const numa_node *n = &numa_nodes[i];
+        double free_pages = numa_hist_free[last][i];
+        double free_slope = numa_slope(numa_hist_free, i);
+        double slab_slope = numa_slope(numa_hist_unreclaim, i);
+
+        rprintf("[NUMA] node%d free=%.0f MB (wmark min/low/high %llu/%llu/%llu MB) "
+                "slab_unreclaim=%.0f MB trend=%+.1f MB/min free trend=%+.1f MB/min",
+                n->nid, free_pages * vm_page_kb / 1024.0,
+                n->wmark_min * vm_page_kb / 1024, n->wmark_low * vm_page_kb / 1024,
+                n->wmark_high * vm_page_kb / 1024, numa_hist_unreclaim[last][i] * vm_page_kb / 1024.0,
+                slab_slope * 60.0 * vm_page_kb / 1024.0, free_slope * 60.0 * vm_page_kb / 1024.0);
+        if (numa_nnodes > 1 && slab_slope > 0.0 && slab_slope > 0.8 * total_growth)
+            rprintf(" (most of the slab growth)");
+
+        if (n->wmark_high == 0)
+            rprintf("\n");
+        else if (free_pages < n->wmark_min)
+            rprintf(" \033[1;31m-> below min watermark, allocations stall\033[0m\n");
+        else if (free_pages < n->wmark_low)
+            rprintf(" \033[1;31m-> below low watermark, direct reclaim\033[0m\n");
+        else if (free_pages < n->wmark_high)
+            rprintf(" \033[1;33m-> below high watermark, kswapd busy\033[0m\n");
+        else if (numa_len >= 3 && free_slope < 0.0 &&
+                 (free_pages - n->wmark_low) / -free_slope < 3600.0)
+            rprintf(" \033[1;33m-> low watermark in ~%.0f min\033[0m\n",
+                    (free_pages - n->wmark_low) / -free_slope / 60.0);
+        else
+            rprintf("\n");
+    }
+}
+
+#endif // NUMA_H
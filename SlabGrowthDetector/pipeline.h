@@ -0,0 +1,418 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include "report.h"
+
+// Pipelined mode (--pipeline). Three stages on three threads:
+//
+//   collector (main thread)  reads /proc and parses rows into a snapshot
+//   analyzer                 folds the snapshot into the lists, runs the
+//                            analysis and formats the report into a frame
+//   renderer                 writes frames to stdout
+//
+// Stages hand each other pointers over bounded single-producer/single-
+// consumer rings; every ring has a twin that carries the buffers back, so
+// nothing is allocated after start-up. A snapshot is never touched by the
+// collector again once pushed. When the analyzer falls behind the collector
+// blocks for a free snapshot (back-pressure). When the renderer falls
+// behind it skips straight to the newest queued frame and recycles the
+// older ones (drop-oldest), so a slow terminal or pipe never delays reads.
+//
+// Only vmstat, slabinfo (or the hot sysfs files) and buddyinfo are read by
+// the collector. The NUMA, sockstat, fs-object, SLUB per-CPU, kmemtrace and
+// kpageflags collectors still read inside analyze_cycle() on the analyzer
+// thread, so their reads are not overlapped with analysis; they take their
+// sample time from the applied snapshot (vm_sample_ts, slab_sample_ts).
+
+#define PIPE_SNAPSHOTS 4      // ring sizes must be powers of two
+#define PIPE_FRAMES 4
+#define PIPE_FRAME_BYTES (256 * 1024)
+
+typedef struct
+{
+    void **slot;
+    unsigned mask;
+    unsigned head __attribute__((aligned(64)));  // advanced by CAS: pop or evict
+    unsigned tail __attribute__((aligned(64)));  // written by the producer only
+    int done;                                    // producer has finished
+    sem_t items;                                 // wakes the consumer
+} spsc_ring;
+
+typedef struct
+{
+    char name[64];
+    unsigned long long value;
+} pipe_vmrow;
+
+typedef struct
+{
+    struct timespec ts;   // CLOCK_MONOTONIC at the start of the read
+    int nslabs, nvm, nzones, orders;
+    slabinfo *slabs;
+    pipe_vmrow *vm;
+    buddyzone zones[BUDDY_MAX_ZONES];
+} pipe_snapshot;
+
+typedef struct
+{
+    FILE *f;              // fmemopen() over buf, rewound for every frame
+    char *buf;
+    size_t len;
+} pipe_frame;
+
+static int pipe_enabled = 0;  // --pipeline
+static int pipe_ready = 0;
+static int pipe_slab_cap = 0, pipe_vm_cap = 0;
+static spsc_ring pipe_snaps, pipe_free_snaps;
+static spsc_ring pipe_frames, pipe_free_frames;
+static FILE *pipe_sink = NULL;  // report target when every frame is queued
+static pthread_t pipe_analyzer_tid, pipe_renderer_tid;
+static void (*pipe_analyze_fn)(void);
+static void (*pipe_render_fn)(void);
+
+static unsigned long long pipe_collected = 0, pipe_stalls = 0;        // collector
+static unsigned long long pipe_evicted = 0, pipe_skipped = 0;         // analyzer
+static unsigned long long pipe_truncated = 0;
+static unsigned long long pipe_written = 0, pipe_dropped = 0;         // renderer
+
+static int spsc_init(spsc_ring *r, unsigned cap, const char *what)
+{
+    r->slot = kml_alloc(cap * sizeof(void *), what);
+    if (!r->slot)
+        return -1;
+    r->mask = cap - 1;
+    r->head = r->tail = 0;
+    r->done = 0;
+    return sem_init(&r->items, 0, 0);
+}
+
+// Producer side; returns -1 when the ring is full.
+static int spsc_push(spsc_ring *r, void *p)
+{
+    unsigned t = r->tail;
+    if (t - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) > r->mask)
+        return -1;
+    __atomic_store_n(&r->slot[t & r->mask], p, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->tail, t + 1, __ATOMIC_RELEASE);
+    sem_post(&r->items);
+    return 0;
+}
+
+// Takes the oldest entry, or NULL if empty. Both the consumer (pop) and the
+// producer (evict) may take from the head, so it moves by CAS; a loser
+// retries with the next entry.
+static void *spsc_take_head(spsc_ring *r)
+{
+    unsigned h = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        if (h == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+            return NULL;
+        void *p = __atomic_load_n(&r->slot[h & r->mask], __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&r->head, &h, h + 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return p;
+    }
+}
+
+// Consumer side, after a successful wait on r->items. An evicted entry
+// leaves its wakeup behind, so NULL here just means nothing is left.
+static void *spsc_pop(spsc_ring *r)
+{
+    return spsc_take_head(r);
+}
+
+// Producer side drop-oldest: reclaim the oldest entry not yet consumed.
+static void *spsc_evict(spsc_ring *r)
+{
+    return spsc_take_head(r);
+}
+
+// Blocking take. Returns NULL once the producer has finished and the ring
+// is drained, or if a signal cut the wait.
+static void *spsc_take(spsc_ring *r)
+{
+    for (;;) {
+        if (sem_wait(&r->items) != 0)
+            return NULL;
+        void *p = spsc_pop(r);
+        if (p || __atomic_load_n(&r->done, __ATOMIC_ACQUIRE))
+            return p;
+    }
+}
+
+static void *spsc_try_take(spsc_ring *r)
+{
+    if (sem_trywait(&r->items) != 0)
+        return NULL;
+    return spsc_pop(r);
+}
+
+static void spsc_finish(spsc_ring *r)
+{
+    __atomic_store_n(&r->done, 1, __ATOMIC_RELEASE);
+    sem_post(&r->items);
+}
+
+// Bytes pipe_init() carves out for the given table sizes; lets the
+// fixed-footprint mode size its region before the pipeline exists.
+size_t pipe_footprint(int slab_cap, int vm_cap)
+{
+    size_t snap = sizeof(pipe_snapshot) + (size_t)slab_cap * sizeof(slabinfo)
+                + (size_t)vm_cap * sizeof(pipe_vmrow) + 3 * ARENA_ALIGN;
+    size_t frame = sizeof(pipe_frame) + PIPE_FRAME_BYTES + BUFSIZ + 3 * ARENA_ALIGN;
+    size_t rings = 2 * (PIPE_SNAPSHOTS + PIPE_FRAMES) * sizeof(void *) + 4 * ARENA_ALIGN;
+    return PIPE_SNAPSHOTS * snap + PIPE_FRAMES * frame + BUFSIZ + ARENA_ALIGN + rings;
+}
+
+// stdio would malloc the stream buffer on first write, mid steady state
+static int pipe_own_buffer(FILE *f, const char *what)
+{
+    char *b = kml_alloc(BUFSIZ, what);
+    return b ? setvbuf(f, b, _IOFBF, BUFSIZ) : -1;
+}
+
+// Idempotent, so fixed-footprint setup can size the tables from its probe
+// and the plain start-up path falls back to the compile-time maxima.
+int pipe_init(int slab_cap, int vm_cap)
+{
+    if (pipe_ready)
+        return 0;
+    pipe_slab_cap = slab_cap;
+    pipe_vm_cap = vm_cap;
+
+    if (spsc_init(&pipe_snaps, PIPE_SNAPSHOTS, "pipeline rings") != 0 ||
+        spsc_init(&pipe_free_snaps, PIPE_SNAPSHOTS, "pipeline rings") != 0 ||
+        spsc_init(&pipe_frames, PIPE_FRAMES, "pipeline rings") != 0 ||
+        spsc_init(&pipe_free_frames, PIPE_FRAMES, "pipeline rings") != 0)
+        return -1;
+
+    for (int i = 0; i < PIPE_SNAPSHOTS; i++) {
+        pipe_snapshot *s = kml_alloc(sizeof(*s), "pipeline snapshots");
+        if (!s)
+            return -1;
+        memset(s, 0, sizeof(*s));
+        s->slabs = kml_alloc((size_t)slab_cap * sizeof(slabinfo), "pipeline snapshots");
+        s->vm = kml_alloc((size_t)vm_cap * sizeof(pipe_vmrow), "pipeline snapshots");
+        if (!s->slabs || !s->vm)
+            return -1;
+        // only the parsed columns are ever written; the rest stay zero
+        memset(s->slabs, 0, (size_t)slab_cap * sizeof(slabinfo));
+        spsc_push(&pipe_free_snaps, s);
+    }
+
+    for (int i = 0; i < PIPE_FRAMES; i++) {
+        pipe_frame *f = kml_alloc(sizeof(*f), "pipeline frames");
+        if (!f)
+            return -1;
+        f->buf = kml_alloc(PIPE_FRAME_BYTES, "pipeline frames");
+        if (!f->buf)
+            return -1;
+        f->f = fmemopen(f->buf, PIPE_FRAME_BYTES, "w");
+        if (!f->f) {
+            perror("fmemopen pipeline frame");
+            return -1;
+        }
+        if (pipe_own_buffer(f->f, "pipeline frames") != 0)
+            return -1;
+        f->len = 0;
+        spsc_push(&pipe_free_frames, f);
+    }
+
+    pipe_sink = fopen("/dev/null", "w");
+    if (!pipe_sink) {
+        perror("open /dev/null");
+        return -1;
+    }
+    if (pipe_own_buffer(pipe_sink, "pipeline frames") != 0)
+        return -1;
+    pipe_ready = 1;
+    return 0;
+}
+
+// Collector: one read + parse into a free snapshot. Blocks while every
+// snapshot is still with the analyzer; returns -1 if a signal cut the wait.
+int pipe_collect(void)
+{
+    pipe_snapshot *s = spsc_try_take(&pipe_free_snaps);
+    if (!s) {
+        pipe_stalls++;
+        s = spsc_take(&pipe_free_snaps);
+        if (!s)
+            return -1;
+    }
+
+    prof_begin(PHASE_READ);
+    clock_gettime(CLOCK_MONOTONIC, &s->ts);
+    int vm_ok = procfile_read(&vmstat_file) >= 0;
+    if (!vm_ok)
+        perror("read /proc/vmstat");
+    int slab_ok = slabsrc_read() == 0;
+    int buddy_ok = procfile_read(&buddyinfo_file) >= 0;
+    if (!buddy_ok)
+        perror("cannot read /proc/buddyinfo");
+    prof_end(PHASE_READ);
+
+    prof_begin(PHASE_PARSE);
+    s->nvm = 0;
+    for (char *line = vm_ok ? vmstat_file.buf : NULL; line && s->nvm < pipe_vm_cap;
+         line = procfile_next_line(line)) {
+        pipe_vmrow *r = &s->vm[s->nvm];
+        if (parse_vmstat_line(line, r->name, sizeof(r->name), &r->value) == 0)
+            s->nvm++;
+    }
+
+    if (slab_ok) {
+        slabsrc_parse();
+        s->nslabs = slabsrc_nrows < pipe_slab_cap ? slabsrc_nrows : pipe_slab_cap;
+        memcpy(s->slabs, slabsrc_rows, (size_t)s->nslabs * sizeof(slabinfo));
+    } else {
+        s->nslabs = -1; // the analyzer marks every cache stale
+    }
+
+    // a failed read keeps the analyzer's previous buddy matrix
+    s->nzones = buddy_ok ? parse_buddyinfo_buffer(buddyinfo_file.buf, s->zones,
+                                                  BUDDY_MAX_ZONES, &s->orders) : -1;
+    prof_end(PHASE_PARSE);
+
+    spsc_push(&pipe_snaps, s);
+    pipe_collected++;
+    return 0;
+}
+
+// Fold a snapshot into the analyzer-owned lists and tables.
+static void pipe_apply(const pipe_snapshot *s)
+{
+    vm_sample_ts = s->ts;
+    slab_sample_ts = s->ts;
+    for (int i = 0; i < s->nvm; i++)
+        list_update_or_add_vmstat(s->vm[i].name, s->vm[i].value);
+    if (s->nslabs < 0)
+        mark_slabs_stale();
+    for (int i = 0; i < s->nslabs; i++)
+        apply_slab_row(&s->slabs[i]);
+    if (s->nzones >= 0) {
+        memcpy(buddy_zones, s->zones, (size_t)s->nzones * sizeof(buddyzone));
+        buddy_nzones = s->nzones;
+        buddy_orders = s->orders;
+    }
+}
+
+static void *pipe_analyzer(void *arg)
+{
+    (void)arg;
+    init_self_profiling();  // perf counters are per thread
+
+    pipe_snapshot *s;
+    while ((s = spsc_take(&pipe_snaps)) != NULL) {
+        pipe_apply(s);
+        spsc_push(&pipe_free_snaps, s);
+
+        // renderer behind: take back the oldest frame it has not started
+        // on. If it holds them all, analyze anyway so the trends stay
+        // continuous, but report into the sink.
+        pipe_frame *f = spsc_try_take(&pipe_free_frames);
+        if (!f && (f = spsc_evict(&pipe_frames)) != NULL)
+            pipe_evicted++;
+        if (f) {
+            rewind(f->f);
+            report_out = f->f;
+        } else {
+            pipe_skipped++;
+            report_out = pipe_sink;
+        }
+
+        pipe_analyze_fn();
+        pipe_render_fn();
+
+        if (f) {
+            fflush(f->f);
+            long len = ftell(f->f);
+            f->len = len > 0 ? (size_t)len : 0;
+            if (f->len >= PIPE_FRAME_BYTES - 1)
+                pipe_truncated++;
+            spsc_push(&pipe_frames, f);
+        }
+    }
+    report_out = NULL;
+    spsc_finish(&pipe_frames);
+    return NULL;
+}
+
+static void *pipe_renderer(void *arg)
+{
+    (void)arg;
+    init_self_profiling();
+    pipe_frame *f;
+    while ((f = spsc_take(&pipe_frames)) != NULL) {
+        // only the newest queued frame is worth writing
+        pipe_frame *next;
+        while ((next = spsc_try_take(&pipe_frames)) != NULL) {
+            spsc_push(&pipe_free_frames, f);
+            pipe_dropped++;
+            f = next;
+        }
+        prof_begin(PHASE_EXPORT);
+        fwrite(f->buf, 1, f->len, stdout);
+        fflush(stdout);
+        prof_end(PHASE_EXPORT);
+        pipe_written++;
+        spsc_push(&pipe_free_frames, f);
+    }
+    return NULL;
+}
+
+// Starts the analyzer and renderer with the signals the collector handles
+// blocked, so SIGINT/SIGTERM always land on the collector's waits.
+int pipe_start(void (*analyze)(void), void (*render)(void))
+{
+    pipe_analyze_fn = analyze;
+    pipe_render_fn = render;
+
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+
+    int err = pthread_create(&pipe_analyzer_tid, NULL, pipe_analyzer, NULL);
+    if (err == 0) {
+        err = pthread_create(&pipe_renderer_tid, NULL, pipe_renderer, NULL);
+        if (err != 0) {
+            spsc_finish(&pipe_snaps);
+            pthread_join(pipe_analyzer_tid, NULL);
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        errno = err;
+        perror("pthread_create pipeline");
+        return -1;
+    }
+    return 0;
+}
+
+// Drains the queued snapshots and frames, then joins both stages.
+void pipe_stop(void)
+{
+    spsc_finish(&pipe_snaps);
+    pthread_join(pipe_analyzer_tid, NULL);
+    pthread_join(pipe_renderer_tid, NULL);
+}
+
+void show_pipeline_summary(void)
+{
+    rprintf("[PIPELINE] %llu snapshots (%llu collector stalls), %llu frames written, "
+            "%llu oldest dropped, %llu unrendered, %llu truncated\n",
+            pipe_collected, pipe_stalls, pipe_written, pipe_dropped + pipe_evicted,
+            pipe_skipped, pipe_truncated);
+}
+
+#endif // PIPELINE_H
@@ -0,0 +1,487 @@
+#ifndef PROCATTR_H
+#define PROCATTR_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "report.h"
+
+// Which processes own the kernel objects of a growing per-process cache.
+// When vm_area_struct, anon_vma(_chain), task_struct, mm_struct or a page
+// table cache alerts, one pass over /proc/<pid>/{status,maps} counts per
+// process the objects behind it: VMAs, private writable VMAs (the ones that
+// get an anon_vma), threads, children (one mm each) and VmPTE. Processes
+// are then ranked by growth since the previous pass.
+//
+// A pass splits the pid list over a few worker threads that take pids
+// from a shared counter. The workers are started once, with the tables,
+// and sleep on a semaphore between passes. Every file is read with plain
+// read()s into the worker's own 64 KB buffer; nothing goes through stdio.
+// With the proc connector table live (procconn.h) the pids, parents,
+// names and thread counts come from it: a pass for task_struct or
+// mm_struct then reads nothing but the names of new or exec'd processes,
+// and only VMA and page table counts, which no lifecycle event reports,
+// still need every process's maps and status.
+
+#define ATTR_MAX_PROCS 32768
+#define ATTR_MAX_THREADS 16
+#define ATTR_BUF_SIZE (64 * 1024)
+#define ATTR_MIN_GAP_CYCLES 3      // passes at most this often while alerts last
+#define ATTR_SHOW 3
+
+enum { ATTR_VMAS, ATTR_ANON_VMAS, ATTR_THREADS, ATTR_CHILDREN, ATTR_PTE_KB, ATTR_KINDS };
+
+typedef struct
+{
+    int pid, ppid;
+    char comm[16];
+    long long v[ATTR_KINDS];
+} attr_proc;
+
+typedef struct
+{
+    char *buf;
+    attr_proc *procs;
+    int *next;        // shared pid cursor
+    int nprocs;
+    pthread_t tid;
+    int spawned;
+} attr_worker;
+
+static int attr_enabled = 1;               // optional collector, the governor may drop it
+static int attr_threads = 4;
+static attr_proc *attr_cur = NULL, *attr_prev = NULL;
+static int attr_ncur = 0, attr_nprev = 0;
+static int attr_have_prev = 0;
+static char *attr_bufs[ATTR_MAX_THREADS];
+static procdir attr_dir = PROCDIR_INIT;    // /proc, when the process table is not live
+static attr_worker attr_workers[ATTR_MAX_THREADS];  // [0] is the calling thread
+static int attr_nworkers = 0;              // pool threads running
+static int attr_pool_started = 0;
+static int attr_pool_stop = 0;
+static int attr_next = 0;                  // pid cursor of the current pass
+static sem_t attr_go, attr_done;
+static int attr_last_pass = -ATTR_MIN_GAP_CYCLES;
+static int attr_cycle = 0;
+static int attr_ran = 0;                   // a pass ran this cycle
+static int attr_reads = 0;                 // it read status and maps
+static double attr_ms = 0.0;
+static int attr_used_threads = 0;
+static int attr_alerting[ATTR_KINDS];
+static char attr_cause[ATTR_KINDS][MAX_NAME_LEN];
+
+static const char *attr_kind_names[ATTR_KINDS] = {"VMAs", "private writable VMAs", "threads",
+                                                  "children", "KB page tables"};
+
+// the object a cache holds per process, -1 if none
+static int attr_kind_of(const char *cache)
+{
+    if (strcmp(cache, "vm_area_struct") == 0)
+        return ATTR_VMAS;
+    if (strcmp(cache, "anon_vma") == 0 || strcmp(cache, "anon_vma_chain") == 0)
+        return ATTR_ANON_VMAS;
+    if (strcmp(cache, "task_struct") == 0)
+        return ATTR_THREADS;
+    if (strcmp(cache, "mm_struct") == 0)
+        return ATTR_CHILDREN;
+    if (strncmp(cache, "pgtable", 7) == 0 || strcmp(cache, "pgd_cache") == 0 ||
+        strcmp(cache, "pmd_cache") == 0 || strcmp(cache, "page->ptl") == 0)
+        return ATTR_PTE_KB;
+    return -1;
+}
+
+static int attr_clamp_threads(void)
+{
+    if (attr_threads < 1)
+        return 1;
+    if (attr_threads > ATTR_MAX_THREADS)
+        return ATTR_MAX_THREADS;
+    return attr_threads;
+}
+
+static int attr_pool_start(void);
+
+// Both pass tables, the worker buffers and the pool, set up once.
+int attr_reserve(void)
+{
+    if (!attr_cur) {
+        attr_cur = kml_alloc(ATTR_MAX_PROCS * sizeof(attr_proc), "attribution tables");
+        attr_prev = kml_alloc(ATTR_MAX_PROCS * sizeof(attr_proc), "attribution tables");
+        if (!attr_cur || !attr_prev)
+            return -1;
+    }
+    for (int i = 0; i < attr_clamp_threads(); i++) {
+        if (!attr_bufs[i])
+            attr_bufs[i] = kml_alloc(ATTR_BUF_SIZE, "attribution buffers");
+        if (!attr_bufs[i])
+            return -1;
+    }
+    char path[PROCFILE_PATH_MAX];
+    if (procdir_open(&attr_dir, procfile_path(path, sizeof(path), "/proc")) != 0) {
+        perror(path);
+        return -1;
+    }
+    if (!attr_pool_started && attr_pool_start() != 0)
+        return -1;
+    return 0;
+}
+
+size_t attr_footprint(void)
+{
+    return 2 * (ATTR_MAX_PROCS * sizeof(attr_proc) + ARENA_ALIGN)
+         + (size_t)attr_clamp_threads() * (ATTR_BUF_SIZE + ARENA_ALIGN)
+         + PROCDIR_BUF_SIZE + ARENA_ALIGN;
+}
+
+// the number after "key" in a status file, -1 if absent
+static long long attr_status_field(const char *buf, const char *key)
+{
+    const char *p = strstr(buf, key);
+    return p ? strtoll(p + strlen(key), NULL, 10) : -1;
+}
+
+static int attr_read_status(attr_proc *p, char *buf, int pid)
+{
+    char path[PROCFILE_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/proc/%d/status", procfile_root, pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = read(fd, buf, ATTR_BUF_SIZE - 1);
+    close(fd);
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+
+    const char *name = strstr(buf, "Name:\t");
+    if (name) {
+        name += 6;
+        size_t len = strcspn(name, "\n");
+        if (len >= sizeof(p->comm))
+            len = sizeof(p->comm) - 1;
+        memcpy(p->comm, name, len);
+        p->comm[len] = '\0';
+    }
+    p->ppid = (int)attr_status_field(buf, "\nPPid:");
+    p->v[ATTR_THREADS] = attr_status_field(buf, "\nThreads:");
+    long long pte = attr_status_field(buf, "\nVmPTE:");
+    p->v[ATTR_PTE_KB] = pte > 0 ? pte : 0;   // kernel threads have no VmPTE
+    return 0;
+}
+
+// One line per VMA: "start-end perms offset dev inode path". A private
+// writable mapping ("rw.p") is the kind that gets an anon_vma on fault.
+static void attr_read_maps(attr_proc *p, char *buf, int pid)
+{
+    char path[PROCFILE_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/proc/%d/maps", procfile_root, pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    long long vmas = 0, anon = 0;
+    size_t have = 0;
+    ssize_t n;
+    while ((n = read(fd, buf + have, ATTR_BUF_SIZE - have)) > 0) {
+        char *line = buf, *end = buf + have + n, *nl;
+        while ((nl = memchr(line, '\n', (size_t)(end - line))) != NULL) {
+            const char *perms = memchr(line, ' ', (size_t)(nl - line));
+            if (perms && nl - perms > 4 && perms[2] == 'w' && perms[4] == 'p')
+                anon++;
+            vmas++;
+            line = nl + 1;
+        }
+        have = (size_t)(end - line);
+        if (have == ATTR_BUF_SIZE)
+            have = 0;                      // no VMA line is that long
+        memmove(buf, line, have);
+    }
+    close(fd);
+    p->v[ATTR_VMAS] = vmas;
+    p->v[ATTR_ANON_VMAS] = anon;
+}
+
+static void attr_worker_run(attr_worker *w)
+{
+    int i;
+    while ((i = __atomic_fetch_add(w->next, 1, __ATOMIC_RELAXED)) < w->nprocs) {
+        attr_proc *p = &w->procs[i];
+        // a process that exits mid-pass keeps pid and zero counts
+        if (attr_read_status(p, w->buf, p->pid) == 0)
+            attr_read_maps(p, w->buf, p->pid);
+    }
+}
+
+// One token on attr_go per pass and pool thread; whichever thread takes
+// it works with its own buffer until the cursor runs out.
+static void *attr_pool_run(void *arg)
+{
+    attr_worker *w = arg;
+    for (;;) {
+        while (sem_wait(&attr_go) != 0 && errno == EINTR)
+            ;
+        if (__atomic_load_n(&attr_pool_stop, __ATOMIC_ACQUIRE))
+            return NULL;
+        attr_worker_run(w);
+        sem_post(&attr_done);
+    }
+}
+
+// Starts the pool threads with the signals the main loop handles blocked.
+// A thread that fails to start leaves its share to the ones that did.
+static int attr_pool_start(void)
+{
+    if (sem_init(&attr_go, 0, 0) != 0 || sem_init(&attr_done, 0, 0) != 0)
+        return -1;
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    for (int i = 1; i < attr_clamp_threads(); i++) {
+        attr_worker *w = &attr_workers[i];
+        w->buf = attr_bufs[i];
+        int err = pthread_create(&w->tid, NULL, attr_pool_run, w);
+        w->spawned = err == 0;
+        if (err != 0) {
+            errno = err;
+            perror("pthread_create proc-attr");
+        } else {
+            attr_nworkers++;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    attr_workers[0].buf = attr_bufs[0];
+    attr_pool_started = 1;
+    return 0;
+}
+
+void attr_stop(void)
+{
+    if (!attr_pool_started)
+        return;
+    __atomic_store_n(&attr_pool_stop, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < attr_nworkers; i++)
+        sem_post(&attr_go);
+    for (int i = 1; i < ATTR_MAX_THREADS; i++)
+        if (attr_workers[i].spawned)
+            pthread_join(attr_workers[i].tid, NULL);
+    attr_nworkers = 0;
+    attr_pool_started = 0;
+    procdir_close(&attr_dir);
+}
+
+static int attr_cmp_pid(const void *a, const void *b)
+{
+    return ((const attr_proc *)a)->pid - ((const attr_proc *)b)->pid;
+}
+
+static attr_proc *attr_find(attr_proc *procs, int n, int pid)
+{
+    attr_proc key = {.pid = pid};
+    return bsearch(&key, procs, n, sizeof(attr_proc), attr_cmp_pid);
+}
+
+// status and maps of every process in attr_cur; returns the threads used
+static int attr_read_all(void)
+{
+    // the semaphores order these stores before the pool's reads
+    attr_next = 0;
+    for (int i = 0; i < ATTR_MAX_THREADS; i++) {
+        attr_workers[i].procs = attr_cur;
+        attr_workers[i].next = &attr_next;
+        attr_workers[i].nprocs = attr_ncur;
+    }
+    for (int i = 0; i < attr_nworkers; i++)
+        sem_post(&attr_go);
+    // worker 0 runs here
+    attr_worker_run(&attr_workers[0]);
+    for (int i = 0; i < attr_nworkers; i++)
+        while (sem_wait(&attr_done) != 0 && errno == EINTR)
+            ;
+    return attr_nworkers + 1;
+}
+
+// /proc/<pid>/comm of a process the table saw start or exec
+static void attr_read_comm(attr_proc *p, char *buf)
+{
+    char path[PROCFILE_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/proc/%d/comm", procfile_root, p->pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    ssize_t n = read(fd, buf, sizeof(p->comm));
+    close(fd);
+    if (n <= 0)
+        return;
+    size_t len = strcspn(buf, "\n");
+    if (len > (size_t)n)
+        len = (size_t)n;
+    if (len >= sizeof(p->comm))
+        len = sizeof(p->comm) - 1;
+    memcpy(p->comm, buf, len);
+    p->comm[len] = '\0';
+}
+
+// pids, parents, names and threads from the proc connector table
+static void attr_from_table(void)
+{
+    for (int i = 0; i < PC_SLOTS && attr_ncur < ATTR_MAX_PROCS; i++) {
+        pc_proc *e = &pc_table[i];
+        if (!e->pid)
+            continue;
+        if (e->dirty) {
+            attr_proc tmp = {.pid = e->pid};
+            memcpy(tmp.comm, e->comm, sizeof(tmp.comm));
+            attr_read_comm(&tmp, attr_bufs[0]);
+            memcpy(e->comm, tmp.comm, sizeof(e->comm));
+            e->dirty = 0;
+        }
+        attr_proc *p = &attr_cur[attr_ncur++];
+        memset(p, 0, sizeof(*p));
+        p->pid = e->pid;
+        p->ppid = e->ppid;
+        memcpy(p->comm, e->comm, sizeof(p->comm));
+        p->v[ATTR_THREADS] = e->threads;
+    }
+}
+
+static void attr_pass(void)
+{
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    attr_proc *swap = attr_prev;
+    attr_prev = attr_cur;
+    attr_nprev = attr_ncur;
+    attr_cur = swap;
+    attr_ncur = 0;
+
+    int from_table = pc_live();
+    if (from_table) {
+        attr_from_table();
+    } else {
+        if (procdir_rewind(&attr_dir) != 0)
+            return;
+        const char *name;
+        while ((name = procdir_next(&attr_dir)) != NULL && attr_ncur < ATTR_MAX_PROCS) {
+            if (name[0] < '1' || name[0] > '9')
+                continue;
+            attr_proc *p = &attr_cur[attr_ncur++];
+            memset(p, 0, sizeof(*p));
+            p->pid = atoi(name);
+            p->ppid = -1;
+        }
+    }
+    qsort(attr_cur, attr_ncur, sizeof(attr_proc), attr_cmp_pid);
+    attr_reads = !from_table || attr_alerting[ATTR_VMAS] || attr_alerting[ATTR_ANON_VMAS] ||
+                 attr_alerting[ATTR_PTE_KB];
+    attr_used_threads = attr_reads ? attr_read_all() : 0;
+
+    for (int i = 0; i < attr_ncur; i++) {
+        attr_proc *parent = attr_find(attr_cur, attr_ncur, attr_cur[i].ppid);
+        if (parent)
+            parent->v[ATTR_CHILDREN]++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    attr_ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+}
+
+// Call after the trend updates: runs a pass when a per-process cache alerts.
+void update_proc_attr(void)
+{
+    attr_ran = 0;
+    attr_cycle++;
+
+    const detector_config *c = cfg();
+    int any = 0;
+    double gained = 0.0;
+    memset(attr_alerting, 0, sizeof(attr_alerting));
+    for (list *cur = get_slab_list_head(); cur; cur = cur->next) {
+        const slabinfo *s = cur->slab;
+        int kind = attr_kind_of(s->name);
+        if (kind < 0)
+            continue;
+        gained += (double)slab_trend_objs(s) - (double)slab_prev_trend_objs(s);
+        if (!attr_enabled)
+            continue;
+        // the same conditions that print [ALERT], [LEAK WARNING] and [CORRELATION]
+        if (s->growth > c->growth_threshold || s->monotonic_count >= c->mono_limit ||
+            get_leak_score(s) >= c->score.alert_score) {
+            if (!attr_alerting[kind])
+                snprintf(attr_cause[kind], sizeof(attr_cause[kind]), "%s", s->name);
+            attr_alerting[kind] = 1;
+            any = 1;
+        }
+    }
+    pc_note_cache_growth(gained);
+    if (!any || attr_cycle - attr_last_pass < ATTR_MIN_GAP_CYCLES)
+        return;
+    if (attr_reserve() != 0) {
+        attr_enabled = 0;
+        return;
+    }
+    attr_have_prev = attr_last_pass >= 0 && attr_ncur > 0;
+    attr_pass();
+    attr_last_pass = attr_cycle;
+    attr_ran = 1;
+}
+
+static long long attr_growth(const attr_proc *p, int kind)
+{
+    if (!attr_have_prev)
+        return p->v[kind];
+    const attr_proc *old = attr_find(attr_prev, attr_nprev, p->pid);
+    return old ? p->v[kind] - old->v[kind] : p->v[kind];
+}
+
+void show_proc_attr(void)
+{
+    if (!attr_ran)
+        return;
+    rprintf("[PROC ATTR] pass over %d processes in %.1f ms (%s)%s\n", attr_ncur, attr_ms,
+            attr_reads ? (attr_used_threads > 1 ? "status and maps, threaded" : "status and maps")
+                       : "process table only",
+            attr_have_prev ? "" : ", first pass: totals, not growth");
+
+    for (int kind = 0; kind < ATTR_KINDS; kind++) {
+        if (!attr_alerting[kind])
+            continue;
+        int shown[ATTR_SHOW];
+        int nshown = 0;
+        for (int k = 0; k < ATTR_SHOW; k++) {
+            int best = -1;
+            long long best_growth = 0;
+            for (int i = 0; i < attr_ncur; i++) {
+                long long g = attr_growth(&attr_cur[i], kind);
+                int taken = 0;
+                for (int j = 0; j < nshown; j++)
+                    taken |= shown[j] == i;
+                if (!taken && g > best_growth) {
+                    best = i;
+                    best_growth = g;
+                }
+            }
+            if (best < 0)
+                break;
+            shown[nshown++] = best;
+            const attr_proc *p = &attr_cur[best];
+            rprintf("[PROC ATTR] %-16s pid %-7d %-16s %+lld %s (now %lld)\n", attr_cause[kind], p->pid,
+                    p->comm, best_growth, attr_kind_names[kind], p->v[kind]);
+        }
+        if (nshown == 0)
+            rprintf("[PROC ATTR] %-16s no process grew %s: kernel-internal or already exited\n",
+                    attr_cause[kind], attr_kind_names[kind]);
+    }
+}
+
+#endif // PROCATTR_H
@@ -0,0 +1,405 @@
+#ifndef PROCCONN_H
+#define PROCCONN_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include "report.h"
+
+// Process table kept current by the kernel's proc connector: fork, exec,
+// comm and exit events arrive over netlink and each one is an O(1) update
+// of an open-addressing table keyed by pid. Attribution passes
+// (procattr.h) take pids, parents, names and thread counts from it
+// instead of walking /proc, and re-read only what changed.
+//
+// Listening needs CAP_NET_ADMIN. Without it, or when the socket overruns
+// and events were lost, the table is rebuilt from /proc/<pid>/status: at
+// once after an overrun, every PC_RESCAN_CYCLES cycles as a fallback.
+//
+// Per-cycle task starts and exits (processes and threads) are kept next
+// to the growth of the per-process caches, to tell caches that follow the
+// live tasks from objects that outlive the tasks that made them.
+
+#define PC_SLOTS 65536             // power of two, twice ATTR_MAX_PROCS
+#define PC_RCVBUF (4 << 20)
+#define PC_RESCAN_CYCLES 12
+#define PC_HISTORY 60
+#define PC_MIN_SAMPLES 6
+#define PC_BURST_MIN 50            // starts per cycle before a burst is worth a line
+
+typedef enum
+{
+    PC_NETLINK,       // netlink, falling back to scans
+    PC_SCAN,          // scans only
+    PC_OFF,
+} pc_mode;
+
+typedef struct
+{
+    int pid;          // 0 = empty slot
+    int ppid;
+    int threads;
+    int dirty;        // new, exec'd or renamed since the last attribution pass
+    char comm[16];
+} pc_proc;
+
+static pc_mode pc_policy = PC_NETLINK;     // --proc-events
+static int pc_enabled = 1;                 // optional collector, the governor may drop it
+static int pc_sock = -1;
+static int pc_in_sync = 0;                 // table matches the system
+static int pc_cycle = 0;
+static int pc_nprocs = 0;
+static pc_proc *pc_table = NULL;
+static procdir pc_dir = PROCDIR_INIT;      // /proc, for the scans
+static char pc_buf[64 * 1024];             // netlink datagrams, then status files
+static unsigned long long pc_overruns = 0, pc_scans = 0;
+
+// this cycle's events
+static int pc_forks, pc_exits, pc_execs, pc_thread_starts, pc_thread_exits;
+
+// per-cycle history: task starts, task exits, per-process cache objects gained
+static double pc_hist_starts[PC_HISTORY], pc_hist_exits[PC_HISTORY], pc_hist_cache[PC_HISTORY];
+static int pc_head = 0, pc_len = 0;
+
+static int pc_at(int i) // 0 = oldest
+{
+    return (pc_head - pc_len + i + 2 * PC_HISTORY) % PC_HISTORY;
+}
+
+static uint32_t pc_home(int pid)
+{
+    return (uint32_t)(((uint64_t)(unsigned)pid * 0x9E3779B97F4A7C15ULL) >> 40) & (PC_SLOTS - 1);
+}
+
+static pc_proc *pc_find(int pid)
+{
+    uint32_t i = pc_home(pid);
+    while (pc_table[i].pid && pc_table[i].pid != pid)
+        i = (i + 1) & (PC_SLOTS - 1);
+    return &pc_table[i];
+}
+
+// The entry for pid, created if new; NULL when the table is full.
+static pc_proc *pc_insert(int pid)
+{
+    pc_proc *p = pc_find(pid);
+    if (p->pid)
+        return p;
+    if (pc_nprocs >= PC_SLOTS / 2)
+        return NULL;
+    memset(p, 0, sizeof(*p));
+    p->pid = pid;
+    pc_nprocs++;
+    return p;
+}
+
+// Backward-shift deletion keeps probe runs unbroken without tombstones.
+static void pc_remove(int pid)
+{
+    pc_proc *p = pc_find(pid);
+    if (!p->pid)
+        return;
+    uint32_t i = (uint32_t)(p - pc_table), j = i;
+    for (;;) {
+        j = (j + 1) & (PC_SLOTS - 1);
+        if (!pc_table[j].pid)
+            break;
+        uint32_t home = pc_home(pc_table[j].pid);
+        if (((j - home) & (PC_SLOTS - 1)) >= ((j - i) & (PC_SLOTS - 1))) {
+            pc_table[i] = pc_table[j];
+            i = j;
+        }
+    }
+    pc_table[i].pid = 0;
+    pc_nprocs--;
+}
+
+int pc_reserve(void)
+{
+    if (!pc_table)
+        pc_table = kml_alloc(PC_SLOTS * sizeof(pc_proc), "process table");
+    if (!pc_table)
+        return -1;
+    char path[PROCFILE_PATH_MAX];
+    if (procdir_open(&pc_dir, procfile_path(path, sizeof(path), "/proc")) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+size_t pc_footprint(void)
+{
+    return PC_SLOTS * sizeof(pc_proc) + PROCDIR_BUF_SIZE + 2 * ARENA_ALIGN;
+}
+
+// Rebuilds the table from /proc/<pid>/status; every entry starts dirty.
+static void pc_scan(void)
+{
+    memset(pc_table, 0, PC_SLOTS * sizeof(pc_proc));
+    pc_nprocs = 0;
+    char path[PROCFILE_PATH_MAX];
+    if (procdir_rewind(&pc_dir) != 0)
+        return;
+    const char *name;
+    while ((name = procdir_next(&pc_dir)) != NULL) {
+        if (name[0] < '1' || name[0] > '9')
+            continue;
+        int pid = atoi(name);
+        snprintf(path, sizeof(path), "%s/proc/%d/status", procfile_root, pid);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        ssize_t n = read(fd, pc_buf, sizeof(pc_buf) - 1);
+        close(fd);
+        if (n <= 0)
+            continue;
+        pc_buf[n] = '\0';
+        pc_proc *p = pc_insert(pid);
+        if (!p)
+            break;
+        const char *v = strstr(pc_buf, "Name:\t");
+        if (v) {
+            size_t len = strcspn(v + 6, "\n");
+            if (len >= sizeof(p->comm))
+                len = sizeof(p->comm) - 1;
+            memcpy(p->comm, v + 6, len);
+        }
+        if ((v = strstr(pc_buf, "\nPPid:")) != NULL)
+            p->ppid = atoi(v + 6);
+        if ((v = strstr(pc_buf, "\nThreads:")) != NULL)
+            p->threads = atoi(v + 9);
+        p->dirty = 1;
+    }
+    pc_scans++;
+    pc_in_sync = 1;
+}
+
+static int pc_send_op(enum proc_cn_mcast_op op)
+{
+    struct
+    {
+        struct nlmsghdr nl;
+        struct cn_msg cn;
+        enum proc_cn_mcast_op op;
+    } __attribute__((packed)) msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.nl.nlmsg_len = sizeof(msg);
+    msg.nl.nlmsg_type = NLMSG_DONE;
+    msg.nl.nlmsg_pid = getpid();
+    msg.cn.id.idx = CN_IDX_PROC;
+    msg.cn.id.val = CN_VAL_PROC;
+    msg.cn.len = sizeof(op);
+    msg.op = op;
+    return send(pc_sock, &msg, sizeof(msg), 0) == (ssize_t)sizeof(msg) ? 0 : -1;
+}
+
+static int pc_listen(void)
+{
+    pc_sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (pc_sock < 0)
+        return -1;
+    struct sockaddr_nl sa = {.nl_family = AF_NETLINK, .nl_groups = CN_IDX_PROC, .nl_pid = getpid()};
+    int rcvbuf = PC_RCVBUF;
+    // bursts of thousands of forks must fit between two cycles
+    if (setsockopt(pc_sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) != 0)
+        setsockopt(pc_sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (bind(pc_sock, (struct sockaddr *)&sa, sizeof(sa)) != 0 || pc_send_op(PROC_CN_MCAST_LISTEN) != 0) {
+        close(pc_sock);
+        pc_sock = -1;
+        return -1;
+    }
+    return 0;
+}
+
+// Subscribes first and scans second, so nothing between the two is lost.
+int proc_events_start(void)
+{
+    if (pc_policy == PC_OFF) {
+        pc_enabled = 0;
+        return 0;
+    }
+    if (pc_reserve() != 0)
+        return -1;
+    if (pc_policy == PC_NETLINK && pc_listen() != 0)
+        fprintf(stderr, "proc events: no proc connector (%s), scanning /proc every %d cycles\n",
+                strerror(errno), PC_RESCAN_CYCLES);
+    pc_scan();
+    return 0;
+}
+
+void proc_events_stop(void)
+{
+    if (pc_sock >= 0) {
+        pc_send_op(PROC_CN_MCAST_IGNORE);
+        close(pc_sock);
+        pc_sock = -1;
+    }
+    procdir_close(&pc_dir);
+}
+
+static void pc_event(const struct proc_event *ev)
+{
+    pc_proc *p;
+    switch (ev->what) {
+    case PROC_EVENT_FORK: {
+        int pid = ev->event_data.fork.child_pid, tgid = ev->event_data.fork.child_tgid;
+        if (pid != tgid) {
+            pc_thread_starts++;
+            if ((p = pc_find(tgid))->pid)
+                p->threads++;
+            break;
+        }
+        pc_forks++;
+        if ((p = pc_insert(pid)) == NULL)
+            break;
+        // inserting never moves other entries
+        const pc_proc *parent = pc_find(ev->event_data.fork.parent_tgid);
+        p->ppid = ev->event_data.fork.parent_tgid;
+        p->threads = 1;
+        p->dirty = 1;
+        if (parent->pid)
+            memcpy(p->comm, parent->comm, sizeof(p->comm));   // until exec or a comm event
+        break;
+    }
+    case PROC_EVENT_EXEC:
+        pc_execs++;
+        if ((p = pc_find(ev->event_data.exec.process_tgid))->pid)
+            p->dirty = 1;
+        break;
+    case PROC_EVENT_COMM:
+        if (ev->event_data.comm.process_pid == ev->event_data.comm.process_tgid &&
+            (p = pc_find(ev->event_data.comm.process_tgid))->pid) {
+            memcpy(p->comm, ev->event_data.comm.comm, sizeof(p->comm));
+            p->comm[sizeof(p->comm) - 1] = '\0';
+        }
+        break;
+    case PROC_EVENT_EXIT:
+        if (ev->event_data.exit.process_pid != ev->event_data.exit.process_tgid) {
+            pc_thread_exits++;
+            if ((p = pc_find(ev->event_data.exit.process_tgid))->pid && p->threads > 1)
+                p->threads--;
+        } else {
+            pc_exits++;
+            pc_remove(ev->event_data.exit.process_pid);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void pc_drain(void)
+{
+    for (;;) {
+        ssize_t n = recv(pc_sock, pc_buf, sizeof(pc_buf), 0);
+        if (n < 0) {
+            if (errno == ENOBUFS) {    // events were dropped: the table is stale
+                pc_overruns++;
+                pc_in_sync = 0;
+                continue;
+            }
+            if (errno == EINTR)
+                continue;
+            return;                    // EAGAIN
+        }
+        for (struct nlmsghdr *nl = (struct nlmsghdr *)pc_buf; NLMSG_OK(nl, (size_t)n);
+             nl = NLMSG_NEXT(nl, n)) {
+            const struct cn_msg *cn = NLMSG_DATA(nl);
+            if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC ||
+                cn->len < sizeof(struct proc_event))
+                continue;
+            pc_event((const struct proc_event *)cn->data);
+        }
+    }
+}
+
+// Call at the start of the analysis, before update_proc_attr().
+void update_proc_events(void)
+{
+    pc_forks = pc_exits = pc_execs = pc_thread_starts = pc_thread_exits = 0;
+    if (!pc_enabled || !pc_table)
+        return;
+    pc_cycle++;
+    int before = pc_nprocs;
+    if (pc_sock >= 0)
+        pc_drain();
+    if (!pc_in_sync || (pc_sock < 0 && pc_cycle % PC_RESCAN_CYCLES == 0)) {
+        pc_scan();
+        // without events the starts and exits are only known net
+        if (pc_sock < 0) {
+            pc_forks = pc_nprocs > before ? pc_nprocs - before : 0;
+            pc_exits = before > pc_nprocs ? before - pc_nprocs : 0;
+        }
+    }
+
+    pc_hist_starts[pc_head] = pc_forks + pc_thread_starts;
+    pc_hist_exits[pc_head] = pc_exits + pc_thread_exits;
+    pc_hist_cache[pc_head] = 0.0;
+    pc_head = (pc_head + 1) % PC_HISTORY;
+    if (pc_len < PC_HISTORY)
+        pc_len++;
+}
+
+// Objects the per-process caches gained this cycle (from procattr.h).
+void pc_note_cache_growth(double objs)
+{
+    if (pc_len > 0)
+        pc_hist_cache[(pc_head - 1 + PC_HISTORY) % PC_HISTORY] = objs;
+}
+
+// The table can stand in for a /proc walk.
+int pc_live(void)
+{
+    return pc_enabled && pc_table && pc_in_sync && pc_sock >= 0;
+}
+
+void show_proc_events(void)
+{
+    if (!pc_enabled || !pc_table)
+        return;
+    rprintf("[PROC EVENTS] procs=%d starts=%d exits=%d", pc_nprocs, pc_forks, pc_exits);
+    if (pc_sock >= 0)
+        rprintf(" execs=%d threads +%d/-%d (netlink", pc_execs, pc_thread_starts, pc_thread_exits);
+    else
+        rprintf(" (net, /proc scan every %d cycles", PC_RESCAN_CYCLES);
+    if (pc_overruns)
+        rprintf(", %llu overruns, %llu rescans", pc_overruns, pc_scans - 1);
+    rprintf(")\n");
+
+    if (pc_len < PC_MIN_SAMPLES)
+        return;
+    double starts = 0.0, exits = 0.0, cache = 0.0;
+    for (int i = 0; i < pc_len; i++) {
+        starts += pc_hist_starts[pc_at(i)];
+        exits += pc_hist_exits[pc_at(i)];
+        cache += pc_hist_cache[pc_at(i)];
+    }
+    double mean = starts / pc_len;
+    if (pc_forks >= PC_BURST_MIN && pc_forks > 3.0 * mean)
+        rprintf("[PROC EVENTS] \033[1;33mstart burst: %d processes (%.1f per cycle on average)\033[0m\n",
+                pc_forks, mean);
+
+    // only worth a verdict while the per-process caches are growing
+    if (cache <= 0.0)
+        return;
+    double net = starts - exits;
+    rprintf("[PROC EVENTS] per-process caches %+.0f objs over %d cycles; tasks %.0f started, %.0f exited",
+            cache, pc_len, starts, exits);
+    if (net > 0.0)
+        rprintf(" -> follows %+.0f live tasks (%.1f objs each)\n", net, cache / net);
+    else if (starts > 0.0)
+        rprintf(" \033[1;31m-> objects outlive the tasks that made them\033[0m\n");
+    else
+        rprintf(" \033[1;33m-> growth without process or thread starts\033[0m\n");
+}
+
+#endif // PROCCONN_H
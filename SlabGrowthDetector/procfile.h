@@ -0,0 +1,182 @@
+#ifndef PROCFILE_H
+#define PROCFILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "arena.h"
+
+// A /proc or /sys file kept open across cycles. Each read rewinds the fd
+// and slurps the whole file into a reusable buffer, so a cycle costs one
+// lseek plus a few reads instead of open/fopen/fgets/close.
+
+#define PROCFILE_INITIAL_CAP 4096
+#define PROCFILE_PATH_MAX 512
+
+// --root DIR: every /proc and /sys path is read under DIR instead, so a
+// recorded tree can stand in for the live system. Empty = live system.
+static const char *procfile_root = "";
+
+typedef struct
+{
+    const char *path;
+    int fd;
+    char *buf;   // NUL terminated after procfile_read()
+    size_t cap;
+    size_t len;
+} procfile;
+
+#define PROCFILE_INIT(p) { (p), -1, NULL, 0, 0 }
+
+// Give the file a buffer of `cap` bytes up front (fixed-footprint mode).
+void procfile_reserve(procfile *pf, size_t cap)
+{
+    pf->buf = kml_alloc(cap, pf->path);
+    pf->cap = cap;
+}
+
+// `path` under --root; returns buf.
+static const char *procfile_path(char *buf, size_t size, const char *path)
+{
+    snprintf(buf, size, "%s%s", procfile_root, path);
+    return buf;
+}
+
+// Returns the number of bytes read, or -1 with errno set.
+ssize_t procfile_read(procfile *pf)
+{
+    if (pf->fd < 0) {
+        char path[PROCFILE_PATH_MAX];
+        pf->fd = open(procfile_path(path, sizeof(path), pf->path), O_RDONLY | O_CLOEXEC);
+        if (pf->fd < 0)
+            return -1;
+    }
+    if (!pf->buf) {
+        pf->buf = kml_alloc(PROCFILE_INITIAL_CAP, pf->path);
+        if (!pf->buf)
+            return -1;
+        pf->cap = PROCFILE_INITIAL_CAP;
+    }
+
+    if (lseek(pf->fd, 0, SEEK_SET) < 0)
+        return -1;
+
+    pf->len = 0;
+    for (;;) {
+        if (pf->len + 1 >= pf->cap) {
+            if (fixed_footprint) {
+                fprintf(stderr, "fixed-footprint: %s outgrew its %zu byte buffer; "
+                                "restart with more --headroom\n", pf->path, pf->cap);
+                exit(EXIT_FAILURE);
+            }
+            char *nb = realloc(pf->buf, pf->cap * 2);
+            if (!nb)
+                return -1;
+            pf->buf = nb;
+            pf->cap *= 2;
+        }
+        ssize_t n = read(pf->fd, pf->buf + pf->len, pf->cap - pf->len - 1);
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        pf->len += (size_t)n;
+    }
+    pf->buf[pf->len] = '\0';
+    return (ssize_t)pf->len;
+}
+
+void procfile_close(procfile *pf)
+{
+    if (pf->fd >= 0)
+        close(pf->fd);
+    kml_free(pf->buf);
+    pf->fd = -1;
+    pf->buf = NULL;
+    pf->cap = pf->len = 0;
+}
+
+// A directory listed again and again, like /proc for the process scans.
+// opendir() mallocs a DIR every time; this keeps the fd open from startup
+// and walks it with getdents64() into a buffer taken once, rewinding with
+// lseek() before every walk.
+
+#define PROCDIR_BUF_SIZE 16384
+
+typedef struct
+{
+    int fd;
+    char *buf;
+    size_t pos, len;
+} procdir;
+
+#define PROCDIR_INIT { -1, NULL, 0, 0 }
+
+// linux_dirent64 from getdents64(2)
+struct procdir_entry
+{
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Opens `path` (already under --root, if it should be) and takes the
+// buffer; -1 with errno set. A second call is a no-op.
+int procdir_open(procdir *pd, const char *path)
+{
+    if (pd->fd >= 0)
+        return 0;
+    if (!pd->buf) {
+        pd->buf = kml_alloc(PROCDIR_BUF_SIZE, path);
+        if (!pd->buf)
+            return -1;
+    }
+    pd->fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return pd->fd < 0 ? -1 : 0;
+}
+
+// Back to the first entry; -1 with errno set.
+int procdir_rewind(procdir *pd)
+{
+    pd->pos = pd->len = 0;
+    return lseek(pd->fd, 0, SEEK_SET) < 0 ? -1 : 0;
+}
+
+// Name of the next entry, NULL at the end or on error.
+const char *procdir_next(procdir *pd)
+{
+    if (pd->pos >= pd->len) {
+        long n = syscall(SYS_getdents64, pd->fd, pd->buf, PROCDIR_BUF_SIZE);
+        if (n <= 0)
+            return NULL;
+        pd->pos = 0;
+        pd->len = (size_t)n;
+    }
+    const struct procdir_entry *e = (const struct procdir_entry *)(pd->buf + pd->pos);
+    pd->pos += e->d_reclen;
+    return e->d_name;
+}
+
+void procdir_close(procdir *pd)
+{
+    if (pd->fd >= 0)
+        close(pd->fd);
+    kml_free(pd->buf);
+    pd->fd = -1;
+    pd->buf = NULL;
+    pd->pos = pd->len = 0;
+}
+
+// Advance to the start of the next line; returns NULL at the end.
+static char *procfile_next_line(char *p)
+{
+    char *nl = strchr(p, '\n');
+    return (nl && nl[1]) ? nl + 1 : NULL;
+}
+
+#endif // PROCFILE_H
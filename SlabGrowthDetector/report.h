@@ -0,0 +1,13 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdio.h>
+
+// Everything the detector reports goes through rprintf(). Normally that is
+// stdout; the pipelined mode points report_out at the frame being built so
+// formatting happens off the thread that writes to the terminal.
+static FILE *report_out = NULL;
+
+#define rprintf(...) fprintf(report_out ? report_out : stdout, __VA_ARGS__)
+
+#endif // REPORT_H
@@ -0,0 +1,696 @@
+#ifndef RULES_H
+#define RULES_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "report.h"
+
+// User-defined alert rules (rules.conf or --rules PATH), one per line:
+//
+//     net-steady-growth: bytes_slope > 10MB/h && r2 > 0.8 && group == "net"
+//
+// Each expression is compiled at load time into a stack program. Every
+// cycle the caches are gathered into flat float columns and evaluated in
+// blocks: each instruction runs over a whole block of caches before the
+// next, so the inner loops are straight passes over arrays the compiler
+// vectorizes, four caches per SSE register. `column op number` is fused
+// into one instruction.
+//
+// A compiled rule set is part of the immutable config (config.h): it is
+// rebuilt on reload and never written while the analyzer runs it.
+
+#define RULES_DEFAULT_CONFIG "rules.conf"
+#define RULE_MAX 512
+#define RULE_CODE_MAX 8192
+#define RULE_NAME_LEN 48
+#define RULE_BLOCK 256
+#define RULE_STACK 16
+#define RULE_SHOW 6          // caches named per matching rule
+
+typedef enum
+{
+    RC_ACTIVE_OBJS, RC_NUM_OBJS, RC_OBJSIZE, RC_EMA, RC_GROWTH, RC_MONOTONIC,
+    RC_PAGES_RATE,
+    // owned by leakscore.h
+    RC_BYTES, RC_BYTES_SLOPE, RC_R2, RC_SHARE, RC_SCORE,
+    RC_NCOLS
+} rule_col;
+
+static const char *rule_col_names[RC_NCOLS] = {
+    "active_objs", "num_objs", "objsize", "ema", "growth", "monotonic",
+    "pages_rate",
+    "bytes", "bytes_slope", "r2", "share", "score",
+};
+
+// system-wide values, the same for every cache
+typedef enum
+{
+    RS_FREE_PAGES, RS_UNRECLAIMABLE, RS_PRESSURE, RS_PSI, RS_FRAG, RS_WATERMARK,
+    RS_SYSTEM_FACTOR, RS_COUNT
+} rule_sys_var;
+
+static const char *rule_sys_names[RS_COUNT] = {
+    "free_pages", "unreclaimable", "pressure", "psi", "frag", "watermark", "system_factor",
+};
+
+// Cache groups by name prefix, first match wins.
+typedef enum { RG_OTHER, RG_NET, RG_FS, RG_MM, RG_TASK, RG_KMALLOC, RG_COUNT } rule_group;
+
+static const char *rule_group_names[RG_COUNT] = {
+    "other", "net", "fs", "mm", "task", "kmalloc",
+};
+
+static const struct
+{
+    const char *prefix;
+    rule_group group;
+} rule_group_prefixes[] = {
+    {"kmalloc-", RG_KMALLOC}, {"dma-kmalloc-", RG_KMALLOC}, {"kmalloc-rcl-", RG_KMALLOC},
+    {"kmalloc-cg-", RG_KMALLOC},
+    {"skbuff_", RG_NET}, {"sock_inode_cache", RG_NET}, {"TCP", RG_NET}, {"UDP", RG_NET},
+    {"RAW", RG_NET}, {"PING", RG_NET}, {"UNIX", RG_NET}, {"MPTCP", RG_NET},
+    {"request_sock_", RG_NET}, {"tw_sock_", RG_NET}, {"net_namespace", RG_NET},
+    {"inet_peer", RG_NET}, {"ip_fib_", RG_NET}, {"ip4-frags", RG_NET}, {"ip6", RG_NET},
+    {"fib6_", RG_NET}, {"nf_conntrack", RG_NET}, {"xfrm_", RG_NET}, {"netlink_", RG_NET},
+    {"dentry", RG_FS}, {"inode_cache", RG_FS}, {"filp", RG_FS}, {"buffer_head", RG_FS},
+    {"names_cache", RG_FS}, {"mnt_cache", RG_FS}, {"kernfs_", RG_FS}, {"ext4_", RG_FS},
+    {"xfs_", RG_FS}, {"btrfs_", RG_FS}, {"fuse_", RG_FS}, {"proc_inode_cache", RG_FS},
+    {"shmem_inode_cache", RG_FS}, {"bio", RG_FS}, {"dquot", RG_FS},
+    {"vm_area_struct", RG_MM}, {"anon_vma", RG_MM}, {"mm_struct", RG_MM},
+    {"pgtable", RG_MM}, {"pgd_cache", RG_MM}, {"pmd_cache", RG_MM}, {"page->ptl", RG_MM},
+    {"radix_tree_node", RG_MM}, {"maple_node", RG_MM}, {"vmap_area", RG_MM},
+    {"task_struct", RG_TASK}, {"cred_jar", RG_TASK}, {"pid", RG_TASK},
+    {"files_cache", RG_TASK}, {"signal_cache", RG_TASK}, {"sighand_cache", RG_TASK},
+    {"fs_cache", RG_TASK}, {"nsproxy", RG_TASK}, {"task_delay_info", RG_TASK},
+};
+
+typedef enum
+{
+    OP_COL, OP_CONST, OP_SYS, OP_GROUP_EQ, OP_GROUP_NE,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_NEG,
+    OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+    OP_AND, OP_OR, OP_NOT,
+    // column <cmp> constant, fused by the compiler
+    OP_COLK_LT, OP_COLK_LE, OP_COLK_GT, OP_COLK_GE, OP_COLK_EQ, OP_COLK_NE,
+} rule_op;
+
+typedef struct
+{
+    unsigned char op;
+    unsigned char arg;      // column, system value or group
+    float k;
+} rule_insn;
+
+typedef struct
+{
+    char name[RULE_NAME_LEN];
+    int start, len;         // in code[]
+} rule_def;
+
+typedef struct
+{
+    rule_def rule[RULE_MAX];
+    int count;
+    rule_insn code[RULE_CODE_MAX];
+    int code_len;
+} rule_set;
+
+// per-cycle results, indexed like rule_set.rule
+static int rule_matched[RULE_MAX];
+static int rule_shown[RULE_MAX][RULE_SHOW];
+
+// per-cache columns gathered every cycle, indexed by slabinfo.idx
+static float rc_col[RC_NCOLS][MAX_SLABS];
+static unsigned char rc_group[MAX_SLABS];
+static unsigned char rc_group_known[MAX_SLABS];
+static unsigned char rc_live[MAX_SLABS];
+static const char *rc_name[MAX_SLABS];
+
+static float rule_sys[RS_COUNT];
+
+static float rule_stack[RULE_STACK][RULE_BLOCK];
+
+/* ---------------------------------------------------------------- */
+/* compiler                                                          */
+/* ---------------------------------------------------------------- */
+
+typedef struct
+{
+    const char *p;
+    const char *err;
+    int depth, max_depth;
+    rule_set *set;
+} rule_parser;
+
+static void rp_skip(rule_parser *ps)
+{
+    while (*ps->p == ' ' || *ps->p == '\t')
+        ps->p++;
+}
+
+static int rp_accept(rule_parser *ps, const char *tok)
+{
+    rp_skip(ps);
+    size_t n = strlen(tok);
+    if (strncmp(ps->p, tok, n) != 0)
+        return 0;
+    ps->p += n;
+    return 1;
+}
+
+static void rp_emit(rule_parser *ps, rule_op op, int arg, double k, int push)
+{
+    if (ps->err)
+        return;
+    rule_set *set = ps->set;
+    if (set->code_len == RULE_CODE_MAX) {
+        ps->err = "rule program space used up";
+        return;
+    }
+    set->code[set->code_len++] = (rule_insn){(unsigned char)op, (unsigned char)arg, (float)k};
+    ps->depth += push;
+    if (ps->depth > ps->max_depth)
+        ps->max_depth = ps->depth;
+}
+
+// Binary comparison; `col op const` becomes one fused instruction.
+static void rp_emit_cmp(rule_parser *ps, rule_op op)
+{
+    rule_set *set = ps->set;
+    rule_insn *a = set->code + set->code_len - 2;
+    if (!ps->err && set->code_len >= 2 && a[0].op == OP_COL && a[1].op == OP_CONST) {
+        a[0].op = (unsigned char)(OP_COLK_LT + (op - OP_LT));
+        a[0].k = a[1].k;
+        set->code_len--;
+        ps->depth--;
+        return;
+    }
+    rp_emit(ps, op, 0, 0.0, -1);
+}
+
+// "10MB/h" -> bytes per hour; rates are per hour, sizes in bytes, "%" is
+// decoration ("growth > 5%").
+static double rp_number(rule_parser *ps)
+{
+    char *end;
+    double v = strtod(ps->p, &end);
+    ps->p = end;
+    static const struct { const char *unit; double mul; } units[] = {
+        {"GB", 1024.0 * 1024 * 1024}, {"MB", 1024.0 * 1024}, {"KB", 1024.0},
+        {"G", 1024.0 * 1024 * 1024}, {"M", 1024.0 * 1024}, {"K", 1024.0}, {"%", 1.0},
+    };
+    for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+        size_t n = strlen(units[i].unit);
+        if (strncmp(ps->p, units[i].unit, n) == 0) {
+            v *= units[i].mul;
+            ps->p += n;
+            break;
+        }
+    }
+    static const struct { const char *unit; double mul; } rates[] = {
+        {"/h", 1.0}, {"/min", 60.0}, {"/s", 3600.0},
+    };
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        size_t n = strlen(rates[i].unit);
+        if (strncmp(ps->p, rates[i].unit, n) == 0 && !isalnum((unsigned char)ps->p[n]) &&
+            ps->p[n] != '_') {
+            v *= rates[i].mul;
+            ps->p += n;
+            break;
+        }
+    }
+    if (isalpha((unsigned char)*ps->p))
+        ps->err = "unknown unit";
+    return v;
+}
+
+static void rp_or(rule_parser *ps);
+
+static void rp_group(rule_parser *ps)
+{
+    rule_op op;
+    if (rp_accept(ps, "=="))
+        op = OP_GROUP_EQ;
+    else if (rp_accept(ps, "!="))
+        op = OP_GROUP_NE;
+    else {
+        ps->err = "group compares with == or != \"name\"";
+        return;
+    }
+    rp_skip(ps);
+    if (*ps->p != '"') {
+        ps->err = "expected a quoted group name";
+        return;
+    }
+    const char *s = ++ps->p;
+    while (*ps->p && *ps->p != '"')
+        ps->p++;
+    if (*ps->p != '"') {
+        ps->err = "unterminated string";
+        return;
+    }
+    size_t n = (size_t)(ps->p++ - s);
+    for (int g = 0; g < RG_COUNT; g++) {
+        if (strlen(rule_group_names[g]) == n && strncmp(s, rule_group_names[g], n) == 0) {
+            rp_emit(ps, op, g, 0.0, 1);
+            return;
+        }
+    }
+    ps->err = "unknown group (net, fs, mm, task, kmalloc, other)";
+}
+
+static void rp_primary(rule_parser *ps)
+{
+    rp_skip(ps);
+    if (rp_accept(ps, "(")) {
+        rp_or(ps);
+        if (!ps->err && !rp_accept(ps, ")"))
+            ps->err = "expected ')'";
+        return;
+    }
+    if (isdigit((unsigned char)*ps->p) || *ps->p == '.') {
+        double v = rp_number(ps);
+        rp_emit(ps, OP_CONST, 0, v, 1);
+        return;
+    }
+    if (isalpha((unsigned char)*ps->p) || *ps->p == '_') {
+        const char *s = ps->p;
+        while (isalnum((unsigned char)*ps->p) || *ps->p == '_')
+            ps->p++;
+        size_t n = (size_t)(ps->p - s);
+        if (n == 5 && strncmp(s, "group", 5) == 0) {
+            rp_group(ps);
+            return;
+        }
+        for (int c = 0; c < RC_NCOLS; c++) {
+            if (strlen(rule_col_names[c]) == n && strncmp(s, rule_col_names[c], n) == 0) {
+                rp_emit(ps, OP_COL, c, 0.0, 1);
+                return;
+            }
+        }
+        for (int v = 0; v < RS_COUNT; v++) {
+            if (strlen(rule_sys_names[v]) == n && strncmp(s, rule_sys_names[v], n) == 0) {
+                rp_emit(ps, OP_SYS, v, 0.0, 1);
+                return;
+            }
+        }
+        ps->p = s;
+        ps->err = "unknown variable";
+        return;
+    }
+    ps->err = "expected a number, variable or '('";
+}
+
+static void rp_unary(rule_parser *ps)
+{
+    if (rp_accept(ps, "-")) {
+        rp_unary(ps);
+        // an operand ending in a constant is that constant
+        rule_insn *last = ps->set->code + ps->set->code_len - 1;
+        if (!ps->err && last->op == OP_CONST)
+            last->k = -last->k;
+        else
+            rp_emit(ps, OP_NEG, 0, 0.0, 0);
+    } else if (rp_accept(ps, "!")) {
+        rp_unary(ps);
+        rp_emit(ps, OP_NOT, 0, 0.0, 0);
+    } else {
+        rp_primary(ps);
+    }
+}
+
+static void rp_mul(rule_parser *ps)
+{
+    rp_unary(ps);
+    while (!ps->err) {
+        if (rp_accept(ps, "*")) {
+            rp_unary(ps);
+            rp_emit(ps, OP_MUL, 0, 0.0, -1);
+        } else if (rp_accept(ps, "/")) {
+            rp_unary(ps);
+            rp_emit(ps, OP_DIV, 0, 0.0, -1);
+        } else {
+            break;
+        }
+    }
+}
+
+static void rp_add(rule_parser *ps)
+{
+    rp_mul(ps);
+    while (!ps->err) {
+        if (rp_accept(ps, "+")) {
+            rp_mul(ps);
+            rp_emit(ps, OP_ADD, 0, 0.0, -1);
+        } else if (rp_accept(ps, "-")) {
+            rp_mul(ps);
+            rp_emit(ps, OP_SUB, 0, 0.0, -1);
+        } else {
+            break;
+        }
+    }
+}
+
+static void rp_cmp(rule_parser *ps)
+{
+    static const struct { const char *tok; rule_op op; } cmps[] = {
+        {"<=", OP_LE}, {">=", OP_GE}, {"==", OP_EQ}, {"!=", OP_NE}, {"<", OP_LT}, {">", OP_GT},
+    };
+    rp_add(ps);
+    for (size_t i = 0; !ps->err && i < sizeof(cmps) / sizeof(cmps[0]); i++) {
+        if (rp_accept(ps, cmps[i].tok)) {
+            rp_add(ps);
+            rp_emit_cmp(ps, cmps[i].op);
+            return;
+        }
+    }
+}
+
+static void rp_and(rule_parser *ps)
+{
+    rp_cmp(ps);
+    while (!ps->err && rp_accept(ps, "&&")) {
+        rp_cmp(ps);
+        rp_emit(ps, OP_AND, 0, 0.0, -1);
+    }
+}
+
+static void rp_or(rule_parser *ps)
+{
+    rp_and(ps);
+    while (!ps->err && rp_accept(ps, "||")) {
+        rp_and(ps);
+        rp_emit(ps, OP_OR, 0, 0.0, -1);
+    }
+}
+
+// Compile one expression into the program space; NULL or an error message.
+static const char *rule_compile(rule_set *set, rule_def *r, const char *expr, const char **where)
+{
+    rule_parser ps = {expr, NULL, 0, 0, set};
+    int start = set->code_len;
+    rp_or(&ps);
+    rp_skip(&ps);
+    if (!ps.err && *ps.p)
+        ps.err = "unexpected text";
+    if (!ps.err && ps.max_depth > RULE_STACK)
+        ps.err = "expression nests too deep";
+    if (ps.err) {
+        set->code_len = start;
+        *where = ps.p;
+        return ps.err;
+    }
+    r->start = start;
+    r->len = set->code_len - start;
+    return NULL;
+}
+
+// "name: expression" lines, '#' starts a comment. Rules that do not
+// compile are reported and skipped. Replaces the contents of *set.
+int load_rules(const char *path, rule_set *set)
+{
+    set->count = 0;
+    set->code_len = 0;
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+
+    char line[1024];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *colon = strchr(line, ':');
+        char *name = line;
+        while (*name == ' ' || *name == '\t')
+            name++;
+        if (!*name)
+            continue;
+        if (!colon) {
+            fprintf(stderr, "%s:%d: expected 'name: expression'\n", path, lineno);
+            continue;
+        }
+        char *name_end = colon;
+        while (name_end > name && (name_end[-1] == ' ' || name_end[-1] == '\t'))
+            name_end--;
+        *name_end = '\0';
+        if (set->count == RULE_MAX) {
+            fprintf(stderr, "%s:%d: more than %d rules, ignoring the rest\n", path, lineno, RULE_MAX);
+            break;
+        }
+
+        rule_def *r = &set->rule[set->count];
+        memset(r, 0, sizeof(*r));
+        if (strlen(name) > RULE_NAME_LEN - 1)
+            fprintf(stderr, "%s:%d: rule name '%s' cut to %d characters\n",
+                    path, lineno, name, RULE_NAME_LEN - 1);
+        snprintf(r->name, sizeof(r->name), "%.*s", RULE_NAME_LEN - 1, name);
+        const char *where;
+        const char *err = rule_compile(set, r, colon + 1, &where);
+        if (err) {
+            fprintf(stderr, "%s:%d: rule '%s': %s at '%.20s'\n", path, lineno, r->name, err, where);
+            continue;
+        }
+        set->count++;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/* ---------------------------------------------------------------- */
+/* evaluator                                                         */
+/* ---------------------------------------------------------------- */
+
+static rule_group rule_group_of(const char *name)
+{
+    for (size_t i = 0; i < sizeof(rule_group_prefixes) / sizeof(rule_group_prefixes[0]); i++) {
+        const char *pre = rule_group_prefixes[i].prefix;
+        if (strncmp(name, pre, strlen(pre)) == 0)
+            return rule_group_prefixes[i].group;
+    }
+    // filesystem inode caches are "<fs>_inode_cache"
+    return strstr(name, "_inode_cache") ? RG_FS : RG_OTHER;
+}
+
+// One kernel per instruction, each over a whole block. The fixed trip
+// count and the restrict parameters are what let -O2 vectorize them: no
+// epilogue, no runtime alias checks. Lanes past the last cache are
+// computed and ignored. Results are 0/1 selects rather than branches.
+#if MAX_SLABS % RULE_BLOCK
+#error "MAX_SLABS must be a multiple of RULE_BLOCK"
+#endif
+
+#define RULE_COL_KERNEL(name, expr) \
+    static inline void name(float *restrict x, const float *restrict c, float k) \
+    { \
+        for (int i = 0; i < RULE_BLOCK; i++) \
+            x[i] = (expr); \
+    }
+
+#define RULE_BIN_KERNEL(name, expr) \
+    static inline void name(float *restrict x, const float *restrict y) \
+    { \
+        for (int i = 0; i < RULE_BLOCK; i++) \
+            x[i] = (expr); \
+    }
+
+RULE_COL_KERNEL(rk_lt_k, c[i] < k)
+RULE_COL_KERNEL(rk_le_k, c[i] <= k)
+RULE_COL_KERNEL(rk_gt_k, c[i] > k)
+RULE_COL_KERNEL(rk_ge_k, c[i] >= k)
+RULE_COL_KERNEL(rk_eq_k, c[i] == k)
+RULE_COL_KERNEL(rk_ne_k, c[i] != k)
+RULE_BIN_KERNEL(rk_add, x[i] + y[i])
+RULE_BIN_KERNEL(rk_sub, x[i] - y[i])
+RULE_BIN_KERNEL(rk_mul, x[i] * y[i])
+RULE_BIN_KERNEL(rk_lt, x[i] < y[i])
+RULE_BIN_KERNEL(rk_le, x[i] <= y[i])
+RULE_BIN_KERNEL(rk_gt, x[i] > y[i])
+RULE_BIN_KERNEL(rk_ge, x[i] >= y[i])
+RULE_BIN_KERNEL(rk_eq, x[i] == y[i])
+RULE_BIN_KERNEL(rk_ne, x[i] != y[i])
+
+static inline void rk_div(float *restrict x, const float *restrict y)
+{
+    for (int i = 0; i < RULE_BLOCK; i++) {
+        float nz = y[i] != 0.0f;
+        x[i] = x[i] / (y[i] + (1.0f - nz)) * nz;    // x / 0 is 0
+    }
+}
+
+static inline void rk_and(float *restrict x, const float *restrict y)
+{
+    for (int i = 0; i < RULE_BLOCK; i++) {
+        float t = y[i] != 0.0f;
+        x[i] = x[i] != 0.0f ? t : 0.0f;
+    }
+}
+
+static inline void rk_or(float *restrict x, const float *restrict y)
+{
+    for (int i = 0; i < RULE_BLOCK; i++) {
+        float t = y[i] != 0.0f;
+        x[i] = x[i] != 0.0f ? 1.0f : t;
+    }
+}
+
+static inline void rk_group(float *restrict x, const unsigned char *restrict g, int group, int eq)
+{
+    for (int i = 0; i < RULE_BLOCK; i++)
+        x[i] = (g[i] == group) == eq;
+}
+
+static inline void rk_load(float *restrict x, const float *restrict c)
+{
+    for (int i = 0; i < RULE_BLOCK; i++)
+        x[i] = c[i];
+}
+
+static inline void rk_fill(float *restrict x, float k)
+{
+    for (int i = 0; i < RULE_BLOCK; i++)
+        x[i] = k;
+}
+
+static inline void rk_neg(float *restrict x)
+{
+    for (int i = 0; i < RULE_BLOCK; i++)
+        x[i] = -x[i];
+}
+
+static inline void rk_not(float *restrict x)
+{
+    for (int i = 0; i < RULE_BLOCK; i++)
+        x[i] = x[i] == 0.0f;
+}
+
+// Run one program over the caches of block [b, b + RULE_BLOCK); the
+// result lands in rule_stack[0].
+static void rule_run(const rule_insn *code, int ncode, int b)
+{
+    int sp = -1;
+    for (const rule_insn *in = code; in < code + ncode; in++) {
+        const float *col = rc_col[in->arg] + b;
+        float *top = rule_stack[sp < 0 ? 0 : sp];
+        float *push = rule_stack[sp + 1];
+        switch ((rule_op)in->op) {
+        case OP_COL:      rk_load(push, col); sp++; break;
+        case OP_CONST:    rk_fill(push, in->k); sp++; break;
+        case OP_SYS:      rk_fill(push, rule_sys[in->arg]); sp++; break;
+        case OP_GROUP_EQ: rk_group(push, rc_group + b, in->arg, 1); sp++; break;
+        case OP_GROUP_NE: rk_group(push, rc_group + b, in->arg, 0); sp++; break;
+        case OP_COLK_LT:  rk_lt_k(push, col, in->k); sp++; break;
+        case OP_COLK_LE:  rk_le_k(push, col, in->k); sp++; break;
+        case OP_COLK_GT:  rk_gt_k(push, col, in->k); sp++; break;
+        case OP_COLK_GE:  rk_ge_k(push, col, in->k); sp++; break;
+        case OP_COLK_EQ:  rk_eq_k(push, col, in->k); sp++; break;
+        case OP_COLK_NE:  rk_ne_k(push, col, in->k); sp++; break;
+        case OP_NEG:      rk_neg(top); break;
+        case OP_NOT:      rk_not(top); break;
+        default:          // binary: the two topmost into the lower one
+            sp--;
+            switch ((rule_op)in->op) {
+            case OP_ADD: rk_add(rule_stack[sp], top); break;
+            case OP_SUB: rk_sub(rule_stack[sp], top); break;
+            case OP_MUL: rk_mul(rule_stack[sp], top); break;
+            case OP_DIV: rk_div(rule_stack[sp], top); break;
+            case OP_LT:  rk_lt(rule_stack[sp], top); break;
+            case OP_LE:  rk_le(rule_stack[sp], top); break;
+            case OP_GT:  rk_gt(rule_stack[sp], top); break;
+            case OP_GE:  rk_ge(rule_stack[sp], top); break;
+            case OP_EQ:  rk_eq(rule_stack[sp], top); break;
+            case OP_NE:  rk_ne(rule_stack[sp], top); break;
+            case OP_AND: rk_and(rule_stack[sp], top); break;
+            case OP_OR:  rk_or(rule_stack[sp], top); break;
+            default: break;
+            }
+        }
+    }
+}
+
+// Run once per cycle after update_leak_scores().
+void evaluate_rules(const rule_set *set)
+{
+    if (!set->count)
+        return;
+
+    // gather the list into the rule columns
+    int n = 0;
+    memset(rc_live, 0, sizeof(rc_live));
+    list *cur = get_slab_list_head();
+    while (cur) {
+        slabinfo *s = cur->slab;
+        int i = s->idx;
+        if (i >= 0) {
+            rc_col[RC_ACTIVE_OBJS][i] = (float)s->active_objs;
+            rc_col[RC_NUM_OBJS][i] = (float)s->num_objs;
+            rc_col[RC_OBJSIZE][i] = (float)s->objsize;
+            rc_col[RC_EMA][i] = (float)s->ema;
+            rc_col[RC_GROWTH][i] = s->growth;
+            rc_col[RC_MONOTONIC][i] = (float)s->monotonic_count;
+            rc_col[RC_PAGES_RATE][i] = (float)(s->slab_pages_per_sec * 3600.0);
+            rc_col[RC_BYTES][i] = (float)sc_bytes[i];
+            rc_col[RC_BYTES_SLOPE][i] = (float)sc_slope[i];
+            rc_col[RC_R2][i] = (float)sc_r2[i];
+            rc_col[RC_SHARE][i] = (float)sc_share[i];
+            rc_col[RC_SCORE][i] = (float)sc_score[i];
+            rc_name[i] = s->name;
+            rc_live[i] = 1;
+            if (!rc_group_known[i]) {   // a slot keeps its cache for life
+                rc_group[i] = (unsigned char)rule_group_of(s->name);
+                rc_group_known[i] = 1;
+            }
+            if (i >= n)
+                n = i + 1;
+        }
+        cur = cur->next;
+    }
+
+    rule_sys[RS_FREE_PAGES] = (float)get_vmstat("nr_free_pages");
+    rule_sys[RS_UNRECLAIMABLE] = (float)get_vmstat("nr_slab_unreclaimable");
+    rule_sys[RS_PRESSURE] = (float)score_sys.pressure;
+    rule_sys[RS_PSI] = (float)score_sys.psi;
+    rule_sys[RS_FRAG] = (float)score_sys.frag;
+    rule_sys[RS_WATERMARK] = (float)score_sys.watermark;
+    rule_sys[RS_SYSTEM_FACTOR] = (float)score_sys.system_factor;
+
+    memset(rule_matched, 0, sizeof(rule_matched[0]) * set->count);
+
+    // block by block, every rule over the block while its columns are hot
+    for (int b = 0; b < n; b += RULE_BLOCK) {
+        const unsigned char *live = rc_live + b;
+        for (int r = 0; r < set->count; r++) {
+            const rule_def *rd = &set->rule[r];
+            rule_run(set->code + rd->start, rd->len, b);
+            const float *hit = rule_stack[0];
+            for (int i = 0; i < RULE_BLOCK && b + i < n; i++) {
+                if (hit[i] != 0.0f && live[i]) {
+                    if (rule_matched[r] < RULE_SHOW)
+                        rule_shown[r][rule_matched[r]] = b + i;
+                    rule_matched[r]++;
+                }
+            }
+        }
+    }
+
+    for (int r = 0; r < set->count; r++) {
+        int matched = rule_matched[r];
+        if (!matched)
+            continue;
+        rprintf("\033[1;33m[RULE %s] %d cache%s:", set->rule[r].name, matched, matched == 1 ? "" : "s");
+        for (int i = 0; i < matched && i < RULE_SHOW; i++)
+            rprintf(" %s", rc_name[rule_shown[r][i]]);
+        if (matched > RULE_SHOW)
+            rprintf(" (+%d more)", matched - RULE_SHOW);
+        rprintf("\033[0m\n");
+    }
+}
+
+#endif // RULES_H
@@ -0,0 +1,262 @@
+#ifndef SELFPROF_H
+#define SELFPROF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "report.h"
+
+// Self-overhead instrumentation. Every pipeline phase records wall time,
+// thread CPU time and, when perf_event_open is allowed, the instructions
+// and cache misses it cost into HDR-style histograms. Export is the write
+// of a finished cycle to stdout.
+//
+// Each phase runs on one thread only (read and parse on the collector,
+// analyze and render on the analyzer, export on the renderer with
+// --pipeline), so its slot has a single writer. The live line is printed
+// by the analyzer and reads the other stages' slots while they run: the
+// values it reads are atomics, the histograms are read once the stages
+// have been joined.
+
+typedef enum
+{
+    PHASE_READ,
+    PHASE_PARSE,
+    PHASE_ANALYZE,
+    PHASE_RENDER,
+    PHASE_EXPORT,
+    PHASE_COUNT
+} prof_phase;
+
+typedef enum
+{
+    METRIC_WALL_NS,
+    METRIC_CPU_NS,
+    METRIC_INSTRUCTIONS,
+    METRIC_CACHE_MISSES,
+    METRIC_COUNT
+} prof_metric;
+
+static const char *prof_phase_names[PHASE_COUNT] = {
+    "read", "parse", "analyze", "render", "export"
+};
+
+// Log-linear histogram: one row per power of two, HDR_SUB buckets inside
+// each row, so every recorded value keeps ~3% relative precision.
+#define HDR_SUB_BITS 5
+#define HDR_SUB (1 << HDR_SUB_BITS)
+#define HDR_ROWS (64 - HDR_SUB_BITS + 1)
+
+typedef struct
+{
+    uint32_t counts[HDR_ROWS][HDR_SUB];
+    uint64_t total;
+    uint64_t max;
+    double sum;
+} hdr_hist;
+
+static int hdr_row(uint64_t v)
+{
+    if (v < HDR_SUB)
+        return 0;
+    return 63 - __builtin_clzll(v) - HDR_SUB_BITS + 1;
+}
+
+void hdr_record(hdr_hist *h, uint64_t v)
+{
+    int row = hdr_row(v);
+    // rows above 0 hold [HDR_SUB, 2*HDR_SUB) << (row - 1)
+    int sub = row == 0 ? (int)v : (int)(v >> (row - 1)) - HDR_SUB;
+    h->counts[row][sub]++;
+    h->total++;
+    h->sum += (double)v;
+    if (v > h->max)
+        h->max = v;
+}
+
+// Value at quantile q (0..1), reported as the upper edge of its bucket.
+uint64_t hdr_quantile(const hdr_hist *h, double q)
+{
+    if (h->total == 0)
+        return 0;
+    uint64_t want = (uint64_t)(q * (double)h->total);
+    if (want >= h->total)
+        want = h->total - 1;
+
+    uint64_t seen = 0;
+    for (int row = 0; row < HDR_ROWS; row++) {
+        for (int sub = 0; sub < HDR_SUB; sub++) {
+            seen += h->counts[row][sub];
+            if (seen > want) {
+                uint64_t edge = row == 0 ? (uint64_t)sub
+                                         : (uint64_t)(sub + HDR_SUB + 1) << (row - 1);
+                return edge < h->max ? edge : h->max;
+            }
+        }
+    }
+    return h->max;
+}
+
+typedef struct
+{
+    struct timespec wall0, cpu0;
+    uint64_t pmu0[2];
+    uint64_t last[METRIC_COUNT]; // most recent sample, for the live line (atomic)
+    uint64_t cycles;             // samples recorded so far (atomic)
+    hdr_hist hist[METRIC_COUNT];
+} prof_slot;
+
+static prof_slot prof_slots[PHASE_COUNT];
+static int prof_enabled = 1;
+static int prof_live = 0;        // --self-stats: print a line every cycle
+// counters belong to the thread that opened them, so each pipeline stage
+// calls init_self_profiling() for its own
+static __thread int prof_group_fd = -1;   // instructions; cache misses are in its group
+static __thread int prof_miss_fd = -1;
+
+static long prof_perf_open(struct perf_event_attr *attr, int group_fd)
+{
+    // pid 0, cpu -1: this thread on any CPU
+    return syscall(__NR_perf_event_open, attr, 0, -1, group_fd, 0);
+}
+
+// Counters are optional: perf_event_paranoid or seccomp may refuse them.
+void init_self_profiling(void)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = 1;
+    attr.exclude_hv = 1;
+
+    // count the kernel side of the /proc reads when permitted
+    prof_group_fd = (int)prof_perf_open(&attr, -1);
+    if (prof_group_fd < 0) {
+        attr.exclude_kernel = 1;
+        prof_group_fd = (int)prof_perf_open(&attr, -1);
+    }
+    if (prof_group_fd < 0)
+        return;
+
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 0;
+    prof_miss_fd = (int)prof_perf_open(&attr, prof_group_fd);
+
+    ioctl(prof_group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(prof_group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+static void prof_read_pmu(uint64_t out[2])
+{
+    out[0] = out[1] = 0;
+    if (prof_group_fd < 0)
+        return;
+    uint64_t buf[3] = {0}; // nr, instructions, cache misses
+    if (read(prof_group_fd, buf, sizeof(buf)) > 0) {
+        out[0] = buf[1];
+        out[1] = buf[0] > 1 ? buf[2] : 0;
+    }
+}
+
+static uint64_t prof_ns(const struct timespec *a, const struct timespec *b)
+{
+    return (uint64_t)((b->tv_sec - a->tv_sec) * 1000000000LL + (b->tv_nsec - a->tv_nsec));
+}
+
+void prof_begin(prof_phase p)
+{
+    if (!prof_enabled)
+        return;
+    prof_slot *s = &prof_slots[p];
+    prof_read_pmu(s->pmu0);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &s->cpu0);
+    clock_gettime(CLOCK_MONOTONIC, &s->wall0);
+}
+
+void prof_end(prof_phase p)
+{
+    if (!prof_enabled)
+        return;
+    prof_slot *s = &prof_slots[p];
+    struct timespec wall1, cpu1;
+    uint64_t pmu1[2];
+    clock_gettime(CLOCK_MONOTONIC, &wall1);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu1);
+    prof_read_pmu(pmu1);
+
+    uint64_t v[METRIC_COUNT];
+    v[METRIC_WALL_NS] = prof_ns(&s->wall0, &wall1);
+    v[METRIC_CPU_NS] = prof_ns(&s->cpu0, &cpu1);
+    v[METRIC_INSTRUCTIONS] = pmu1[0] - s->pmu0[0];
+    v[METRIC_CACHE_MISSES] = pmu1[1] - s->pmu0[1];
+    for (int m = 0; m < METRIC_COUNT; m++) {
+        hdr_record(&s->hist[m], v[m]);
+        __atomic_store_n(&s->last[m], v[m], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&s->cycles, s->cycles + 1, __ATOMIC_RELEASE);
+}
+
+// one line per cycle when --self-stats is set
+void show_self_stats_live(void)
+{
+    if (!prof_live)
+        return;
+    rprintf("[SELF]");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        prof_slot *s = &prof_slots[p];
+        if (__atomic_load_n(&s->cycles, __ATOMIC_ACQUIRE) == 0)
+            continue;
+        rprintf(" %s=%.0fus/%.0fus", prof_phase_names[p],
+                __atomic_load_n(&s->last[METRIC_WALL_NS], __ATOMIC_RELAXED) / 1e3,
+                __atomic_load_n(&s->last[METRIC_CPU_NS], __ATOMIC_RELAXED) / 1e3);
+        if (prof_group_fd >= 0)
+            rprintf("/%llukinsn", (unsigned long long)__atomic_load_n(
+                        &s->last[METRIC_INSTRUCTIONS], __ATOMIC_RELAXED) / 1000);
+    }
+    rprintf(" (wall/cpu)\n");
+}
+
+void show_self_report(void)
+{
+    if (!prof_enabled)
+        return;
+    rprintf("\n--- Self Overhead (p50 / p99 / max) ---\n");
+    rprintf("%-8s %7s %26s %26s", "phase", "cycles", "wall us", "cpu us");
+    if (prof_group_fd >= 0)
+        rprintf(" %26s %20s", "instructions (k)", "cache misses");
+    rprintf("\n");
+
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        const hdr_hist *h = prof_slots[p].hist;
+        if (h[METRIC_WALL_NS].total == 0)
+            continue;
+        rprintf("%-8s %7llu", prof_phase_names[p], (unsigned long long)h[METRIC_WALL_NS].total);
+        for (int m = METRIC_WALL_NS; m <= METRIC_CPU_NS; m++)
+            rprintf("   %7.1f / %7.1f / %7.1f",
+                    hdr_quantile(&h[m], 0.50) / 1e3, hdr_quantile(&h[m], 0.99) / 1e3,
+                    h[m].max / 1e3);
+        if (prof_group_fd >= 0) {
+            rprintf("   %7.0f / %7.0f / %7.0f",
+                    hdr_quantile(&h[METRIC_INSTRUCTIONS], 0.50) / 1e3,
+                    hdr_quantile(&h[METRIC_INSTRUCTIONS], 0.99) / 1e3,
+                    h[METRIC_INSTRUCTIONS].max / 1e3);
+            rprintf("   %5llu / %5llu / %5llu",
+                    (unsigned long long)hdr_quantile(&h[METRIC_CACHE_MISSES], 0.50),
+                    (unsigned long long)hdr_quantile(&h[METRIC_CACHE_MISSES], 0.99),
+                    (unsigned long long)h[METRIC_CACHE_MISSES].max);
+        }
+        rprintf("\n");
+    }
+    if (prof_group_fd < 0)
+        rprintf("(perf_event_open unavailable: instruction and cache-miss counters off)\n");
+}
+
+#endif // SELFPROF_H
@@ -8,12 +8,14 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include "procfile.h"
+#include "report.h"
 
 // file to parse slab allocator info
 #define FILE_SLABINFO "/proc/slabinfo"
 #define MAX_NAME_LEN 64
-// define 5 seconds for now later it can be changed based our needs
-#define INTERVAL 5
 #define MAX_SLABS 1024
 #define LINE_BUFFER 256
 
@@ -30,14 +32,79 @@ typedef struct
     size_t objsize;            // size of each object in bytes
     unsigned int objperslab;   // objects per slab
     unsigned int pagesperslab; // pages per slab
+    unsigned int limit;        // tunables (SLAB only, 0 on SLUB)
+    unsigned int batchcount;
+    unsigned int sharedfactor;
+    unsigned int active_slabs; // slabdata
+    unsigned int num_slabs;
+    unsigned int sharedavail;
 
     double ema;
     unsigned int prev_active_objs;
     int monotonic_count;
     float growth;
     unsigned int baseline_active_objs;  // Starting point for long-term analysis
+    int idx;                            // column slot for the scoring stage, -1 if none
+    unsigned int prev_num_slabs;
+    double slab_pages_per_sec;          // net slab pages gained (+) or released (-)
+    unsigned int cpu_held_objs;         // in CPU-owned slabs (slubcpu.h), 0 if not watched
+    unsigned int prev_cpu_held_objs;
+    unsigned char stale;                // row not re-read this cycle (slabsource.h hybrid mode)
+    unsigned int stale_cycles;          // cycles since the row was last re-read
+    unsigned int span;                  // cycles the last change covers, 1 unless it was stale
 } slabinfo;
 
+// Objects the trend engine follows: active minus those sitting in slabs a
+// CPU owns, whose count swings with CPU activity rather than real usage.
+static inline unsigned int slab_trend_objs(const slabinfo *s)
+{
+    return s->active_objs - s->cpu_held_objs;
+}
+
+static inline unsigned int slab_prev_trend_objs(const slabinfo *s)
+{
+    return s->prev_active_objs > s->prev_cpu_held_objs
+               ? s->prev_active_objs - s->prev_cpu_held_objs : 0;
+}
+
+// A stale cache holds its trend state; the change seen when it is read
+// again is spread over the cycles it was not.
+static inline unsigned int slab_span(const slabinfo *s)
+{
+    return s->span > 1 ? s->span : 1;
+}
+
+// Which slabinfo field each whitespace-separated token of a data line
+// holds. Built once from the "# name <active_objs> ..." header so the
+// tokenizer follows whatever layout the running kernel prints.
+typedef enum
+{
+    SCOL_SKIP,          // ":", "tunables", "slabdata" or a column we don't know
+    SCOL_NAME,
+    SCOL_ACTIVE_OBJS,
+    SCOL_NUM_OBJS,
+    SCOL_OBJSIZE,
+    SCOL_OBJPERSLAB,
+    SCOL_PAGESPERSLAB,
+    SCOL_LIMIT,
+    SCOL_BATCHCOUNT,
+    SCOL_SHAREDFACTOR,
+    SCOL_ACTIVE_SLABS,
+    SCOL_NUM_SLABS,
+    SCOL_SHAREDAVAIL,
+} slab_col;
+
+#define SLAB_MAX_COLS 32
+// the columns the trend analysis cannot do without
+#define SLAB_REQUIRED_COLS ((1u << SCOL_NAME) | (1u << SCOL_ACTIVE_OBJS) | (1u << SCOL_NUM_OBJS) | \
+                            (1u << SCOL_OBJSIZE) | (1u << SCOL_OBJPERSLAB) | (1u << SCOL_PAGESPERSLAB))
+
+typedef struct
+{
+    int ncols;
+    unsigned char col[SLAB_MAX_COLS];
+} slab_plan;
+
 typedef struct
 {
     int active_objs_diff; // number of active object difference
@@ -61,6 +128,8 @@ void list_remove(slabinfo target);
 void list_del(void);
 int list_cnt(void);
 void init_slab_list();
+int read_slabinfo(void);
+void parse_slabinfo_buffer(void);
 void parse_slabinfo(void);
 
 //exposing head pointer
@@ -69,6 +138,20 @@ list *get_slab_list_head(void);
 //global head pointer and list size tracker
 static list* head = NULL;
 static int list_size = 0;
+static int slab_slots = 0; //column slots handed out, never reused
+// CLOCK_MONOTONIC of the last read, written by the reading thread only;
+// it becomes slab_sample_ts when the rows are applied, so the pipeline's
+// collector never touches what the analyzer is using
+static struct timespec slab_read_ts;
+static struct timespec slab_sample_ts; // of the rows in the slab list
+
+// version 2.1 layout, used until (or if) the header cannot be followed
+static slab_plan slab_layout = {
+    17, { SCOL_NAME, SCOL_ACTIVE_OBJS, SCOL_NUM_OBJS, SCOL_OBJSIZE, SCOL_OBJPERSLAB,
+          SCOL_PAGESPERSLAB, SCOL_SKIP, SCOL_SKIP, SCOL_LIMIT, SCOL_BATCHCOUNT,
+          SCOL_SHAREDFACTOR, SCOL_SKIP, SCOL_SKIP, SCOL_ACTIVE_SLABS, SCOL_NUM_SLABS,
+          SCOL_SHAREDAVAIL, SCOL_SKIP } };
+static int slab_layout_ready = 0;
 
 //function to compare two slabinfo structs (based on name)
 bool slabinfo_equal(slabinfo a, slabinfo b) {
@@ -77,20 +160,21 @@ bool slabinfo_equal(slabinfo a, slabinfo b) {
 
 //add new node to the linkedlist
 list* list_add(slabinfo new_slab) {
-    list* new_node = (list*)malloc(sizeof(list));
+    list* new_node = (list*)kml_alloc(sizeof(list), "slab list");
     if (!new_node) {
         perror("Failed to allocate memory for new node");
         return NULL;
     }
 
-    new_node->slab = (slabinfo*)malloc(sizeof(slabinfo));
+    new_node->slab = (slabinfo*)kml_alloc(sizeof(slabinfo), "slab list");
     if (!new_node->slab) {
         perror("Failed to allocate memory for slabinfo");
-        free(new_node);
+        kml_free(new_node);
         return NULL;
     }
 
     *(new_node->slab) = new_slab;
+    new_node->slab->idx = (slab_slots < MAX_SLABS) ? slab_slots++ : -1;
     new_node->next = head;
     new_node->prev = NULL;
 
@@ -118,13 +202,13 @@ bool list_exist(slabinfo target) {
 void list_trav() {
     list* temp = head;
     while (temp) {
-        printf("Name: %-20s Active: %-6u Total: %-6u ObjSize: %-4zu Obj/Slab: %-4u Pages/Slab: %-2u\n",
-               temp->slab->name,
-               temp->slab->active_objs,
-               temp->slab->num_objs,
-               temp->slab->objsize,
-               temp->slab->objperslab,
-               temp->slab->pagesperslab);
+        rprintf("Name: %-20s Active: %-6u Total: %-6u ObjSize: %-4zu Obj/Slab: %-4u Pages/Slab: %-2u\n",
+                temp->slab->name,
+                temp->slab->active_objs,
+                temp->slab->num_objs,
+                temp->slab->objsize,
+                temp->slab->objperslab,
+                temp->slab->pagesperslab);
         temp = temp->next;
     }
 }
@@ -145,7 +229,7 @@ diff list_match(slabinfo target) {
         temp = temp->next;
     }
 
-    printf("No match found for '%s'.\n", target.name);
+    rprintf("No match found for '%s'.\n", target.name);
     return result;
 }
 
@@ -162,16 +246,16 @@ void list_remove(slabinfo target) {
             if (temp->next)
                 temp->next->prev = temp->prev;
 
-            free(temp->slab);
-            free(temp);
+            kml_free(temp->slab);
+            kml_free(temp);
             list_size--;
 
-            printf("Removed slab: %s\n", target.name);
+            rprintf("Removed slab: %s\n", target.name);
             return;
         }
         temp = temp->next;
     }
-    printf("Slab not found for removal.\n");
+    rprintf("Slab not found for removal.\n");
 }
 
 //delete the whole linkedlist
@@ -179,8 +263,8 @@ void list_del() {
     list* temp = head;
     while (temp) {
         list* next = temp->next;
-        free(temp->slab);
-        free(temp);
+        kml_free(temp->slab);
+        kml_free(temp);
         temp = next;
     }
     head = NULL;
@@ -206,61 +290,281 @@ void init_slab_list()
     list_del(); // if needed to reset state
 }
 
-void parse_slabinfo()
+static procfile slabinfo_file = PROCFILE_INIT(FILE_SLABINFO);
+
+// read phase: pull the whole file into slabinfo_file.buf
+int read_slabinfo()
 {
-    FILE *file = fopen(FILE_SLABINFO, "r");
-    if (!file) {
-        perror("cannot open /proc/slabinfo");
-        return;
+    clock_gettime(CLOCK_MONOTONIC, &slab_read_ts);
+    if (procfile_read(&slabinfo_file) < 0) {
+        perror("cannot read /proc/slabinfo");
+        slabinfo_file.len = 0;
+        return -1;
     }
+    return 0;
+}
 
-    char line[LINE_BUFFER];
-    slabinfo s;
+static const struct
+{
+    const char *tag;
+    slab_col col;
+} slab_col_tags[] = {
+    {"name", SCOL_NAME},
+    {"<active_objs>", SCOL_ACTIVE_OBJS},
+    {"<num_objs>", SCOL_NUM_OBJS},
+    {"<objsize>", SCOL_OBJSIZE},
+    {"<objperslab>", SCOL_OBJPERSLAB},
+    {"<pagesperslab>", SCOL_PAGESPERSLAB},
+    {"<limit>", SCOL_LIMIT},
+    {"<batchcount>", SCOL_BATCHCOUNT},
+    {"<sharedfactor>", SCOL_SHAREDFACTOR},
+    {"<active_slabs>", SCOL_ACTIVE_SLABS},
+    {"<num_slabs>", SCOL_NUM_SLABS},
+    {"<sharedavail>", SCOL_SHAREDAVAIL},
+};
+
+// Next whitespace-separated token of a line; NULL at the end of the line.
+static const char *slab_token(const char **pos, size_t *len)
+{
+    const char *p = *pos;
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (*p == '\0' || *p == '\n')
+        return NULL;
+    const char *tok = p;
+    while (*p && *p != ' ' && *p != '\t' && *p != '\n')
+        p++;
+    *len = (size_t)(p - tok);
+    *pos = p;
+    return tok;
+}
 
-    // skip first two lines (headers)
-    fgets(line, sizeof(line), file);
-    fgets(line, sizeof(line), file);
+// "# name <active_objs> ... : slabdata <active_slabs> <num_slabs> <sharedavail>"
+static int slab_plan_from_header(const char *line, slab_plan *plan)
+{
+    const char *p = line + 1; // past '#'
+    const char *tok;
+    size_t len;
+    unsigned seen = 0;
+
+    plan->ncols = 0;
+    while ((tok = slab_token(&p, &len)) != NULL && plan->ncols < SLAB_MAX_COLS) {
+        slab_col col = SCOL_SKIP;
+        for (size_t i = 0; i < sizeof(slab_col_tags) / sizeof(slab_col_tags[0]); i++) {
+            if (strlen(slab_col_tags[i].tag) == len && memcmp(slab_col_tags[i].tag, tok, len) == 0) {
+                col = slab_col_tags[i].col;
+                break;
+            }
+        }
+        seen |= 1u << col;
+        plan->col[plan->ncols++] = (unsigned char)col;
+    }
+    return (seen & SLAB_REQUIRED_COLS) == SLAB_REQUIRED_COLS ? 0 : -1;
+}
 
-    // read each slab line
-    while (fgets(line, sizeof(line), file)) {
-        int matched = sscanf(line, "%s %u %u %zu %u %u",
-                             s.name, &s.active_objs, &s.num_objs,
-                             &s.objsize, &s.objperslab, &s.pagesperslab);
+// Validates the version line and, the first time through, turns the header
+// into the column plan. Returns the first data line, or NULL if none.
+char *slabinfo_data_start(char *buf)
+{
+    char *line = buf;
+    if (!slab_layout_ready) {
+        int major = 0, minor = 0;
+        if (sscanf(line, "slabinfo - version: %d.%d", &major, &minor) != 2)
+            fprintf(stderr, "slabinfo: no version line, assuming the 2.1 layout\n");
+        else if (major != 2)
+            fprintf(stderr, "slabinfo: unexpected version %d.%d, following its header\n",
+                    major, minor);
+    }
 
-        if (matched != 6)
+    // the version line and any '#' header lines precede the data
+    for (line = procfile_next_line(line); line && *line == '#'; line = procfile_next_line(line)) {
+        if (slab_layout_ready)
             continue;
+        slab_plan plan;
+        if (slab_plan_from_header(line, &plan) == 0)
+            slab_layout = plan;
+        else
+            fprintf(stderr, "slabinfo: header lacks required columns, assuming the 2.1 layout\n");
+    }
+    slab_layout_ready = 1;
+    return line;
+}
 
-        if (!list_exist(s)) {
-            list_add(s);
-        } else {
-            // Update existing slab
-            list* temp = head;
-            while (temp) {
-                if (slabinfo_equal(*(temp->slab), s)) {
-                    // Save the previous value before updating
-                    temp->slab->prev_active_objs = temp->slab->active_objs;
-                    // Update with new values
-                    temp->slab->active_objs = s.active_objs;
-                    temp->slab->num_objs = s.num_objs;
-
-                    // Add after updating values (for debugging)
-                    //printf("DEBUG: Updated %s: old=%u new=%u\n",
-                    //       temp->slab->name, temp->slab->prev_active_objs, temp->slab->active_objs);
-
-                    break;
-                }
-                temp = temp->next;
+static unsigned int slab_token_uint(const char *tok, size_t len)
+{
+    unsigned int v = 0;
+    for (size_t i = 0; i < len && tok[i] >= '0' && tok[i] <= '9'; i++)
+        v = v * 10 + (unsigned int)(tok[i] - '0');
+    return v;
+}
+
+// Parse one data line into s following the column plan; returns 0 when
+// every required column was present.
+int parse_slab_row(const char *line, slabinfo *s)
+{
+    const char *p = line;
+    const char *tok;
+    size_t len;
+    unsigned seen = 0;
+
+    for (int c = 0; c < slab_layout.ncols && (tok = slab_token(&p, &len)) != NULL; c++) {
+        slab_col col = (slab_col)slab_layout.col[c];
+        seen |= 1u << col;
+        switch (col) {
+        case SCOL_NAME:
+            if (len >= MAX_NAME_LEN)
+                len = MAX_NAME_LEN - 1;
+            memcpy(s->name, tok, len);
+            s->name[len] = '\0';
+            break;
+        case SCOL_ACTIVE_OBJS:  s->active_objs = slab_token_uint(tok, len); break;
+        case SCOL_NUM_OBJS:     s->num_objs = slab_token_uint(tok, len); break;
+        case SCOL_OBJSIZE:      s->objsize = slab_token_uint(tok, len); break;
+        case SCOL_OBJPERSLAB:   s->objperslab = slab_token_uint(tok, len); break;
+        case SCOL_PAGESPERSLAB: s->pagesperslab = slab_token_uint(tok, len); break;
+        case SCOL_LIMIT:        s->limit = slab_token_uint(tok, len); break;
+        case SCOL_BATCHCOUNT:   s->batchcount = slab_token_uint(tok, len); break;
+        case SCOL_SHAREDFACTOR: s->sharedfactor = slab_token_uint(tok, len); break;
+        case SCOL_ACTIVE_SLABS: s->active_slabs = slab_token_uint(tok, len); break;
+        case SCOL_NUM_SLABS:    s->num_slabs = slab_token_uint(tok, len); break;
+        case SCOL_SHAREDAVAIL:  s->sharedavail = slab_token_uint(tok, len); break;
+        case SCOL_SKIP:         break;
+        }
+    }
+
+    return (seen & SLAB_REQUIRED_COLS) == SLAB_REQUIRED_COLS ? 0 : -1;
+}
+
+// Fold one parsed row into the list: add new caches, update known ones.
+void apply_slab_row(const slabinfo *s)
+{
+    list* temp = head;
+    while (temp) {
+        if (slabinfo_equal(*(temp->slab), *s)) {
+            temp->slab->stale = s->stale;
+            if (s->stale) {
+                temp->slab->stale_cycles++;
+                return;
             }
+            temp->slab->span = temp->slab->stale_cycles + 1;
+            temp->slab->stale_cycles = 0;
+            // Save the previous value before updating
+            temp->slab->prev_active_objs = temp->slab->active_objs;
+            // Update with new values
+            temp->slab->active_objs = s->active_objs;
+            temp->slab->num_objs = s->num_objs;
+            temp->slab->limit = s->limit;
+            temp->slab->batchcount = s->batchcount;
+            temp->slab->sharedfactor = s->sharedfactor;
+            temp->slab->active_slabs = s->active_slabs;
+            temp->slab->num_slabs = s->num_slabs;
+            temp->slab->sharedavail = s->sharedavail;
+
+            // Add after updating values (for debugging)
+            //printf("DEBUG: Updated %s: old=%u new=%u\n",
+            //       temp->slab->name, temp->slab->prev_active_objs, temp->slab->active_objs);
+            return;
         }
+        temp = temp->next;
     }
+    list *added = list_add(*s);
+    if (added)
+        added->slab->prev_num_slabs = s->num_slabs; // no churn on first sight
+}
 
-    fclose(file);
+// A cycle whose slab read failed: every cache holds, as if not re-read
+void mark_slabs_stale(void)
+{
+    for (list *cur = head; cur; cur = cur->next) {
+        cur->slab->stale = 1;
+        cur->slab->stale_cycles++;
+    }
+}
+
+// parse phase: walk the buffer filled by read_slabinfo()
+void parse_slabinfo_buffer()
+{
+    if (slabinfo_file.len == 0)
+        return;
+
+    slabinfo s;
+    memset(&s, 0, sizeof(s));
+
+    for (char *line = slabinfo_data_start(slabinfo_file.buf); line;
+         line = procfile_next_line(line)) {
+        if (parse_slab_row(line, &s) == 0)
+            apply_slab_row(&s);
+    }
+}
+
+void parse_slabinfo()
+{
+    if (read_slabinfo() == 0) {
+        parse_slabinfo_buffer();
+        slab_sample_ts = slab_read_ts;
+    }
+}
+
+// Slab-page churn from the slabdata columns, in pages per second
+typedef struct
+{
+    double grown;       // pages gained by caches that grew
+    double released;    // pages given back by caches that shrank
+    const slabinfo *top; // cache with the largest net change
+} slab_churn;
+
+static slab_churn slab_churn_now;
+static struct timespec slab_prev_ts;
+static int slab_prev_valid = 0;
+
+// Call once per cycle after the rows are applied.
+void update_slab_churn(void)
+{
+    slab_churn *c = &slab_churn_now;
+    c->grown = c->released = 0.0;
+    c->top = NULL;
+
+    double dt = (slab_sample_ts.tv_sec - slab_prev_ts.tv_sec) +
+                (slab_sample_ts.tv_nsec - slab_prev_ts.tv_nsec) / 1e9;
+    double inv_dt = (slab_prev_valid && dt > 0.0) ? 1.0 / dt : 0.0;
+    slab_prev_ts = slab_sample_ts;
+    slab_prev_valid = 1;
+
+    double top = 0.0;
+    for (list *cur = head; cur; cur = cur->next) {
+        slabinfo *s = cur->slab;
+        if (s->stale)
+            continue;
+        long delta = (long)s->num_slabs - (long)s->prev_num_slabs;
+        s->prev_num_slabs = s->num_slabs;
+        s->slab_pages_per_sec = (double)delta * s->pagesperslab * inv_dt / slab_span(s);
+
+        if (s->slab_pages_per_sec > 0.0)
+            c->grown += s->slab_pages_per_sec;
+        else
+            c->released -= s->slab_pages_per_sec;
+        if (fabs(s->slab_pages_per_sec) > top) {
+            top = fabs(s->slab_pages_per_sec);
+            c->top = s;
+        }
+    }
+}
+
+void show_slab_churn(void)
+{
+    const slab_churn *c = &slab_churn_now;
+    rprintf("[SLAB PAGES] grown=%.1f/s released=%.1f/s churn=%.1f/s",
+            c->grown, c->released, c->grown + c->released);
+    if (c->top)
+        rprintf(" top=%s (%+.1f/s, %u/%u slabs active)", c->top->name,
+                c->top->slab_pages_per_sec, c->top->active_slabs, c->top->num_slabs);
+    rprintf("\n");
 }
 
 // Add this function:
 void show_long_term_growth()
 {
-    printf("\n--- Long-Term Growth Analysis ---\n");
+    rprintf("\n--- Long-Term Growth Analysis ---\n");
     list *cur = get_slab_list_head();
     while (cur) {
         float long_term_growth = 0;
@@ -270,8 +574,8 @@ void show_long_term_growth()
         }
 
         if (long_term_growth > 10.0f) {
-            printf("\033[1;35m[LONG-TERM] %s has grown %.1f%% since start\033[0m\n",
-                   cur->slab->name, long_term_growth);
+            rprintf("\033[1;35m[LONG-TERM] %s has grown %.1f%% since start\033[0m\n",
+                    cur->slab->name, long_term_growth);
         }
 
         cur = cur->next;
@@ -0,0 +1,320 @@
+#ifndef SLABSOURCE_H
+#define SLABSOURCE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "report.h"
+
+// Where slab counts come from each cycle. Reading /proc/slabinfo makes the
+// kernel walk every cache and node under slab_mutex; on big hosts that is
+// tens of milliseconds of kernel time and stalls cache creation. The cost
+// of every read is measured; when a full read gets expensive the source
+// turns hybrid: the full file only every --discovery cycles, to find caches
+// and pick the hot ones, and the SLUB sysfs counters of the hot caches in
+// between. Caches outside the hot set, and hot ones whose files cannot be
+// read, are marked stale until the next full read: the trend engine holds
+// their state instead of seeing a flat cycle.
+//
+// On SLUB, sysfs objects/total_objects/slabs count what slabinfo reports as
+// active_objs/num_objs/num_slabs, but only with CONFIG_SLUB_DEBUG; without
+// it objects leaves out full slabs. Each discovery therefore reads the hot
+// caches' sysfs files too and keeps the difference to the slabinfo row,
+// which the sysfs cycles add back.
+
+#define SLAB_SYSFS_DIR "/sys/kernel/slab"
+#define SLAB_HOT_MAX 32
+#define SLAB_DISCOVERY_CYCLES 12
+#define SLAB_COST_MS 5.0          // full-read cost that turns hybrid on
+#define SLAB_COST_EMA 0.3
+
+typedef enum
+{
+    SLABSRC_AUTO,
+    SLABSRC_FULL,
+    SLABSRC_HYBRID,
+} slabsrc_policy;
+
+typedef struct
+{
+    unsigned long long reads;
+    double last_ms, ema_ms, max_ms;   // wall
+    double cpu_ms;                    // thread CPU of the last read, mostly kernel
+} slabsrc_cost;
+
+// sysfs files read per hot cache
+enum { HOT_OBJECTS, HOT_TOTAL_OBJECTS, HOT_SLABS, HOT_FILES };
+
+typedef struct
+{
+    int row;             // index into slabsrc_rows
+    int fd[HOT_FILES];
+    long long offset[HOT_FILES]; // slabinfo minus sysfs at the last discovery
+} slabsrc_hot;
+
+static slabsrc_policy slabsrc_mode = SLABSRC_AUTO;  // --slab-source
+static double slabsrc_cost_ms = SLAB_COST_MS;       // --slab-cost-ms
+static int slabsrc_discovery = SLAB_DISCOVERY_CYCLES; // --discovery
+static int slabsrc_hybrid = 0;       // currently running hybrid
+static int slabsrc_sysfs = -1;       // /sys/kernel/slab usable, -1 = not probed
+static int slabsrc_cycle = 0;
+static int slabsrc_full_now = 1;     // this cycle reads /proc/slabinfo
+static slabsrc_cost slabsrc_full_cost, slabsrc_sysfs_cost;
+
+// last known row of every cache; hot rows are refreshed from sysfs
+static slabinfo slabsrc_rows[MAX_SLABS];
+static unsigned long long slabsrc_prev_bytes[MAX_SLABS];
+static int slabsrc_nrows = 0;
+static slabsrc_hot slabsrc_hot_set[SLAB_HOT_MAX];
+static int slabsrc_nhot = 0;
+
+static double slabsrc_ms(const struct timespec *a, const struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) * 1e3 + (b->tv_nsec - a->tv_nsec) / 1e6;
+}
+
+static void slabsrc_account(slabsrc_cost *c, const struct timespec *w0, const struct timespec *c0)
+{
+    struct timespec w1, c1;
+    clock_gettime(CLOCK_MONOTONIC, &w1);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c1);
+    c->last_ms = slabsrc_ms(w0, &w1);
+    c->cpu_ms = slabsrc_ms(c0, &c1);
+    c->ema_ms = c->reads ? c->ema_ms + SLAB_COST_EMA * (c->last_ms - c->ema_ms) : c->last_ms;
+    if (c->last_ms > c->max_ms)
+        c->max_ms = c->last_ms;
+    c->reads++;
+}
+
+static void slabsrc_close_hot(void)
+{
+    for (int i = 0; i < slabsrc_nhot; i++)
+        for (int f = 0; f < HOT_FILES; f++)
+            if (slabsrc_hot_set[i].fd[f] >= 0)
+                close(slabsrc_hot_set[i].fd[f]);
+    slabsrc_nhot = 0;
+}
+
+static int slabsrc_open_hot(slabsrc_hot *h, const char *name)
+{
+    static const char *files[HOT_FILES] = {"objects", "total_objects", "slabs"};
+    char path[PROCFILE_PATH_MAX];
+    for (int f = 0; f < HOT_FILES; f++) {
+        snprintf(path, sizeof(path), "%s" SLAB_SYSFS_DIR "/%s/%s", procfile_root, name, files[f]);
+        h->fd[f] = open(path, O_RDONLY | O_CLOEXEC);
+        if (h->fd[f] < 0) {
+            while (f-- > 0)
+                close(h->fd[f]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// "1234 N0=1234"; -1 if the cache went away
+static int slabsrc_read_uint(int fd, unsigned long long *v)
+{
+    char buf[32];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+    *v = strtoull(buf, NULL, 10);
+    return 0;
+}
+
+// All three sysfs counters of a hot cache, or -1 if any failed
+static int slabsrc_read_hot(const slabsrc_hot *h, unsigned long long v[HOT_FILES])
+{
+    for (int f = 0; f < HOT_FILES; f++)
+        if (slabsrc_read_uint(h->fd[f], &v[f]) != 0)
+            return -1;
+    return 0;
+}
+
+static unsigned int slabsrc_adjust(unsigned long long v, long long offset)
+{
+    long long x = (long long)v + offset;
+    return x > 0 ? (unsigned int)x : 0;
+}
+
+// Hot caches: the biggest byte movers since the previous discovery, then
+// the biggest caches. Only runs on discovery cycles.
+static void slabsrc_pick_hot(void)
+{
+    static int order[MAX_SLABS];
+    static unsigned long long moved[MAX_SLABS];
+    int n = slabsrc_nrows;
+
+    for (int i = 0; i < n; i++) {
+        const slabinfo *r = &slabsrc_rows[i];
+        unsigned long long bytes = (unsigned long long)r->active_objs * r->objsize;
+        unsigned long long prev = slabsrc_prev_bytes[i];
+        moved[i] = bytes > prev ? bytes - prev : prev - bytes;
+        slabsrc_prev_bytes[i] = bytes;
+        order[i] = i;
+    }
+    // partial selection sort: only the first SLAB_HOT_MAX places matter
+    int want = n < SLAB_HOT_MAX ? n : SLAB_HOT_MAX;
+    for (int i = 0; i < want; i++) {
+        int best = i;
+        for (int j = i + 1; j < n; j++) {
+            const slabinfo *a = &slabsrc_rows[order[j]], *b = &slabsrc_rows[order[best]];
+            if (moved[order[j]] > moved[order[best]] ||
+                (moved[order[j]] == moved[order[best]] &&
+                 (unsigned long long)a->num_objs * a->objsize >
+                 (unsigned long long)b->num_objs * b->objsize))
+                best = j;
+        }
+        int t = order[i];
+        order[i] = order[best];
+        order[best] = t;
+    }
+
+    slabsrc_close_hot();
+    for (int i = 0; i < want; i++) {
+        slabsrc_hot *h = &slabsrc_hot_set[slabsrc_nhot];
+        h->row = order[i];
+        if (slabsrc_open_hot(h, slabsrc_rows[h->row].name) != 0)
+            continue;
+        // line sysfs up with the slabinfo row just read
+        const slabinfo *r = &slabsrc_rows[h->row];
+        unsigned long long v[HOT_FILES];
+        memset(h->offset, 0, sizeof(h->offset));
+        if (slabsrc_read_hot(h, v) == 0) {
+            h->offset[HOT_OBJECTS] = (long long)r->active_objs - (long long)v[HOT_OBJECTS];
+            h->offset[HOT_TOTAL_OBJECTS] = (long long)r->num_objs - (long long)v[HOT_TOTAL_OBJECTS];
+            h->offset[HOT_SLABS] = (long long)r->num_slabs - (long long)v[HOT_SLABS];
+        }
+        slabsrc_nhot++;
+    }
+}
+
+// Full read or hot-cache sysfs reads, whichever this cycle calls for.
+// Returns 0 when the cycle produced data.
+int slabsrc_read(void)
+{
+    if (slabsrc_sysfs < 0) {
+        char path[PROCFILE_PATH_MAX];
+        slabsrc_sysfs = access(procfile_path(path, sizeof(path), SLAB_SYSFS_DIR), R_OK | X_OK) == 0;
+    }
+
+    slabsrc_full_now = !slabsrc_hybrid || slabsrc_nrows == 0 ||
+                       slabsrc_cycle % slabsrc_discovery == 0;
+    slabsrc_cycle++;
+
+    struct timespec w0, c0;
+    clock_gettime(CLOCK_MONOTONIC, &w0);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c0);
+
+    if (slabsrc_full_now) {
+        int rc = read_slabinfo();
+        if (rc == 0)
+            slabsrc_account(&slabsrc_full_cost, &w0, &c0);
+        return rc;
+    }
+
+    slab_read_ts = w0;
+    for (int i = 0; i < slabsrc_nrows; i++)
+        slabsrc_rows[i].stale = 1;
+    for (int i = 0; i < slabsrc_nhot; i++) {
+        slabsrc_hot *h = &slabsrc_hot_set[i];
+        slabinfo *r = &slabsrc_rows[h->row];
+        unsigned long long v[HOT_FILES];
+        if (slabsrc_read_hot(h, v) != 0)
+            continue;
+        r->active_objs = slabsrc_adjust(v[HOT_OBJECTS], h->offset[HOT_OBJECTS]);
+        r->num_objs = slabsrc_adjust(v[HOT_TOTAL_OBJECTS], h->offset[HOT_TOTAL_OBJECTS]);
+        r->num_slabs = slabsrc_adjust(v[HOT_SLABS], h->offset[HOT_SLABS]);
+        r->active_slabs = r->num_slabs; // as /proc/slabinfo reports it on SLUB
+        r->stale = 0;
+    }
+    slabsrc_account(&slabsrc_sysfs_cost, &w0, &c0);
+    return 0;
+}
+
+static void slabsrc_switch(int hybrid, const char *why)
+{
+    if (hybrid == slabsrc_hybrid)
+        return;
+    slabsrc_hybrid = hybrid;
+    slabsrc_cycle = 1; // the read that triggered this was a discovery
+    if (!hybrid)
+        slabsrc_close_hot();
+    fprintf(stderr, "slab source: %s (%s)\n", hybrid ? "hybrid" : "full /proc/slabinfo", why);
+}
+
+// Turns a full read into slabsrc_rows and settles the mode for the next
+// cycles. Sysfs cycles already updated their rows in slabsrc_read().
+void slabsrc_parse(void)
+{
+    if (!slabsrc_full_now || slabinfo_file.len == 0)
+        return;
+
+    static slabinfo row; // unparsed columns stay zero
+    int n = 0;
+    for (char *line = slabinfo_data_start(slabinfo_file.buf); line && n < MAX_SLABS;
+         line = procfile_next_line(line)) {
+        if (parse_slab_row(line, &row) != 0)
+            continue;
+        // a cache that moved to another row starts its history afresh
+        if (n >= slabsrc_nrows || strcmp(row.name, slabsrc_rows[n].name) != 0)
+            slabsrc_prev_bytes[n] = (unsigned long long)row.active_objs * row.objsize;
+        slabsrc_rows[n++] = row;
+    }
+    slabsrc_nrows = n;
+
+    int want = slabsrc_mode == SLABSRC_HYBRID ||
+               (slabsrc_mode == SLABSRC_AUTO && (slabsrc_hybrid
+                    ? slabsrc_full_cost.ema_ms > slabsrc_cost_ms / 2  // hysteresis
+                    : slabsrc_full_cost.ema_ms > slabsrc_cost_ms));
+    // hot-cache reads that cost as much as a full read buy nothing
+    if (slabsrc_mode == SLABSRC_AUTO && slabsrc_hybrid && slabsrc_sysfs_cost.reads &&
+        slabsrc_sysfs_cost.ema_ms >= slabsrc_full_cost.ema_ms)
+        want = 0;
+    if (want && !slabsrc_sysfs) {
+        if (slabsrc_mode == SLABSRC_HYBRID)
+            fprintf(stderr, "slab source: " SLAB_SYSFS_DIR " unavailable (not SLUB?), "
+                            "staying on /proc/slabinfo\n");
+        slabsrc_mode = SLABSRC_FULL;
+        want = 0;
+    }
+    if (slabsrc_mode == SLABSRC_HYBRID)
+        slabsrc_switch(want, "forced");
+    else if (slabsrc_mode == SLABSRC_AUTO)
+        slabsrc_switch(want, want ? "full read over budget" : "full read no dearer than sysfs");
+    if (slabsrc_hybrid)
+        slabsrc_pick_hot();
+}
+
+// Fold the current rows into the slab list.
+void slabsrc_apply(void)
+{
+    slab_sample_ts = slab_read_ts;
+    for (int i = 0; i < slabsrc_nrows; i++)
+        apply_slab_row(&slabsrc_rows[i]);
+}
+
+// A failed read leaves the previous rows in slabsrc_rows; applying them
+// would look like a flat cycle, so the whole list goes stale instead.
+void slabsrc_apply_failed(void)
+{
+    slab_sample_ts = slab_read_ts;
+    mark_slabs_stale();
+}
+
+void show_slab_source(void)
+{
+    const slabsrc_cost *f = &slabsrc_full_cost, *s = &slabsrc_sysfs_cost;
+    rprintf("[SLAB SOURCE] %s full=%.2fms (avg %.2f, max %.2f, cpu %.2f)",
+            slabsrc_hybrid ? "hybrid" : "full", f->last_ms, f->ema_ms, f->max_ms, f->cpu_ms);
+    if (slabsrc_hybrid)
+        rprintf(" every %d cycles, sysfs=%.2fms (avg %.2f, cpu %.2f) for %d hot caches",
+                slabsrc_discovery, s->last_ms, s->ema_ms, s->cpu_ms, slabsrc_nhot);
+    rprintf("\n");
+}
+
+#endif // SLABSOURCE_H
@@ -0,0 +1,243 @@
+#ifndef SLUBCPU_H
+#define SLUBCPU_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "report.h"
+
+// SLUB per-CPU slabs and partial lists of watched caches, from
+// /sys/kernel/slab/<cache>/{cpu_slabs,partial,cpu_partial,slabs_cpu_partial}.
+//
+// /proc/slabinfo only subtracts the free objects on the node partial
+// lists, so every object in a slab a CPU currently owns (its active slab
+// and its per-CPU partial slabs) counts as active. On many-core hosts that
+// swings with CPU activity. The collector records how many objects sit in
+// CPU-owned slabs; the trend engine then follows the objects outside them
+// (slab_trend_objs()), which only move when memory is really held.
+
+#define SLUB_WATCH_MAX 16
+#define SLUB_MAX_NODES 16
+#define SLUB_REPICK_CYCLES 12
+#define SLUB_SHOW_MAX 5
+
+enum { SLUB_CPU_SLABS, SLUB_PARTIAL, SLUB_CPU_PARTIAL, SLUB_SLABS_CPU_PARTIAL, SLUB_FILES };
+
+typedef struct
+{
+    slabinfo *slab;
+    int fd[SLUB_FILES];
+    int fresh;                        // no sample taken yet
+    unsigned int cpu_slabs;           // active + per-CPU partial slabs
+    unsigned int partial;             // node partial slabs
+    unsigned int cpu_partial;         // per-CPU partial limit (tunable)
+    unsigned int pcp_objs, pcp_slabs; // per-CPU partial, kernel's estimate
+    int pcp_cpus;                     // CPUs holding per-CPU partial slabs
+    int busiest_cpu;
+    unsigned int busiest_objs;
+    int nnodes;
+    unsigned int node_cpu_slabs[SLUB_MAX_NODES];
+    unsigned int node_partial[SLUB_MAX_NODES];
+} slub_watch;
+
+static int slub_enabled = 0;              // --slub-cpu
+static const char *slub_names = NULL;     // --slub-cpu=a,b,c; NULL = largest caches
+static slub_watch slub_watched[SLUB_WATCH_MAX];
+static int slub_nwatched = 0;
+static int slub_cycle = 0;
+static char slub_buf[4096 + 1];           // sysfs attributes are one page at most
+
+static void slub_unwatch(slub_watch *w)
+{
+    for (int f = 0; f < SLUB_FILES; f++)
+        if (w->fd[f] >= 0)
+            close(w->fd[f]);
+    w->slab->cpu_held_objs = w->slab->prev_cpu_held_objs = 0;
+}
+
+static int slub_watch_cache(slabinfo *s)
+{
+    static const char *files[SLUB_FILES] = {"cpu_slabs", "partial", "cpu_partial",
+                                            "slabs_cpu_partial"};
+    if (slub_nwatched >= SLUB_WATCH_MAX)
+        return -1;
+    slub_watch *w = &slub_watched[slub_nwatched];
+    memset(w, 0, sizeof(*w));
+    char path[PROCFILE_PATH_MAX];
+    for (int f = 0; f < SLUB_FILES; f++) {
+        snprintf(path, sizeof(path), "%s" SLAB_SYSFS_DIR "/%s/%s", procfile_root, s->name, files[f]);
+        w->fd[f] = open(path, O_RDONLY | O_CLOEXEC);
+        if (w->fd[f] < 0) {
+            while (f-- > 0)
+                close(w->fd[f]);
+            return -1;
+        }
+    }
+    w->slab = s;
+    w->fresh = 1;
+    w->busiest_cpu = -1;
+    slub_nwatched++;
+    return 0;
+}
+
+// Named caches once; otherwise the largest caches, re-picked now and then.
+static void slub_pick(void)
+{
+    for (int i = 0; i < slub_nwatched; i++)
+        slub_unwatch(&slub_watched[i]);
+    slub_nwatched = 0;
+
+    if (slub_names) {
+        const char *p = slub_names;
+        while (*p) {
+            size_t len = strcspn(p, ",");
+            for (list *cur = get_slab_list_head(); cur; cur = cur->next)
+                if (strlen(cur->slab->name) == len && strncmp(cur->slab->name, p, len) == 0)
+                    slub_watch_cache(cur->slab);
+            p += len + (p[len] == ',');
+        }
+        return;
+    }
+
+    // strictly descending sizes, so a cache that cannot be watched (no
+    // sysfs directory) is passed over instead of picked again
+    unsigned long long below = ~0ULL;
+    while (slub_nwatched < SLUB_WATCH_MAX) {
+        slabinfo *best = NULL;
+        unsigned long long best_bytes = 0;
+        for (list *cur = get_slab_list_head(); cur; cur = cur->next) {
+            slabinfo *s = cur->slab;
+            unsigned long long bytes = (unsigned long long)s->num_objs * s->objsize;
+            if (bytes > best_bytes && bytes < below) {
+                best = s;
+                best_bytes = bytes;
+            }
+        }
+        if (!best)
+            break;
+        below = best_bytes;
+        slub_watch_cache(best);
+    }
+}
+
+static const char *slub_read(int fd)
+{
+    ssize_t n = pread(fd, slub_buf, sizeof(slub_buf) - 1, 0);
+    slub_buf[n > 0 ? n : 0] = '\0';
+    return slub_buf;
+}
+
+// "<total> N0=<n> N1=<n> ..." in one pass
+static unsigned int slub_parse_nodes(const char *p, unsigned int *node, int *nnodes)
+{
+    char *end;
+    unsigned int total = (unsigned int)strtoul(p, &end, 10);
+    for (p = end; (p = strstr(p, " N")) != NULL; ) {
+        int nid = (int)strtol(p + 2, &end, 10);
+        if (*end != '=')
+            break;
+        unsigned int v = (unsigned int)strtoul(end + 1, &end, 10);
+        if (nid >= 0 && nid < SLUB_MAX_NODES) {
+            node[nid] = v;
+            if (nid + 1 > *nnodes)
+                *nnodes = nid + 1;
+        }
+        p = end;
+    }
+    return total;
+}
+
+// "<objs>(<slabs>) C0=<objs>(<slabs>) C5=..." in one pass
+static void slub_parse_cpu_partial(const char *p, slub_watch *w)
+{
+    char *end;
+    w->pcp_objs = (unsigned int)strtoul(p, &end, 10);
+    w->pcp_slabs = *end == '(' ? (unsigned int)strtoul(end + 1, &end, 10) : 0;
+    w->pcp_cpus = 0;
+    w->busiest_cpu = -1;
+    w->busiest_objs = 0;
+    for (p = end; (p = strstr(p, " C")) != NULL; ) {
+        int cpu = (int)strtol(p + 2, &end, 10);
+        if (*end != '=')
+            break;
+        unsigned int objs = (unsigned int)strtoul(end + 1, &end, 10);
+        w->pcp_cpus++;
+        if (objs > w->busiest_objs) {
+            w->busiest_objs = objs;
+            w->busiest_cpu = cpu;
+        }
+        p = end;
+    }
+}
+
+// Call after the rows are applied and before the trend updates.
+void update_slub_cpu(void)
+{
+    if (!slub_enabled)
+        return;
+    if (slub_cycle++ % SLUB_REPICK_CYCLES == 0 && (!slub_names || slub_nwatched == 0))
+        slub_pick();
+
+    for (int i = 0; i < slub_nwatched; i++) {
+        slub_watch *w = &slub_watched[i];
+        w->nnodes = 0;
+        w->cpu_slabs = slub_parse_nodes(slub_read(w->fd[SLUB_CPU_SLABS]),
+                                        w->node_cpu_slabs, &w->nnodes);
+        int nn = 0;
+        w->partial = slub_parse_nodes(slub_read(w->fd[SLUB_PARTIAL]), w->node_partial, &nn);
+        w->cpu_partial = (unsigned int)strtoul(slub_read(w->fd[SLUB_CPU_PARTIAL]), NULL, 10);
+        slub_parse_cpu_partial(slub_read(w->fd[SLUB_SLABS_CPU_PARTIAL]), w);
+
+        slabinfo *s = w->slab;
+        unsigned int held = w->cpu_slabs * s->objperslab;
+        if (held > s->active_objs)
+            held = s->active_objs;
+        // first sample of a newly watched cache: no step in the trend
+        s->prev_cpu_held_objs = w->fresh ? held : s->cpu_held_objs;
+        s->cpu_held_objs = held;
+        w->fresh = 0;
+    }
+}
+
+void show_slub_cpu(void)
+{
+    if (!slub_enabled || slub_nwatched == 0)
+        return;
+
+    // the caches where CPU-owned slabs hide the largest share of "active"
+    int shown[SLUB_WATCH_MAX] = {0};
+    for (int k = 0; k < SLUB_SHOW_MAX; k++) {
+        int best = -1;
+        double best_share = 0.0;
+        for (int i = 0; i < slub_nwatched; i++) {
+            const slabinfo *s = slub_watched[i].slab;
+            double share = s->active_objs ? (double)s->cpu_held_objs / s->active_objs : 0.0;
+            if (!shown[i] && share > best_share) {
+                best = i;
+                best_share = share;
+            }
+        }
+        if (best < 0)
+            break;
+        shown[best] = 1;
+
+        const slub_watch *w = &slub_watched[best];
+        rprintf("[SLUB CPU] %-20s cpu-held=%u objs (%.0f%% of active) cpu_slabs=%u "
+                "pcp=%u objs/%u slabs on %d CPUs",
+                w->slab->name, w->slab->cpu_held_objs, best_share * 100.0, w->cpu_slabs,
+                w->pcp_objs, w->pcp_slabs, w->pcp_cpus);
+        if (w->busiest_cpu >= 0)
+            rprintf(" (max C%d=%u)", w->busiest_cpu, w->busiest_objs);
+        rprintf(" limit=%u node_partial=%u", w->cpu_partial, w->partial);
+        if (w->nnodes > 1) {
+            rprintf(" per-node cpu/partial:");
+            for (int n = 0; n < w->nnodes; n++)
+                rprintf(" N%d=%u/%u", n, w->node_cpu_slabs[n], w->node_partial[n]);
+        }
+        rprintf("\n");
+    }
+}
+
+#endif // SLUBCPU_H
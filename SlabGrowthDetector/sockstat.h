@@ -0,0 +1,425 @@
+#ifndef SOCKSTAT_H
+#define SOCKSTAT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "report.h"
+
+// Socket memory from /proc/net/sockstat and sockstat6, next to the network
+// slab caches. A cache that grows with its socket count means sockets are
+// being held open; one that grows while the sockets stay flat means the
+// objects are not accounted to live sockets. skbuff_head_cache growing
+// with the TCP/UDP memory pages is receive/send queue buildup, growing
+// without them points at skbs that are not queued anywhere.
+//
+// With --netns the namespaces bound under a directory (default /run/netns,
+// as `ip netns` creates them) are entered with setns() once per rescan;
+// their sockstat files are opened from inside and the held fds are then
+// read every cycle like the host's, with no namespace switch. An open file
+// pins its namespace, so vanished ones are let go on the next rescan.
+
+#define SOCK_NETNS_DIR "/run/netns"
+#define SOCK_NETNS_MAX 64
+#define SOCK_NETNS_RESCAN 12
+#define SOCK_HISTORY 60
+#define SOCK_MIN_SAMPLES 6
+#define SOCK_SHOW_NETNS 3
+
+typedef enum
+{
+    SC_SOCKETS,
+    SC_TCP_INUSE, SC_TCP_ORPHAN, SC_TCP_TW, SC_TCP_ALLOC, SC_TCP_MEM,
+    SC_UDP_INUSE, SC_UDP_MEM, SC_UDPLITE_INUSE, SC_RAW_INUSE,
+    SC_FRAG_INUSE, SC_FRAG_MEMORY,
+    SC_TCP6_INUSE, SC_UDP6_INUSE, SC_UDPLITE6_INUSE, SC_RAW6_INUSE,
+    SC_FRAG6_INUSE, SC_FRAG6_MEMORY,
+    SC_QUEUE_PAGES,     // derived: TCP + UDP memory pages
+    SC_COUNT
+} sock_ctr;
+
+// "<proto>: <key> <value> ..." fields; per_net ones are summed over the
+// namespaces, the others are kernel-wide and taken from the host only
+static const struct
+{
+    const char *proto;
+    const char *key;
+    sock_ctr ctr;
+    int per_net;
+} sock_fields[] = {
+    {"sockets", "used", SC_SOCKETS, 1},
+    {"TCP", "inuse", SC_TCP_INUSE, 1},
+    {"TCP", "orphan", SC_TCP_ORPHAN, 0},
+    {"TCP", "tw", SC_TCP_TW, 1},
+    {"TCP", "alloc", SC_TCP_ALLOC, 0},
+    {"TCP", "mem", SC_TCP_MEM, 0},
+    {"UDP", "inuse", SC_UDP_INUSE, 1},
+    {"UDP", "mem", SC_UDP_MEM, 0},
+    {"UDPLITE", "inuse", SC_UDPLITE_INUSE, 1},
+    {"RAW", "inuse", SC_RAW_INUSE, 1},
+    {"FRAG", "inuse", SC_FRAG_INUSE, 1},
+    {"FRAG", "memory", SC_FRAG_MEMORY, 1},
+    {"TCP6", "inuse", SC_TCP6_INUSE, 1},
+    {"UDP6", "inuse", SC_UDP6_INUSE, 1},
+    {"UDPLITE6", "inuse", SC_UDPLITE6_INUSE, 1},
+    {"RAW6", "inuse", SC_RAW6_INUSE, 1},
+    {"FRAG6", "inuse", SC_FRAG6_INUSE, 1},
+    {"FRAG6", "memory", SC_FRAG6_MEMORY, 1},
+};
+#define SOCK_NFIELDS ((int)(sizeof(sock_fields) / sizeof(sock_fields[0])))
+
+// network caches and the counter each one should follow, -1 for none
+static const struct
+{
+    const char *cache;
+    int ctr;
+    const char *what;
+} sock_pairs[] = {
+    {"sock_inode_cache", SC_SOCKETS, "sockets"},
+    {"TCP", SC_TCP_INUSE, "tcp"},
+    {"TCPv6", SC_TCP6_INUSE, "tcp6"},
+    {"UDP", SC_UDP_INUSE, "udp"},
+    {"UDPv6", SC_UDP6_INUSE, "udp6"},
+    {"tw_sock_TCP", SC_TCP_TW, "timewait"},
+    {"request_sock_TCP", -1, NULL},
+    {"skbuff_head_cache", SC_QUEUE_PAGES, "queued pages"},
+};
+#define SOCK_NPAIRS ((int)(sizeof(sock_pairs) / sizeof(sock_pairs[0])))
+
+typedef struct
+{
+    char name[64];
+    int fd[2];                        // sockstat, sockstat6
+    unsigned long long v[SC_COUNT];
+} sock_ns;
+
+static int sock_enabled = 1;              // optional collector, the governor may drop it
+static int sock_netns = 0;                // --netns
+static const char *sock_netns_dir = SOCK_NETNS_DIR;
+static procdir sock_netns_list = PROCDIR_INIT;
+static sock_ns sock_host = { "host", { -1, -1 }, { 0 } };
+static sock_ns sock_ns_list[SOCK_NETNS_MAX];
+static int sock_nns = 0;
+static int sock_cycle = 0;
+static char sock_buf[4096];
+static unsigned long long sock_total[SC_COUNT];
+
+// history for the trends, oldest first through sock_at()
+static double sock_hist_t[SOCK_HISTORY];
+static double sock_hist_ctr[SOCK_HISTORY][SC_COUNT];
+static double sock_hist_cache[SOCK_HISTORY][SOCK_NPAIRS];
+static int sock_head = 0, sock_len = 0;
+static const slabinfo *sock_cache[SOCK_NPAIRS];
+
+static int sock_at(int i) // 0 = oldest
+{
+    return (sock_head - sock_len + i + 2 * SOCK_HISTORY) % SOCK_HISTORY;
+}
+
+// Opens sockstat and sockstat6 of the calling thread's network namespace.
+static int sock_open(sock_ns *ns)
+{
+    char path[PROCFILE_PATH_MAX];
+    ns->fd[0] = open(procfile_path(path, sizeof(path), "/proc/thread-self/net/sockstat"), O_RDONLY | O_CLOEXEC);
+    ns->fd[1] = open(procfile_path(path, sizeof(path), "/proc/thread-self/net/sockstat6"),
+                     O_RDONLY | O_CLOEXEC); // no IPv6 is fine
+    return ns->fd[0] >= 0 ? 0 : -1;
+}
+
+// The --netns directory, opened once; its listing buffer comes from the
+// region in fixed-footprint mode.
+int sock_reserve(void)
+{
+    if (!sock_netns)
+        return 0;
+    if (procdir_open(&sock_netns_list, sock_netns_dir) != 0) {
+        fprintf(stderr, "sockstat: cannot open %s (%s), host only\n", sock_netns_dir, strerror(errno));
+        sock_netns = 0;
+    }
+    return 0;
+}
+
+size_t sock_footprint(void)
+{
+    return sock_netns ? PROCDIR_BUF_SIZE + ARENA_ALIGN : 0;
+}
+
+static void sock_close(sock_ns *ns)
+{
+    for (int f = 0; f < 2; f++)
+        if (ns->fd[f] >= 0)
+            close(ns->fd[f]);
+    ns->fd[0] = ns->fd[1] = -1;
+}
+
+// One pass over "<proto>: <key> <value> <key> <value>..." lines.
+static void sock_parse(const char *p, unsigned long long *v)
+{
+    while (*p) {
+        const char *colon = strchr(p, ':');
+        const char *eol = strchr(p, '\n');
+        if (!eol)
+            eol = p + strlen(p);
+        if (!colon || colon > eol) {
+            p = *eol ? eol + 1 : eol;
+            continue;
+        }
+        size_t plen = (size_t)(colon - p);
+        const char *q = colon + 1;
+        while (q < eol) {
+            while (*q == ' ')
+                q++;
+            const char *key = q;
+            while (q < eol && *q != ' ')
+                q++;
+            size_t klen = (size_t)(q - key);
+            char *end;
+            unsigned long long val = strtoull(q, &end, 10);
+            if (end == q)
+                break;
+            q = end;
+            for (int f = 0; f < SOCK_NFIELDS; f++)
+                if (strlen(sock_fields[f].proto) == plen && strncmp(sock_fields[f].proto, p, plen) == 0 &&
+                    strlen(sock_fields[f].key) == klen && strncmp(sock_fields[f].key, key, klen) == 0) {
+                    v[sock_fields[f].ctr] = val;
+                    break;
+                }
+        }
+        p = *eol ? eol + 1 : eol;
+    }
+}
+
+static void sock_read(sock_ns *ns)
+{
+    memset(ns->v, 0, sizeof(ns->v));
+    for (int f = 0; f < 2; f++) {
+        if (ns->fd[f] < 0)
+            continue;
+        ssize_t n = pread(ns->fd[f], sock_buf, sizeof(sock_buf) - 1, 0);
+        sock_buf[n > 0 ? n : 0] = '\0';
+        sock_parse(sock_buf, ns->v);
+    }
+    ns->v[SC_QUEUE_PAGES] = ns->v[SC_TCP_MEM] + ns->v[SC_UDP_MEM];
+}
+
+// Re-enters every namespace bound under sock_netns_dir and reopens its
+// files; namespaces that went away are released here.
+static void sock_rescan_netns(void)
+{
+    for (int i = 0; i < sock_nns; i++)
+        sock_close(&sock_ns_list[i]);
+    sock_nns = 0;
+
+    int self = open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (self < 0 || procdir_rewind(&sock_netns_list) != 0) {
+        fprintf(stderr, "sockstat: cannot scan namespaces in %s, host only\n", sock_netns_dir);
+        sock_netns = 0;
+        if (self >= 0)
+            close(self);
+        return;
+    }
+    struct stat self_st;
+    fstat(self, &self_st);
+
+    const char *name;
+    char path[320];
+    while ((name = procdir_next(&sock_netns_list)) != NULL && sock_nns < SOCK_NETNS_MAX) {
+        if (name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", sock_netns_dir, name);
+        int nsfd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (nsfd < 0)
+            continue;
+        // our own namespace is already the host entry
+        if (fstat(nsfd, &st) != 0 || (st.st_dev == self_st.st_dev && st.st_ino == self_st.st_ino)) {
+            close(nsfd);
+            continue;
+        }
+        if (setns(nsfd, CLONE_NEWNET) != 0) {
+            perror("sockstat: setns (needs CAP_SYS_ADMIN), host only");
+            close(nsfd);
+            sock_netns = 0;
+            break;
+        }
+        sock_ns *ns = &sock_ns_list[sock_nns];
+        snprintf(ns->name, sizeof(ns->name), "%.*s", (int)sizeof(ns->name) - 1, name);
+        if (sock_open(ns) == 0)
+            sock_nns++;
+        close(nsfd);
+        if (setns(self, CLONE_NEWNET) != 0) {
+            perror("sockstat: setns back to our namespace");
+            exit(EXIT_FAILURE);
+        }
+    }
+    close(self);
+}
+
+// Least-squares slope of one history column, units per second.
+static double sock_slope(const double *y, int stride)
+{
+    int n = sock_len;
+    double t0 = sock_hist_t[sock_at(0)];
+    double st = 0.0, sy = 0.0, stt = 0.0, sty = 0.0;
+    for (int i = 0; i < n; i++) {
+        int k = sock_at(i);
+        double t = sock_hist_t[k] - t0;
+        st += t;
+        sy += y[k * stride];
+        stt += t * t;
+        sty += t * y[k * stride];
+    }
+    double den = n * stt - st * st;
+    return den > 0.0 ? (n * sty - st * sy) / den : 0.0;
+}
+
+static double sock_corr(const double *x, int xstride, const double *y, int ystride)
+{
+    int n = sock_len;
+    double mx = 0.0, my = 0.0;
+    for (int i = 0; i < n; i++) {
+        mx += x[sock_at(i) * xstride];
+        my += y[sock_at(i) * ystride];
+    }
+    mx /= n;
+    my /= n;
+    double sxy = 0.0, sxx = 0.0, syy = 0.0;
+    for (int i = 0; i < n; i++) {
+        double dx = x[sock_at(i) * xstride] - mx;
+        double dy = y[sock_at(i) * ystride] - my;
+        sxy += dx * dy;
+        sxx += dx * dx;
+        syy += dy * dy;
+    }
+    double den = sqrt(sxx * syy);
+    return den > 0.0 ? sxy / den : 0.0;
+}
+
+// Over the window, did the series rise by more than noise?
+static int sock_rising(const double *y, int stride)
+{
+    double first = y[sock_at(0) * stride];
+    double last = y[sock_at(sock_len - 1) * stride];
+    double span = sock_hist_t[sock_at(sock_len - 1)] - sock_hist_t[sock_at(0)];
+    double rise = sock_slope(y, stride) * span;
+    return last > first && rise > 16.0 && rise > 0.02 * first;
+}
+
+// Call after the slab rows are applied.
+void update_sockstat(void)
+{
+    if (!sock_enabled)
+        return;
+    if (sock_host.fd[0] < 0 && sock_open(&sock_host) != 0) {
+        perror("sockstat: /proc/thread-self/net/sockstat");
+        sock_enabled = 0;
+        return;
+    }
+    if (sock_netns && sock_cycle == 0)
+        sock_reserve();
+    if (sock_netns && sock_cycle % SOCK_NETNS_RESCAN == 0)
+        sock_rescan_netns();
+    sock_cycle++;
+
+    sock_read(&sock_host);
+    memcpy(sock_total, sock_host.v, sizeof(sock_total));
+    for (int i = 0; i < sock_nns; i++) {
+        sock_read(&sock_ns_list[i]);
+        for (int f = 0; f < SOCK_NFIELDS; f++)
+            if (sock_fields[f].per_net)
+                sock_total[sock_fields[f].ctr] += sock_ns_list[i].v[sock_fields[f].ctr];
+    }
+
+    for (int p = 0; p < SOCK_NPAIRS; p++) {
+        sock_cache[p] = NULL;
+        for (list *cur = get_slab_list_head(); cur; cur = cur->next)
+            if (strcmp(cur->slab->name, sock_pairs[p].cache) == 0) {
+                sock_cache[p] = cur->slab;
+                break;
+            }
+    }
+
+    int k = sock_head;
+    sock_hist_t[k] = slab_sample_ts.tv_sec + slab_sample_ts.tv_nsec / 1e9;
+    for (int c = 0; c < SC_COUNT; c++)
+        sock_hist_ctr[k][c] = (double)sock_total[c];
+    for (int p = 0; p < SOCK_NPAIRS; p++)
+        sock_hist_cache[k][p] = sock_cache[p] ? (double)slab_trend_objs(sock_cache[p]) : 0.0;
+    sock_head = (sock_head + 1) % SOCK_HISTORY;
+    if (sock_len < SOCK_HISTORY)
+        sock_len++;
+}
+
+void show_sockstat(void)
+{
+    if (!sock_enabled || sock_len == 0)
+        return;
+    const unsigned long long *v = sock_total;
+    unsigned long long page_kb = vm_page_kb;
+
+    rprintf("[SOCKSTAT] sockets=%llu tcp=%llu (orphan %llu, tw %llu, alloc %llu, mem %llu KB) "
+            "udp=%llu (mem %llu KB) tcp6=%llu udp6=%llu raw=%llu frag=%llu KB",
+            v[SC_SOCKETS], v[SC_TCP_INUSE], v[SC_TCP_ORPHAN], v[SC_TCP_TW], v[SC_TCP_ALLOC],
+            v[SC_TCP_MEM] * page_kb, v[SC_UDP_INUSE], v[SC_UDP_MEM] * page_kb,
+            v[SC_TCP6_INUSE], v[SC_UDP6_INUSE], v[SC_RAW_INUSE] + v[SC_RAW6_INUSE],
+            (v[SC_FRAG_MEMORY] + v[SC_FRAG6_MEMORY]) / 1024);
+    if (sock_netns)
+        rprintf(" over host + %d netns", sock_nns);
+    rprintf("\n");
+
+    // namespaces holding the most sockets
+    int shown[SOCK_NETNS_MAX] = {0};
+    for (int s = 0; s < SOCK_SHOW_NETNS; s++) {
+        int best = -1;
+        for (int i = 0; i < sock_nns; i++)
+            if (!shown[i] && sock_ns_list[i].v[SC_SOCKETS] > 0 &&
+                (best < 0 || sock_ns_list[i].v[SC_SOCKETS] > sock_ns_list[best].v[SC_SOCKETS]))
+                best = i;
+        if (best < 0)
+            break;
+        shown[best] = 1;
+        const sock_ns *ns = &sock_ns_list[best];
+        rprintf("[SOCKSTAT] netns %-16s sockets=%llu tcp=%llu tw=%llu udp=%llu tcp6=%llu udp6=%llu\n",
+                ns->name, ns->v[SC_SOCKETS], ns->v[SC_TCP_INUSE], ns->v[SC_TCP_TW],
+                ns->v[SC_UDP_INUSE], ns->v[SC_TCP6_INUSE], ns->v[SC_UDP6_INUSE]);
+    }
+
+    if (sock_len < SOCK_MIN_SAMPLES)
+        return;
+    // only the growing network caches get a verdict
+    for (int p = 0; p < SOCK_NPAIRS; p++) {
+        if (!sock_cache[p] || !sock_rising(&sock_hist_cache[0][p], SOCK_NPAIRS))
+            continue;
+        rprintf("[SOCKSTAT] %-18s objs=%u trend=%+.1f/min", sock_pairs[p].cache,
+                slab_trend_objs(sock_cache[p]), sock_slope(&sock_hist_cache[0][p], SOCK_NPAIRS) * 60.0);
+        int c = sock_pairs[p].ctr;
+        if (c < 0) {
+            rprintf(" (no socket counter to compare)\n");
+            continue;
+        }
+        double r = sock_corr(&sock_hist_cache[0][p], SOCK_NPAIRS, &sock_hist_ctr[0][c], SC_COUNT);
+        int follows = sock_rising(&sock_hist_ctr[0][c], SC_COUNT) && r > 0.6;
+        rprintf(" %s=%llu trend=%+.1f/min corr=%.2f", sock_pairs[p].what, sock_total[c],
+                sock_slope(&sock_hist_ctr[0][c], SC_COUNT) * 60.0, r);
+        if (c == SC_QUEUE_PAGES)
+            rprintf(follows ? " -> socket queue buildup\n"
+                            : " \033[1;33m-> skbs not held by socket queues, possible skb leak\033[0m\n");
+        else if (follows)
+            rprintf(" -> sockets being held open\n");
+        // inuse only counts hashed sockets; unbound ones still show up as used
+        else if (c != SC_SOCKETS && sock_rising(&sock_hist_ctr[0][SC_SOCKETS], SC_COUNT) &&
+                 sock_corr(&sock_hist_cache[0][p], SOCK_NPAIRS,
+                           &sock_hist_ctr[0][SC_SOCKETS], SC_COUNT) > 0.6)
+            rprintf(" -> unbound sockets being held open (sockets used follows)\n");
+        else
+            rprintf(" \033[1;33m-> objects outpace live sockets, possible socket leak\033[0m\n");
+    }
+}
+
+#endif // SOCKSTAT_H
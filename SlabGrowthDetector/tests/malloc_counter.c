@@ -0,0 +1,121 @@
+// LD_PRELOAD shim for the fixed-footprint test: counts every heap
+// allocation and uses the detector's own mallinfo2() calls as markers.
+// The first call (fixed_footprint_mark, after warm-up) starts the window,
+// every later one (fixed_footprint_check) closes it. At exit the process
+// fails if anything was allocated inside the window.
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t align, size_t size);
+
+static unsigned long mc_allocs;      // all allocations so far
+static unsigned long mc_mark;        // mc_allocs at the first mallinfo2()
+static unsigned long mc_checked;     // mc_allocs at the latest mallinfo2()
+static int mc_marked;
+static void *mc_first_caller;        // first allocation after the mark
+
+static void mc_count(void *caller)
+{
+    __atomic_add_fetch(&mc_allocs, 1, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&mc_marked, __ATOMIC_ACQUIRE) && !mc_first_caller)
+        mc_first_caller = caller;
+}
+
+void *malloc(size_t size)
+{
+    mc_count(__builtin_return_address(0));
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    mc_count(__builtin_return_address(0));
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    mc_count(__builtin_return_address(0));
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t align, size_t size)
+{
+    mc_count(__builtin_return_address(0));
+    return __libc_memalign(align, size);
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    mc_count(__builtin_return_address(0));
+    return __libc_memalign(align, size);
+}
+
+int posix_memalign(void **out, size_t align, size_t size)
+{
+    mc_count(__builtin_return_address(0));
+    void *p = __libc_memalign(align, size);
+    if (!p)
+        return ENOMEM;
+    *out = p;
+    return 0;
+}
+
+static struct mallinfo2 (*mc_real_mallinfo2)(void);
+
+// resolved up front: dlsym() allocates, which must not land in the window
+__attribute__((constructor))
+static void mc_init(void)
+{
+    mc_real_mallinfo2 = (struct mallinfo2 (*)(void))dlsym(RTLD_NEXT, "mallinfo2");
+}
+
+struct mallinfo2 mallinfo2(void)
+{
+    unsigned long now = __atomic_load_n(&mc_allocs, __ATOMIC_RELAXED);
+    if (!mc_marked) {
+        mc_mark = mc_checked = now;
+        mc_first_caller = NULL;
+        __atomic_store_n(&mc_marked, 1, __ATOMIC_RELEASE);
+    } else {
+        mc_checked = now;
+    }
+    return mc_real_mallinfo2();
+}
+
+__attribute__((destructor))
+static void mc_report(void)
+{
+    char line[256];
+    int n;
+    if (!mc_marked) {
+        n = snprintf(line, sizeof(line), "malloc_counter: no warm-up mark, was --fixed-footprint given?\n");
+        write(2, line, n);
+        _exit(1);
+    }
+    unsigned long steady = mc_checked - mc_mark;
+    n = snprintf(line, sizeof(line), "malloc_counter: %lu allocations at startup, %lu in steady state\n",
+                 mc_mark, steady);
+    write(2, line, n);
+    if (steady == 0)
+        return;
+
+    Dl_info info;
+    if (mc_first_caller && dladdr(mc_first_caller, &info) && info.dli_fname) {
+        n = snprintf(line, sizeof(line), "malloc_counter: first from %s+%#lx (%s)\n",
+                     info.dli_fname, (unsigned long)((char *)mc_first_caller - (char *)info.dli_fbase),
+                     info.dli_sname ? info.dli_sname : "?");
+        write(2, line, n);
+    }
+    _exit(1);
+}
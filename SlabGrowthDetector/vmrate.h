@@ -0,0 +1,175 @@
+#ifndef VMRATE_H
+#define VMRATE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "report.h"
+
+// Per-second rates for every /proc/vmstat counter plus the reclaim metrics
+// derived from them. Works on the dense vm_values[] array from vmstatlist.h.
+
+typedef struct
+{
+    double dt;                    // seconds between the last two samples
+    double pgalloc_kb_per_sec;    // all zones, not just pgalloc_dma
+    double pgscan_per_sec;
+    double pgsteal_per_sec;
+    double reclaim_efficiency;    // pgsteal / pgscan, 0..1
+    double slabs_scanned_per_sec;
+    double shrinker_yield;        // reclaimable slab pages freed per object scanned
+    double compact_stall_per_sec;
+    double compact_fail_per_sec;
+    double compact_success_per_sec;
+    double allocstall_per_sec;    // direct reclaim entries, all zones
+} vmrate_derived;
+
+static unsigned long long vm_prev[MAX_VMSTAT];
+static double vm_rate[MAX_VMSTAT];
+static struct timespec vm_prev_ts;
+static int vm_prev_valid = 0;
+static int vm_prev_count = 0;
+static int vm_seeded = 0;     // slots below this have a vm_prev sample
+static vmrate_derived vm_derived;
+
+// dense slots of the counters the derived metrics need, resolved once
+static int vmr_pgalloc[16], vmr_pgalloc_n = 0;
+static int vmr_allocstall[16], vmr_allocstall_n = 0;
+static int vmr_pgscan[4], vmr_pgsteal[4];
+static int vmr_slabs_scanned = -1, vmr_reclaimable = -1;
+static int vmr_compact_stall = -1, vmr_compact_fail = -1, vmr_compact_success = -1;
+
+static int vmrate_slot(const char *name)
+{
+    struct vmstat *v = list_find_vmstat(name);
+    return v ? v->idx : -1;
+}
+
+static void vmrate_resolve(void)
+{
+    // direct, kswapd, khugepaged and proactive reclaim; the _anon/_file
+    // counters split the same pages a second way and must not be added
+    static const char *scan[4] = {"pgscan_kswapd", "pgscan_direct",
+                                  "pgscan_khugepaged", "pgscan_proactive"};
+    static const char *steal[4] = {"pgsteal_kswapd", "pgsteal_direct",
+                                   "pgsteal_khugepaged", "pgsteal_proactive"};
+    for (int i = 0; i < 4; i++) {
+        vmr_pgscan[i] = vmrate_slot(scan[i]);
+        vmr_pgsteal[i] = vmrate_slot(steal[i]);
+    }
+
+    vmr_pgalloc_n = vmr_allocstall_n = 0;
+    struct list_head *pos;
+    for (pos = vmstat_head.next; pos != &vmstat_head; pos = pos->next) {
+        struct vmstat *e = list_entry(pos, struct vmstat, list_head);
+        if (e->idx < 0)
+            continue;
+        if (strncmp(e->name, "pgalloc_", 8) == 0 && vmr_pgalloc_n < 16)
+            vmr_pgalloc[vmr_pgalloc_n++] = e->idx;
+        else if (strncmp(e->name, "allocstall_", 11) == 0 && vmr_allocstall_n < 16)
+            vmr_allocstall[vmr_allocstall_n++] = e->idx;
+    }
+
+    vmr_slabs_scanned = vmrate_slot("slabs_scanned");
+    vmr_reclaimable = vmrate_slot("nr_slab_reclaimable");
+    vmr_compact_stall = vmrate_slot("compact_stall");
+    vmr_compact_fail = vmrate_slot("compact_fail");
+    vmr_compact_success = vmrate_slot("compact_success");
+}
+
+static double vmrate_sum(const int *slots, int n)
+{
+    double sum = 0.0;
+    for (int i = 0; i < n; i++)
+        if (slots[i] >= 0)
+            sum += vm_rate[slots[i]];
+    return sum;
+}
+
+static double vmrate_at(int slot)
+{
+    return slot >= 0 ? vm_rate[slot] : 0.0;
+}
+
+// Call right after parse_vmstat(). Counter deltas are taken in unsigned
+// 64-bit arithmetic, so a counter that wraps still yields the right delta.
+// Slots are handed out in order and never reused, so counters that appear
+// after startup are the ones past vm_seeded; their rate stays 0 until
+// their second sample.
+void vmrate_update(void)
+{
+    if (vm_count != vm_prev_count) {
+        vmrate_resolve();
+        vm_prev_count = vm_count;
+    }
+
+    if (!vm_prev_valid) {
+        memcpy(vm_prev, vm_values, sizeof(vm_prev[0]) * vm_count);
+        vm_prev_ts = vm_sample_ts;
+        vm_prev_valid = 1;
+        vm_seeded = vm_count;
+        return;
+    }
+
+    int n = vm_count;
+    for (int i = vm_seeded; i < n; i++)
+        vm_prev[i] = vm_values[i];
+    vm_seeded = n;
+
+    double dt = (vm_sample_ts.tv_sec - vm_prev_ts.tv_sec) +
+                (vm_sample_ts.tv_nsec - vm_prev_ts.tv_nsec) / 1e9;
+    if (dt <= 0.0)
+        return;
+
+    double inv_dt = 1.0 / dt;
+    // one flat sweep over the dense arrays; plain enough to vectorize
+    for (int i = 0; i < n; i++)
+        vm_rate[i] = (double)(long long)(vm_values[i] - vm_prev[i]) * inv_dt;
+
+    vmrate_derived *d = &vm_derived;
+    d->dt = dt;
+    d->pgalloc_kb_per_sec = vmrate_sum(vmr_pgalloc, vmr_pgalloc_n) * vm_page_kb;
+    d->allocstall_per_sec = vmrate_sum(vmr_allocstall, vmr_allocstall_n);
+    d->pgscan_per_sec = vmrate_sum(vmr_pgscan, 4);
+    d->pgsteal_per_sec = vmrate_sum(vmr_pgsteal, 4);
+    d->reclaim_efficiency = d->pgscan_per_sec > 0.0
+                                ? d->pgsteal_per_sec / d->pgscan_per_sec : 0.0;
+    d->slabs_scanned_per_sec = vmrate_at(vmr_slabs_scanned);
+    // nr_slab_reclaimable is a gauge: a negative rate means pages were freed
+    double freed = -vmrate_at(vmr_reclaimable);
+    d->shrinker_yield = (d->slabs_scanned_per_sec > 0.0 && freed > 0.0)
+                            ? freed / d->slabs_scanned_per_sec : 0.0;
+    d->compact_stall_per_sec = vmrate_at(vmr_compact_stall);
+    d->compact_fail_per_sec = vmrate_at(vmr_compact_fail);
+    d->compact_success_per_sec = vmrate_at(vmr_compact_success);
+
+    memcpy(vm_prev, vm_values, sizeof(vm_prev[0]) * n);
+    vm_prev_ts = vm_sample_ts;
+}
+
+double get_vmstat_rate(const char *name)
+{
+    return vmrate_at(vmrate_slot(name));
+}
+
+const vmrate_derived *get_vmrate_derived(void)
+{
+    return &vm_derived;
+}
+
+void show_vmrate_summary(void)
+{
+    const vmrate_derived *d = &vm_derived;
+    rprintf("[RECLAIM] alloc=%.0fKB/s scan=%.0f/s steal=%.0f/s efficiency=%.1f%% "
+            "slabs_scanned=%.0f/s shrinker_yield=%.4f\n",
+            d->pgalloc_kb_per_sec, d->pgscan_per_sec, d->pgsteal_per_sec,
+            d->reclaim_efficiency * 100.0, d->slabs_scanned_per_sec,
+            d->shrinker_yield);
+    if (d->compact_stall_per_sec > 0.0 || d->allocstall_per_sec > 0.0) {
+        rprintf("\033[1;33m[RECLAIM] compact stall=%.2f/s fail=%.2f/s success=%.2f/s allocstall=%.2f/s\033[0m\n",
+                d->compact_stall_per_sec, d->compact_fail_per_sec,
+                d->compact_success_per_sec, d->allocstall_per_sec);
+    }
+}
+
+#endif // VMRATE_H
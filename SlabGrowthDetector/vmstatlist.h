@@ -3,13 +3,17 @@
 
 
 #include <stdio.h>
+#include <time.h>
+#include "procfile.h"
+#include "report.h"
 
 #define INIT_SNAPSHOT_vm 1
 #define CHECK_SNAPSHOT_vm 2
 
 #define READ_END 0
 #define WRITE_END 1
-#define INTERVAL 5
+// dense slots for the rate engine (vmrate.h); /proc/vmstat has ~200 keys
+#define MAX_VMSTAT 512
 
 #define INIT_LIST_HEAD(ptr) do { \
 (ptr)->next = (ptr); (ptr)->prev = (ptr); \
@@ -27,22 +31,25 @@ typedef struct list_head{
 typedef struct vmstat{
     struct list_head list_head;
     char name[100];
-    unsigned int stats;
+    unsigned long long stats;
+    int idx;                 // slot in vm_values[]
 }vmstat;
 /*struct zone{
     struct vmstat vmstat[100];
 };*/
 typedef struct diffvm{
     char name[100];
-    unsigned int statsdiff;
+    unsigned long long statsdiff;
 }diffvm;
 
-struct diffvm list_update_or_add_vmstat(const char *name, unsigned int new_stats);
+struct diffvm list_update_or_add_vmstat(const char *name, unsigned long long new_stats);
 struct vmstat* list_find_vmstat(const char *name);
 void list_add_vmstat(struct vmstat *new_stat);
 void init_vmstat_list();
+int read_vmstat();
+void parse_vmstat_buffer();
 void parse_vmstat();
-unsigned int get_vmstat(const char *name);
+unsigned long long get_vmstat(const char *name);
 void show_vmstat_summary();
 
 #include <stdlib.h>
@@ -50,6 +57,12 @@ void show_vmstat_summary();
 
 struct list_head vmstat_head;
 
+// every counter also lives in a dense array indexed by vmstat.idx so the
+// rate engine can sweep all of them in one loop
+static unsigned long long vm_values[MAX_VMSTAT];
+static int vm_count = 0;
+static struct timespec vm_sample_ts; // CLOCK_MONOTONIC of the last parse
+
 void list_add_vmstat(struct vmstat *new_stat) {
     new_stat->list_head.next = vmstat_head.next;
     new_stat->list_head.prev = &vmstat_head;
@@ -66,7 +79,7 @@ struct vmstat* list_find_vmstat(const char *name) {
     return NULL;
 }
 
-struct diffvm list_update_or_add_vmstat(const char *name, unsigned int new_stats) {
+struct diffvm list_update_or_add_vmstat(const char *name, unsigned long long new_stats) {
     struct diffvm d;
     strcpy(d.name, name);
     d.statsdiff = 0;
@@ -75,10 +88,15 @@ struct diffvm list_update_or_add_vmstat(const char *name, unsigned int new_stats
     if (entry) {
         d.statsdiff = new_stats - entry->stats;
         entry->stats = new_stats;
+        if (entry->idx >= 0)
+            vm_values[entry->idx] = new_stats;
     } else {
-        struct vmstat *new_entry = malloc(sizeof(struct vmstat));
+        struct vmstat *new_entry = kml_alloc(sizeof(struct vmstat), "vmstat list");
         strcpy(new_entry->name, name);
         new_entry->stats = new_stats;
+        new_entry->idx = (vm_count < MAX_VMSTAT) ? vm_count++ : -1;
+        if (new_entry->idx >= 0)
+            vm_values[new_entry->idx] = new_stats;
         list_add_vmstat(new_entry);
     }
 
@@ -86,29 +104,64 @@ struct diffvm list_update_or_add_vmstat(const char *name, unsigned int new_stats
 }
 
 
+// vmstat, meminfo and sockstat count pages; their size in KB, taken once
+// (4 on x86, 16 or 64 on some arm64 and ppc64 kernels)
+static unsigned long vm_page_kb = 4;
+
 void init_vmstat_list()
 {
     INIT_LIST_HEAD(&vmstat_head);
+    long page = sysconf(_SC_PAGESIZE);
+    if (page >= 1024)
+        vm_page_kb = (unsigned long)page / 1024;
 }
 
-void parse_vmstat()
+static procfile vmstat_file = PROCFILE_INIT("/proc/vmstat");
+
+int read_vmstat()
 {
-    FILE *fp = fopen("/proc/vmstat", "r");
-    if (!fp)
+    clock_gettime(CLOCK_MONOTONIC, &vm_sample_ts);
+    if (procfile_read(&vmstat_file) < 0)
     {
-        perror("fopen /proc/vmstat");
-        return;
+        perror("read /proc/vmstat");
+        vmstat_file.len = 0;
+        return -1;
     }
+    return 0;
+}
+
+// "name value\n" line; returns 0 and fills name/value on success
+int parse_vmstat_line(const char *line, char *name, size_t name_len,
+                      unsigned long long *value)
+{
+    const char *sp = strchr(line, ' ');
+    if (!sp || (size_t)(sp - line) >= name_len)
+        return -1;
+    memcpy(name, line, sp - line);
+    name[sp - line] = '\0';
+    *value = strtoull(sp + 1, NULL, 10);
+    return 0;
+}
+
+void parse_vmstat_buffer()
+{
     char name[128];
-    unsigned long long val;
-    while (fscanf(fp, "%127s %llu", name, &val) == 2)
+    unsigned long long value;
+    for (char *line = vmstat_file.len ? vmstat_file.buf : NULL; line;
+         line = procfile_next_line(line))
     {
-        list_update_or_add_vmstat(name, (unsigned int)val);
+        if (parse_vmstat_line(line, name, sizeof(name), &value) == 0)
+            list_update_or_add_vmstat(name, value);
     }
-    fclose(fp);
 }
 
-unsigned int get_vmstat(const char *name)
+void parse_vmstat()
+{
+    if (read_vmstat() == 0)
+        parse_vmstat_buffer();
+}
+
+unsigned long long get_vmstat(const char *name)
 {
     struct vmstat *entry = list_find_vmstat(name);
     return entry ? entry->stats : 0;
@@ -116,12 +169,12 @@ unsigned int get_vmstat(const char *name)
 
 void show_vmstat_summary()
 {
-    unsigned int memfree = get_vmstat("nr_free_pages");
-    unsigned int reclaim = get_vmstat("nr_slab_reclaimable");
-    unsigned int unreclaim = get_vmstat("nr_slab_unreclaimable");
+    unsigned long long memfree = get_vmstat("nr_free_pages");
+    unsigned long long reclaim = get_vmstat("nr_slab_reclaimable");
+    unsigned long long unreclaim = get_vmstat("nr_slab_unreclaimable");
 
-    printf("[VMSTAT] free_pages=%u reclaimable=%u unreclaimable=%u\n",
-           memfree, reclaim, unreclaim);
+    rprintf("[VMSTAT] free_pages=%llu reclaimable=%llu unreclaimable=%llu\n",
+            memfree, reclaim, unreclaim);
 }
 
 